@@ -13,6 +13,8 @@ struct CPUBranch
     float radius;
     float bfsDepth;   // BFS level
     int   parentIndex; // -1 if no parent
+    float birth = 0.f;  // growth clock (0..1): segment starts growing
+    float grown = 0.f;  //   ... and reaches full length (<= birth: always grown)
 };
 
 /**
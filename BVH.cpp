@@ -4,12 +4,17 @@
 
     Recursively splits the longest axis at object median
     Stops when leaf size ? 8
-    Node layout / leaf flag identical to previous shader contract
+    Node layout / leaf flag identical to previous shader contract,
+     internal lo = skip link (left child is implicit, see BVH.hpp)
    --------------------------------------------------------------------------*/
 #include "BVH.hpp"
+#include "DynamicBVH.hpp"
 #include <algorithm>
+#include <cfloat>
 #include <stack>
 
+static const uint32_t LEAF_SIZE = 8u;
+
    /* ---------- helpers ---------------------------------------------------- */
 static void branchBounds(const CPUBranch& b, glm::vec3& mn, glm::vec3& mx)
 {
@@ -25,9 +30,9 @@ static uint32_t buildNode(BuiltBVH& out,
     const std::vector<glm::vec3>& bmn,
     const std::vector<glm::vec3>& bmx,
     std::vector<uint32_t>& indices,
-    uint32_t first, uint32_t count)
+    uint32_t first, uint32_t count,
+    uint32_t leafSize = LEAF_SIZE)
 {
-    const uint32_t LEAF_SIZE = 8u;
     uint32_t myIndex = (uint32_t)out.nodes.size();
     out.nodes.emplace_back();              /* reserve slot */
 
@@ -39,7 +44,7 @@ static uint32_t buildNode(BuiltBVH& out,
     }
 
     /* leaf? ------------------------------------------------------------- */
-    if (count <= LEAF_SIZE) {
+    if (count <= leafSize) {
         uint32_t start = (uint32_t)out.leafIdx.size();
         out.leafIdx.insert(out.leafIdx.end(),
             indices.begin() + first,
@@ -70,20 +75,473 @@ static uint32_t buildNode(BuiltBVH& out,
             return ca < cb;
         });
 
-    uint32_t left = buildNode(out, br, bmn, bmx, indices, first, mid - first);
-    uint32_t right = buildNode(out, br, bmn, bmx, indices, mid, count - (mid - first));
+    buildNode(out, br, bmn, bmx, indices, first, mid - first, leafSize);      /* = myIndex + 1 */
+    uint32_t right = buildNode(out, br, bmn, bmx, indices, mid, count - (mid - first), leafSize);
 
     /* fill this internal node ----------------------------------------- */
     BvhNode n;
     n.mn = mn;  n.mx = mx;
-    n.lo = left;
+    n.lo = (uint32_t)out.nodes.size();     /* skip link: past the subtree */
     n.hi = right;               /* hi bit clear = internal */
     out.nodes[myIndex] = n;
     return myIndex;
 }
 
+/* ---------- binned SAH ------------------------------------------------- */
+static float halfArea(const glm::vec3& mn, const glm::vec3& mx)
+{
+    glm::vec3 e = glm::max(mx - mn, glm::vec3(0.f));
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+struct SahSplit { int axis = -1; float pos = 0.f; float cost = FLT_MAX; };
+
+/* Best plane over `ids` (bounds pmn/pmx, weight = primitives inside);
+   cost = A(L) * wL + A(R) * wR, unnormalised.                         */
+static SahSplit binnedSAH(const std::vector<glm::vec3>& pmn,
+    const std::vector<glm::vec3>& pmx,
+    const std::vector<uint32_t>& weight,
+    const std::vector<uint32_t>& ids)
+{
+    const int BINS = 16;
+    SahSplit best;
+
+    glm::vec3 cmn(FLT_MAX), cmx(-FLT_MAX);
+    for (uint32_t i : ids) {
+        glm::vec3 c = 0.5f * (pmn[i] + pmx[i]);
+        cmn = glm::min(cmn, c); cmx = glm::max(cmx, c);
+    }
+
+    for (int a = 0; a < 3; ++a) {
+        float ext = cmx[a] - cmn[a];
+        if (!(ext > 0.f)) continue;
+
+        glm::vec3 bmn[BINS], bmx[BINS];
+        uint32_t  cnt[BINS] = {};
+        for (int k = 0; k < BINS; ++k) { bmn[k] = glm::vec3(FLT_MAX); bmx[k] = glm::vec3(-FLT_MAX); }
+
+        for (uint32_t i : ids) {
+            float c = 0.5f * (pmn[i][a] + pmx[i][a]);
+            int k = std::min(BINS - 1, int(BINS * (c - cmn[a]) / ext));
+            bmn[k] = glm::min(bmn[k], pmn[i]); bmx[k] = glm::max(bmx[k], pmx[i]);
+            cnt[k] += weight[i];
+        }
+
+        /* sweep right-to-left, then left-to-right */
+        float rCost[BINS];
+        glm::vec3 mn(FLT_MAX), mx(-FLT_MAX); uint32_t n = 0;
+        for (int k = BINS - 1; k > 0; --k) {
+            mn = glm::min(mn, bmn[k]); mx = glm::max(mx, bmx[k]); n += cnt[k];
+            rCost[k] = n ? halfArea(mn, mx) * float(n) : 0.f;
+        }
+        mn = glm::vec3(FLT_MAX); mx = glm::vec3(-FLT_MAX); n = 0;
+        for (int k = 0; k < BINS - 1; ++k) {
+            mn = glm::min(mn, bmn[k]); mx = glm::max(mx, bmx[k]); n += cnt[k];
+            if (n == 0 || rCost[k + 1] == 0.f) continue;
+            float cost = halfArea(mn, mx) * float(n) + rCost[k + 1];
+            if (cost < best.cost) {
+                best.cost = cost; best.axis = a;
+                best.pos = cmn[a] + ext * float(k + 1) / float(BINS);
+            }
+        }
+    }
+    return best;
+}
+
+/* ---------- topology-aware builder -------------------------------------
+   1. Post-order over the branch tree: every branch keeps a pending group
+      (itself + whatever its children handed up).  Small child groups are
+      merged in; once a group would exceed LEAF_SIZE the leftovers are
+      packed into sibling clusters and emitted.  Clusters are therefore
+      connected pieces of the plant - spatially tight, linear to build.
+   2. Top-down over clusters: at every node compare the best topology cut
+      (the cluster subtree holding ~half the branches vs. the rest) with a
+      binned SAH plane over cluster centroids, and take the cheaper.  Where
+      subtrees interleave the spatial plane wins automatically.
+   ------------------------------------------------------------------------*/
+struct TopoCtx {
+    std::vector<std::vector<uint32_t>> clusters;   /* branch ids          */
+    std::vector<int>       parent;                 /* parent cluster / -1 */
+    std::vector<glm::vec3> mn, mx;
+    std::vector<uint32_t>  weight;                 /* = clusters[c].size() */
+    std::vector<int>       mark, inSetParent;      /* scratch             */
+    std::vector<uint32_t>  sub;                    /* scratch             */
+    std::vector<uint8_t>   inCut;                  /* scratch             */
+    int stamp = 0;
+};
+
+static void makeClusters(TopoCtx& ctx, const std::vector<CPUBranch>& br,
+    const std::vector<glm::vec3>& bmn, const std::vector<glm::vec3>& bmx)
+{
+    const uint32_t N = (uint32_t)br.size();
+    std::vector<std::vector<uint32_t>> kids(N);
+    std::vector<uint32_t> roots;
+    for (uint32_t i = 0; i < N; ++i) {
+        int p = br[i].parentIndex;
+        if (p >= 0 && uint32_t(p) < N && uint32_t(p) != i) kids[p].push_back(i);
+        else roots.push_back(i);
+    }
+
+    /* iterative post-order (the L-system can nest deeper than the stack) */
+    std::vector<uint32_t> post; post.reserve(N);
+    {
+        std::vector<std::pair<uint32_t, size_t>> st;
+        for (uint32_t r : roots) {
+            st.push_back({ r, 0 });
+            while (!st.empty()) {
+                auto& [b, k] = st.back();
+                if (k < kids[b].size()) { uint32_t c = kids[b][k++]; st.push_back({ c, 0 }); }
+                else { post.push_back(b); st.pop_back(); }
+            }
+        }
+    }
+
+    auto emit = [&](std::vector<uint32_t>&& g) { ctx.clusters.push_back(std::move(g)); };
+
+    /* group bounds are tracked alongside so merges can be SAH-checked */
+    struct Box { glm::vec3 mn{ FLT_MAX }, mx{ -FLT_MAX }; };
+    auto grow = [](Box a, const Box& b) { a.mn = glm::min(a.mn, b.mn); a.mx = glm::max(a.mx, b.mx); return a; };
+    std::vector<Box> pbox(N);
+
+    /* merge only if one leaf is no dearer than two leaves + their parent */
+    auto worthMerging = [&](const Box& a, size_t na, const Box& b, size_t nb) {
+        Box u = grow(a, b);
+        float merged = halfArea(u.mn, u.mx) * float(na + nb);
+        float split = halfArea(u.mn, u.mx) + halfArea(a.mn, a.mx) * float(na) + halfArea(b.mn, b.mx) * float(nb);
+        return na + nb <= LEAF_SIZE && merged <= split;
+    };
+
+    std::vector<std::vector<uint32_t>> pend(N);
+    for (uint32_t b : post) {
+        std::vector<uint32_t> groups;                /* children with pending */
+        for (uint32_t c : kids[b]) if (!pend[c].empty()) groups.push_back(c);
+        std::sort(groups.begin(), groups.end(),
+            [&](uint32_t x, uint32_t y) { return pend[x].size() < pend[y].size(); });
+
+        std::vector<uint32_t> cur{ b };
+        Box curBox{ bmn[b], bmx[b] };
+        std::vector<uint32_t> rest;
+        for (uint32_t c : groups) {
+            if (worthMerging(curBox, cur.size(), pbox[c], pend[c].size())) {
+                cur.insert(cur.end(), pend[c].begin(), pend[c].end());
+                curBox = grow(curBox, pbox[c]);
+            }
+            else rest.push_back(c);
+        }
+
+        /* first-fit decreasing over the leftovers: siblings share a joint */
+        std::vector<std::vector<uint32_t>> bins;
+        std::vector<Box> binBox;
+        for (auto it = rest.rbegin(); it != rest.rend(); ++it) {
+            const std::vector<uint32_t>& g = pend[*it];
+            size_t k = 0;
+            while (k < bins.size() && !worthMerging(binBox[k], bins[k].size(), pbox[*it], g.size())) ++k;
+            if (k == bins.size()) { bins.push_back(g); binBox.push_back(pbox[*it]); }
+            else { bins[k].insert(bins[k].end(), g.begin(), g.end()); binBox[k] = grow(binBox[k], pbox[*it]); }
+        }
+        for (auto& bin : bins) emit(std::move(bin));
+        for (uint32_t c : kids[b]) { pend[c].clear(); pend[c].shrink_to_fit(); }
+        pend[b] = std::move(cur);
+        pbox[b] = curBox;
+    }
+    for (uint32_t r : roots) if (!pend[r].empty()) emit(std::move(pend[r]));
+
+    /* cluster links + bounds; group[0] is always the cluster's top branch */
+    const uint32_t C = (uint32_t)ctx.clusters.size();
+    std::vector<uint32_t> clusterOf(N);
+    for (uint32_t c = 0; c < C; ++c)
+        for (uint32_t b : ctx.clusters[c]) clusterOf[b] = c;
+
+    ctx.parent.assign(C, -1);
+    ctx.mn.assign(C, glm::vec3(FLT_MAX));
+    ctx.mx.assign(C, glm::vec3(-FLT_MAX));
+    ctx.weight.resize(C);
+    for (uint32_t c = 0; c < C; ++c) {
+        int p = br[ctx.clusters[c][0]].parentIndex;
+        if (p >= 0 && uint32_t(p) < N && clusterOf[p] != c) ctx.parent[c] = int(clusterOf[p]);
+        for (uint32_t b : ctx.clusters[c]) {
+            ctx.mn[c] = glm::min(ctx.mn[c], bmn[b]);
+            ctx.mx[c] = glm::max(ctx.mx[c], bmx[b]);
+        }
+        ctx.weight[c] = (uint32_t)ctx.clusters[c].size();
+    }
+    ctx.mark.assign(C, 0);
+    ctx.inSetParent.assign(C, -1);
+    ctx.sub.assign(C, 0);
+    ctx.inCut.assign(C, 0);
+}
+
+static uint32_t buildTopoNode(BuiltBVH& out, TopoCtx& ctx,
+    std::vector<uint32_t>& set)
+{
+    uint32_t myIndex = (uint32_t)out.nodes.size();
+    out.nodes.emplace_back();
+
+    glm::vec3 mn(FLT_MAX), mx(-FLT_MAX);
+    uint32_t total = 0;
+    for (uint32_t c : set) {
+        mn = glm::min(mn, ctx.mn[c]); mx = glm::max(mx, ctx.mx[c]);
+        total += ctx.weight[c];
+    }
+
+    /* leaf: one cluster, or several that still fit ---------------------- */
+    if (set.size() == 1 || total <= LEAF_SIZE) {
+        BvhNode n;
+        n.mn = mn; n.mx = mx;
+        n.lo = (uint32_t)out.leafIdx.size();
+        for (uint32_t c : set)
+            out.leafIdx.insert(out.leafIdx.end(), ctx.clusters[c].begin(), ctx.clusters[c].end());
+        n.hi = total | 0x80000000u;
+        out.nodes[myIndex] = n;
+        return myIndex;
+    }
+
+    /* topology cut: in-set subtree weights, children before parents ---- */
+    const int stamp = ++ctx.stamp;
+    std::sort(set.begin(), set.end());               /* ancestors emit last */
+    for (uint32_t c : set) ctx.mark[c] = stamp;
+    for (uint32_t c : set) {
+        int p = ctx.parent[c];
+        while (p >= 0 && ctx.mark[p] != stamp) p = ctx.parent[p];
+        ctx.inSetParent[c] = p;
+        ctx.sub[c] = ctx.weight[c];
+    }
+    for (uint32_t c : set)
+        if (ctx.inSetParent[c] >= 0) ctx.sub[ctx.inSetParent[c]] += ctx.sub[c];
+
+    int cut = -1; uint32_t bestGap = UINT32_MAX;
+    for (uint32_t c : set) {
+        if (ctx.sub[c] == total) continue;           /* whole set - no cut */
+        uint32_t gap = (uint32_t)std::abs(int(2 * ctx.sub[c]) - int(total));
+        if (gap < bestGap) { bestGap = gap; cut = int(c); }
+    }
+
+    std::vector<uint32_t> left, right;
+    float topoCost = FLT_MAX;
+    if (cut >= 0) {
+        /* descending ids visit parents first, so membership propagates */
+        for (auto it = set.rbegin(); it != set.rend(); ++it) {
+            uint32_t c = *it;
+            int p = ctx.inSetParent[c];
+            ctx.inCut[c] = (int(c) == cut) || (p >= 0 && ctx.inCut[p]);
+            (ctx.inCut[c] ? left : right).push_back(c);
+        }
+
+        glm::vec3 lmn(FLT_MAX), lmx(-FLT_MAX), rmn(FLT_MAX), rmx(-FLT_MAX);
+        uint32_t lw = 0, rw = 0;
+        for (uint32_t c : left) { lmn = glm::min(lmn, ctx.mn[c]); lmx = glm::max(lmx, ctx.mx[c]); lw += ctx.weight[c]; }
+        for (uint32_t c : right) { rmn = glm::min(rmn, ctx.mn[c]); rmx = glm::max(rmx, ctx.mx[c]); rw += ctx.weight[c]; }
+        topoCost = halfArea(lmn, lmx) * float(lw) + halfArea(rmn, rmx) * float(rw);
+    }
+
+    /* spatial fallback -------------------------------------------------- */
+    SahSplit sah = binnedSAH(ctx.mn, ctx.mx, ctx.weight, set);
+    if (sah.axis >= 0 && sah.cost < topoCost) {
+        left.clear(); right.clear();
+        for (uint32_t c : set) {
+            float cc = 0.5f * (ctx.mn[c][sah.axis] + ctx.mx[c][sah.axis]);
+            (cc < sah.pos ? left : right).push_back(c);
+        }
+    }
+    if (left.empty() || right.empty()) {             /* coincident centroids */
+        left.assign(set.begin(), set.begin() + set.size() / 2);
+        right.assign(set.begin() + set.size() / 2, set.end());
+    }
+
+    buildTopoNode(out, ctx, left);
+    uint32_t r = buildTopoNode(out, ctx, right);
+
+    BvhNode n;
+    n.mn = mn; n.mx = mx;
+    n.lo = (uint32_t)out.nodes.size();     /* skip link */
+    n.hi = r;
+    out.nodes[myIndex] = n;
+    return myIndex;
+}
+
+/* ---------- SBVH --------------------------------------------------------
+   Binned object SAH as usual; where the two object halves overlap by more
+   than kOverlap of the root, also try spatial planes.  A capsule crossing
+   the chosen plane is cut at it (refs carry segment parameters, bounds
+   are recomputed per piece), as long as the duplication budget lasts.
+   ------------------------------------------------------------------------*/
+struct SbvhRef {
+    uint32_t  id;
+    float     t0, t1;
+    glm::vec3 mn, mx;
+};
+
+struct SbvhCtx {
+    const std::vector<CPUBranch>* br = nullptr;
+    float    rootHalfArea = 0.f;
+    uint32_t budget = 0, extra = 0;
+};
+
+static glm::vec3 segPoint(const CPUBranch& b, float t)
+{
+    glm::vec3 s(b.startX, b.startY, b.startZ), e(b.endX, b.endY, b.endZ);
+    return s + (e - s) * t;
+}
+
+static SbvhRef makeRef(const CPUBranch& b, uint32_t id, float t0, float t1)
+{
+    glm::vec3 a = segPoint(b, t0), e = segPoint(b, t1);
+    return { id, t0, t1, glm::min(a, e) - b.radius, glm::max(a, e) + b.radius };
+}
+
+/* parameter where the ref's segment crosses coordinate `pos` on `axis` */
+static float crossParam(const CPUBranch& b, const SbvhRef& r, int axis, float pos)
+{
+    float a = segPoint(b, r.t0)[axis], e = segPoint(b, r.t1)[axis];
+    float u = (e != a) ? std::clamp((pos - a) / (e - a), 0.f, 1.f) : 0.5f;
+    return r.t0 + (r.t1 - r.t0) * u;
+}
+
+static SahSplit spatialSAH(const SbvhCtx& ctx, const std::vector<SbvhRef>& refs,
+    const glm::vec3& nmn, const glm::vec3& nmx)
+{
+    const int BINS = 16;
+    SahSplit best;
+
+    for (int a = 0; a < 3; ++a) {
+        float lo = nmn[a], ext = nmx[a] - nmn[a];
+        if (!(ext > 0.f)) continue;
+        auto binOf = [&](float x) { return std::clamp(int(BINS * (x - lo) / ext), 0, BINS - 1); };
+
+        glm::vec3 bmn[BINS], bmx[BINS];
+        uint32_t enter[BINS] = {}, exit[BINS] = {};
+        for (int k = 0; k < BINS; ++k) { bmn[k] = glm::vec3(FLT_MAX); bmx[k] = glm::vec3(-FLT_MAX); }
+
+        for (const SbvhRef& r : refs) {
+            const CPUBranch& b = (*ctx.br)[r.id];
+            float sa = segPoint(b, r.t0)[a], se = segPoint(b, r.t1)[a];
+            int k0 = binOf(std::min(sa, se)), k1 = binOf(std::max(sa, se));
+            ++enter[k0]; ++exit[k1];
+
+            /* chop the piece at every bin wall it crosses */
+            SbvhRef rest = r;
+            for (int k = k0; k < k1; ++k) {
+                float wall = lo + ext * float(k + 1) / float(BINS);
+                float tc = crossParam(b, rest, a, wall);
+                bool fwd = se >= sa;
+                SbvhRef piece = makeRef(b, r.id, fwd ? rest.t0 : tc, fwd ? tc : rest.t1);
+                bmn[k] = glm::min(bmn[k], piece.mn); bmx[k] = glm::max(bmx[k], piece.mx);
+                rest = makeRef(b, r.id, fwd ? tc : rest.t0, fwd ? rest.t1 : tc);
+            }
+            bmn[k1] = glm::min(bmn[k1], rest.mn); bmx[k1] = glm::max(bmx[k1], rest.mx);
+        }
+
+        float rCost[BINS];
+        glm::vec3 mn(FLT_MAX), mx(-FLT_MAX); uint32_t n = 0;
+        for (int k = BINS - 1; k > 0; --k) {
+            mn = glm::min(mn, bmn[k]); mx = glm::max(mx, bmx[k]); n += exit[k];
+            rCost[k] = n ? halfArea(mn, mx) * float(n) : 0.f;
+        }
+        mn = glm::vec3(FLT_MAX); mx = glm::vec3(-FLT_MAX); n = 0;
+        for (int k = 0; k < BINS - 1; ++k) {
+            mn = glm::min(mn, bmn[k]); mx = glm::max(mx, bmx[k]); n += enter[k];
+            if (n == 0 || rCost[k + 1] == 0.f) continue;
+            float cost = halfArea(mn, mx) * float(n) + rCost[k + 1];
+            if (cost < best.cost) {
+                best.cost = cost; best.axis = a;
+                best.pos = lo + ext * float(k + 1) / float(BINS);
+            }
+        }
+    }
+    return best;
+}
+
+static uint32_t buildSbvhNode(BuiltBVH& out, SbvhCtx& ctx, std::vector<SbvhRef>& refs)
+{
+    const float kOverlap = 1e-5f;
+    uint32_t myIndex = (uint32_t)out.nodes.size();
+    out.nodes.emplace_back();
+
+    glm::vec3 mn(FLT_MAX), mx(-FLT_MAX);
+    for (const SbvhRef& r : refs) { mn = glm::min(mn, r.mn); mx = glm::max(mx, r.mx); }
+
+    if (refs.size() <= LEAF_SIZE) {
+        BvhNode n;
+        n.mn = mn; n.mx = mx;
+        n.lo = (uint32_t)out.leafIdx.size();
+        n.hi = uint32_t(refs.size()) | 0x80000000u;
+        for (const SbvhRef& r : refs) {
+            out.leafIdx.push_back(r.id);
+            out.clip.push_back({ r.t0, r.t1 });
+        }
+        out.nodes[myIndex] = n;
+        return myIndex;
+    }
+
+    /* object split over ref centroids ---------------------------------- */
+    const uint32_t R = (uint32_t)refs.size();
+    std::vector<glm::vec3> pmn(R), pmx(R);
+    std::vector<uint32_t> ids(R), ones(R, 1u);
+    for (uint32_t i = 0; i < R; ++i) { pmn[i] = refs[i].mn; pmx[i] = refs[i].mx; ids[i] = i; }
+    SahSplit obj = binnedSAH(pmn, pmx, ones, ids);
+
+    std::vector<SbvhRef> left, right;
+    auto objectPartition = [&]() {
+        left.clear(); right.clear();
+        for (const SbvhRef& r : refs) {
+            bool l = obj.axis >= 0 ? 0.5f * (r.mn[obj.axis] + r.mx[obj.axis]) < obj.pos : false;
+            (l ? left : right).push_back(r);
+        }
+        if (left.empty() || right.empty()) {       /* coincident centroids */
+            left.assign(refs.begin(), refs.begin() + R / 2);
+            right.assign(refs.begin() + R / 2, refs.end());
+        }
+    };
+    objectPartition();
+
+    /* spatial split where the object halves overlap -------------------- */
+    glm::vec3 lmn(FLT_MAX), lmx(-FLT_MAX), rmn(FLT_MAX), rmx(-FLT_MAX);
+    for (const SbvhRef& r : left) { lmn = glm::min(lmn, r.mn); lmx = glm::max(lmx, r.mx); }
+    for (const SbvhRef& r : right) { rmn = glm::min(rmn, r.mn); rmx = glm::max(rmx, r.mx); }
+    float overlap = halfArea(glm::max(lmn, rmn), glm::min(lmx, rmx));
+
+    if (overlap > kOverlap * ctx.rootHalfArea && ctx.extra < ctx.budget) {
+        SahSplit sp = spatialSAH(ctx, refs, mn, mx);
+        if (sp.axis >= 0 && sp.cost < obj.cost) {
+            std::vector<SbvhRef> sl, sr;
+            uint32_t dup = 0;
+            for (const SbvhRef& r : refs) {
+                const CPUBranch& b = (*ctx.br)[r.id];
+                float sa = segPoint(b, r.t0)[sp.axis], se = segPoint(b, r.t1)[sp.axis];
+                if (std::max(sa, se) <= sp.pos) sl.push_back(r);
+                else if (std::min(sa, se) >= sp.pos) sr.push_back(r);
+                else {
+                    float tc = crossParam(b, r, sp.axis, sp.pos);
+                    SbvhRef a = makeRef(b, r.id, r.t0, tc), e = makeRef(b, r.id, tc, r.t1);
+                    (sa < se ? sl : sr).push_back(a);
+                    (sa < se ? sr : sl).push_back(e);
+                    ++dup;
+                }
+            }
+            /* only if it fits the budget and actually separates something */
+            if (ctx.extra + dup <= ctx.budget && sl.size() < R && sr.size() < R &&
+                !sl.empty() && !sr.empty()) {
+                ctx.extra += dup;
+                left.swap(sl); right.swap(sr);
+            }
+        }
+    }
+
+    std::vector<SbvhRef>().swap(refs);              /* free before recursing */
+    buildSbvhNode(out, ctx, left);
+    uint32_t r = buildSbvhNode(out, ctx, right);
+
+    BvhNode n;
+    n.mn = mn; n.mx = mx;
+    n.lo = (uint32_t)out.nodes.size();     /* skip link */
+    n.hi = r;
+    out.nodes[myIndex] = n;
+    return myIndex;
+}
+
 /* ---------- public entry ----------------------------------------------- */
-BuiltBVH buildBVH(const std::vector<CPUBranch>& br)
+BuiltBVH buildBVH(const std::vector<CPUBranch>& br,
+    const BvhBuildOptions& opt)
 {
     BuiltBVH out;
     if (br.empty()) {
@@ -105,6 +563,190 @@ BuiltBVH buildBVH(const std::vector<CPUBranch>& br)
     for (uint32_t i = 0; i < N; ++i) idx[i] = i;
 
     /* build recursively  root at index 0 */
-    buildNode(out, br, bmn, bmx, idx, 0, (uint32_t)N);
+    if (opt.builder == BvhBuilder::Topology) {
+        TopoCtx ctx;
+        makeClusters(ctx, br, bmn, bmx);
+        std::vector<uint32_t> all(ctx.clusters.size());
+        for (uint32_t c = 0; c < all.size(); ++c) all[c] = c;
+        buildTopoNode(out, ctx, all);
+    }
+    else if (opt.builder == BvhBuilder::SBVH) {
+        SbvhCtx ctx;
+        ctx.br = &br;
+        ctx.budget = uint32_t(std::max(0.f, opt.splitBudget) * float(N));
+        std::vector<SbvhRef> refs(N);
+        glm::vec3 rmn(FLT_MAX), rmx(-FLT_MAX);
+        for (uint32_t i = 0; i < N; ++i) {
+            refs[i] = { i, 0.f, 1.f, bmn[i], bmx[i] };
+            rmn = glm::min(rmn, bmn[i]); rmx = glm::max(rmx, bmx[i]);
+        }
+        ctx.rootHalfArea = halfArea(rmn, rmx);
+        buildSbvhNode(out, ctx, refs);
+    }
+    else if (opt.builder == BvhBuilder::Dynamic) {
+        /* leaves address branches directly: the order is the identity */
+        DynamicBVH dyn;
+        for (uint32_t i = 0; i < N; ++i) dyn.insert(i, br[i]);
+        out = dyn.flatten();
+        if (opt.leafOrder) out.order = idx;
+        return out;
+    }
+    else {
+        buildNode(out, br, bmn, bmx, idx, 0, (uint32_t)N);
+    }
+
+    /* leaves were emitted depth-first, so leafIdx already lists the
+       branches in leaf order - it becomes the permutation itself       */
+    if (opt.leafOrder) out.order.swap(out.leafIdx);
+    return out;
+}
+
+BuiltBVH buildBoxBVH(const std::vector<glm::vec3>& mn,
+    const std::vector<glm::vec3>& mx, uint32_t leafSize)
+{
+    BuiltBVH out;
+    if (mn.empty()) {
+        BvhNode n{};
+        n.lo = 0;  n.hi = 0x80000000u;
+        out.nodes.push_back(n);
+        return out;
+    }
+
+    std::vector<uint32_t> idx(mn.size());
+    for (uint32_t i = 0; i < idx.size(); ++i) idx[i] = i;
+    const std::vector<CPUBranch> none;
+    buildNode(out, none, mn, mx, idx, 0, (uint32_t)idx.size(), std::max(1u, leafSize));
+    out.order.swap(out.leafIdx);                   /* always leaf order */
+    return out;
+}
+
+CPUBranch clipBranch(const CPUBranch& b, const glm::vec2& t)
+{
+    CPUBranch c = b;
+    glm::vec3 s = segPoint(b, t.x), e = segPoint(b, t.y);
+    c.startX = s.x; c.startY = s.y; c.startZ = s.z;
+    c.endX = e.x;   c.endY = e.y;   c.endZ = e.z;
+    if (b.grown > b.birth) {               /* piece grows in its own window */
+        const float span = b.grown - b.birth;
+        c.birth = b.birth + t.x * span;
+        c.grown = b.birth + t.y * span;
+    }
+    return c;
+}
+
+std::vector<CPUBranch> reorderBranches(const std::vector<CPUBranch>& br,
+    const std::vector<uint32_t>& order,
+    const std::vector<glm::vec2>& clip)
+{
+    /* a parent split by the SBVH is represented by its base piece */
+    std::vector<int> slotOf(br.size(), -1);
+    for (size_t s = order.size(); s-- > 0;)
+        if (clip.empty() || clip[s].x == 0.f || slotOf[order[s]] < 0)
+            slotOf[order[s]] = int(s);
+
+    std::vector<CPUBranch> out;
+    out.reserve(order.size());
+    for (size_t s = 0; s < order.size(); ++s) {
+        CPUBranch b = clip.empty() ? br[order[s]] : clipBranch(br[order[s]], clip[s]);
+        if (b.parentIndex >= 0) b.parentIndex = slotOf[b.parentIndex];
+        out.push_back(b);
+    }
     return out;
 }
+
+CPUBranch leafBranch(const BuiltBVH& bvh, const std::vector<CPUBranch>& br, uint32_t i)
+{
+    if (bvh.leafIdx.empty()) return br[i];          /* already slot order */
+    const CPUBranch& b = br[bvh.leafIdx[i]];
+    return bvh.clip.empty() ? b : clipBranch(b, bvh.clip[i]);
+}
+
+/* ---------- node proxies ---------------------------------------------- */
+/* length-weighted moments of a set of segments; additive, so children
+   simply merge into their parent                                       */
+struct SegMoments {
+    float     w = 0.f;                 /* total length                 */
+    glm::vec3 m1{ 0.f };               /* sum L * mid                  */
+    float     m2[6] = {};              /* sum L * E[x x^T]: xx yy zz xy xz yz */
+    float     rw = 0.f;                /* sum L * radius               */
+    float     birth = FLT_MAX;
+
+    void add(const CPUBranch& b)
+    {
+        glm::vec3 s(b.startX, b.startY, b.startZ), e(b.endX, b.endY, b.endZ);
+        glm::vec3 m = 0.5f * (s + e), d = e - s;
+        float L = std::max(glm::length(d), 1e-6f);
+        /* uniform segment: E[x x^T] = m m^T + d d^T / 12 */
+        w += L;  m1 += L * m;  rw += L * b.radius;
+        m2[0] += L * (m.x * m.x + d.x * d.x / 12.f);
+        m2[1] += L * (m.y * m.y + d.y * d.y / 12.f);
+        m2[2] += L * (m.z * m.z + d.z * d.z / 12.f);
+        m2[3] += L * (m.x * m.y + d.x * d.y / 12.f);
+        m2[4] += L * (m.x * m.z + d.x * d.z / 12.f);
+        m2[5] += L * (m.y * m.z + d.y * d.z / 12.f);
+        birth = std::min(birth, b.birth);
+    }
+    void add(const SegMoments& o)
+    {
+        w += o.w;  m1 += o.m1;  rw += o.rw;
+        for (int k = 0; k < 6; ++k) m2[k] += o.m2[k];
+        birth = std::min(birth, o.birth);
+    }
+};
+
+/* spread around the principal axis thickens the proxy by this much */
+static const float kProxyInflate = 0.5f;
+
+static BvhNodeAux fitProxy(const SegMoments& m, const BvhNode& n)
+{
+    BvhNodeAux x{};
+    x.birth = m.birth;
+    if (m.w <= 0.f) { x.a = x.b = 0.5f * (n.mn + n.mx); return x; }
+
+    glm::vec3 c = m.m1 / m.w;
+    float C[6];                                    /* covariance */
+    C[0] = m.m2[0] / m.w - c.x * c.x;  C[1] = m.m2[1] / m.w - c.y * c.y;
+    C[2] = m.m2[2] / m.w - c.z * c.z;  C[3] = m.m2[3] / m.w - c.x * c.y;
+    C[4] = m.m2[4] / m.w - c.x * c.z;  C[5] = m.m2[5] / m.w - c.y * c.z;
+    auto mul = [&](const glm::vec3& v) {
+        return glm::vec3(C[0] * v.x + C[3] * v.y + C[4] * v.z,
+            C[3] * v.x + C[1] * v.y + C[5] * v.z,
+            C[4] * v.x + C[5] * v.y + C[2] * v.z);
+    };
+
+    /* principal axis by power iteration, seeded with the longest box axis */
+    glm::vec3 ext = n.mx - n.mn, v(0.f);
+    v[ext.x >= ext.y && ext.x >= ext.z ? 0 : (ext.y >= ext.z ? 1 : 2)] = 1.f;
+    for (int it = 0; it < 16; ++it) {
+        glm::vec3 u = mul(v);
+        float l = glm::length(u);
+        if (l < 1e-12f) break;
+        v = u / l;
+    }
+    float lambda = std::max(glm::dot(v, mul(v)), 0.f);
+    float perp = std::max(C[0] + C[1] + C[2] - lambda, 0.f);
+
+    float half = std::sqrt(3.f * lambda);
+    x.a = glm::clamp(c - v * half, n.mn, n.mx);
+    x.b = glm::clamp(c + v * half, n.mn, n.mx);
+    if (glm::length(x.b - x.a) < 1e-6f) x.b = x.a + v * 1e-6f;   /* shader divides by |b-a|^2 */
+    x.r = m.rw / m.w + kProxyInflate * std::sqrt(perp);
+    return x;
+}
+
+std::vector<BvhNodeAux> bvhNodeAux(const BuiltBVH& bvh, const std::vector<CPUBranch>& br)
+{
+    /* preorder: both children sit after their parent */
+    std::vector<SegMoments> mom(bvh.nodes.size());
+    std::vector<BvhNodeAux> aux(bvh.nodes.size());
+    for (size_t i = bvh.nodes.size(); i-- > 0;) {
+        const BvhNode& n = bvh.nodes[i];
+        if (bvhIsLeaf(n)) {
+            for (uint32_t k = 0; k < bvhLeafCount(n); ++k)
+                mom[i].add(leafBranch(bvh, br, n.lo + k));
+        }
+        else { mom[i].add(mom[i + 1]); mom[i].add(mom[n.hi]); }
+        aux[i] = fitProxy(mom[i], n);
+    }
+    return aux;
+}
@@ -11,13 +11,108 @@
    --------------------------------------------------------------------------*/
 struct BvhNode {
     glm::vec3 mn, mx;
-    uint32_t  lo;              /* child index  OR leaf start            */
-    uint32_t  hi;              /* child index OR leaf count | 0x8000..  */
+    uint32_t  lo;              /* skip link    OR leaf start            */
+    uint32_t  hi;              /* right child  OR 0x8000.. | skip<<8 | count */
 };
 
+/* Nodes are stored depth-first (pre-order), so an internal node's left
+   child is always the next node.  Its `lo` holds the skip link - the
+   first node after its subtree - which lets the shader walk the tree
+   without a stack: on a hit go to i+1, on a miss go to lo.
+   The walk ends at the root's skip link (== node count).
+
+   Leaf hi packs count (bits 0-7) and skip (bits 8-30): the number of
+   unused slots that follow the leaf.  The static builders emit skip 0;
+   DynamicBVH leaves slack there so insertions stay local.  Leaves
+   always continue at i + 1 + skip.                                      */
+inline bool     bvhIsLeaf(const BvhNode& n)    { return (n.hi & 0x80000000u) != 0u; }
+inline uint32_t bvhLeafCount(const BvhNode& n) { return n.hi & 0xffu; }
+inline uint32_t bvhLeafSkip(const BvhNode& n)  { return (n.hi >> 8) & 0x7fffffu; }
+
 struct BuiltBVH {
     std::vector<BvhNode> nodes;
-    std::vector<uint32_t> leafIdx;
+    std::vector<uint32_t> leafIdx;     /* empty when built in leaf order   */
+    std::vector<uint32_t> order;       /* leaf order: slot -> source branch */
+    std::vector<glm::vec2> clip;       /* SBVH: segment [t0,t1] per entry  */
+
+    /* branch slot referenced by leaf entry i (lo + k) */
+    uint32_t prim(uint32_t i) const { return leafIdx.empty() ? i : leafIdx[i]; }
+};
+
+enum class BvhBuilder {
+    Median,        /* longest axis, object median (original builder)      */
+    Topology,      /* leaves = connected branch clusters, SAH above them  */
+    SBVH,          /* binned SAH + spatial splits that clip capsules      */
+    Dynamic        /* DynamicBVH, branches inserted in array order        */
+};
+
+struct BvhBuildOptions {
+    BvhBuilder builder = BvhBuilder::Median;
+
+    /* Emit `order` instead of leafIdx: leaves then address a contiguous
+       range of the branch array once it is permuted by reorderBranches(). */
+    bool leafOrder = false;
+
+    /* SBVH only: extra leaf references allowed, as a fraction of the
+       branch count.  A clipped capsule becomes several shorter capsules. */
+    float splitBudget = 0.30f;
+};
+
+BuiltBVH buildBVH(const std::vector<CPUBranch>& br,
+    const BvhBuildOptions& opt = {});
+
+/* Median builder over plain boxes (TLAS over plant instances).  Always
+   in leaf order: `order` lists box indices as the leaves reference them. */
+BuiltBVH buildBoxBVH(const std::vector<glm::vec3>& mn,
+    const std::vector<glm::vec3>& mx, uint32_t leafSize = 2);
+
+/* br permuted by order (slot -> source), parentIndex remapped to slots;
+   with clip (SBVH) every slot gets its piece of the source segment      */
+std::vector<CPUBranch> reorderBranches(const std::vector<CPUBranch>& br,
+    const std::vector<uint32_t>& order,
+    const std::vector<glm::vec2>& clip = {});
+
+/* CPU reference of the shader's stackless walk.  cull(node) returns true
+   to skip the subtree, leaf(node) consumes a leaf (and may tighten what
+   cull tests).  Returns the number of nodes visited.                    */
+template<class Cull, class Leaf>
+uint32_t walkStackless(const BuiltBVH& bvh, Cull&& cull, Leaf&& leaf)
+{
+    if (bvh.nodes.empty()) return 0;
+    const BvhNode& root = bvh.nodes[0];
+    const uint32_t end = bvhIsLeaf(root) ? 1u : root.lo;
+
+    uint32_t i = 0, visits = 0;
+    while (i < end) {
+        const BvhNode& n = bvh.nodes[i];
+        ++visits;
+        if (bvhIsLeaf(n)) {
+            if (!cull(n)) leaf(n);
+            i += 1u + bvhLeafSkip(n);
+        }
+        else i = cull(n) ? n.lo : i + 1u;
+    }
+    return visits;
+}
+
+/* sub-capsule of b over segment parameters [t.x, t.y] */
+CPUBranch clipBranch(const CPUBranch& b, const glm::vec2& t);
+
+/* capsule tested for leaf entry i: br is the source array, or the
+   reorderBranches() output when the BVH was built in leaf order        */
+CPUBranch leafBranch(const BuiltBVH& bvh, const std::vector<CPUBranch>& br, uint32_t i);
+
+/* Per-node side data, uploaded next to the nodes (2 x vec4 per node):
+   * proxy capsule [a, b] x r fitted to the subtree's segments (principal
+     axis, +-sqrt(3 var) along it, mean twig radius inflated by the spread
+     around it); the shader draws it instead of descending once the node
+     is below a pixel
+   * earliest CPUBranch::birth below the node; the shader skips the
+     subtree while the growth clock is before it                        */
+struct BvhNodeAux {
+    glm::vec3 a;  float r;
+    glm::vec3 b;  float birth;
 };
 
-BuiltBVH buildBVH(const std::vector<CPUBranch>& br);
+/* one entry per node, br as for leafBranch() */
+std::vector<BvhNodeAux> bvhNodeAux(const BuiltBVH& bvh, const std::vector<CPUBranch>& br);
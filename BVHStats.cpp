@@ -0,0 +1,274 @@
+/* --------------------------------------------------------------------------
+   BVHStats.cpp  -  offline quality metrics for BuiltBVH
+
+   The visit counter replays sceneSDF() from scene_sdf.glsl on the CPU
+   (same pruning test, same nearest-first order, same smooth-min) so the
+   numbers track what the compute shader actually does per march step.
+   --------------------------------------------------------------------------*/
+#include "BVHStats.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+/* ---------- helpers ---------------------------------------------------- */
+static float boxArea(const glm::vec3& mn, const glm::vec3& mx)
+{
+    glm::vec3 e = glm::max(mx - mn, glm::vec3(0.f));
+    return 2.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+static float boxVolume(const glm::vec3& mn, const glm::vec3& mx)
+{
+    glm::vec3 e = glm::max(mx - mn, glm::vec3(0.f));
+    return e.x * e.y * e.z;
+}
+
+static bool isLeaf(const BvhNode& n) { return bvhIsLeaf(n); }
+static uint32_t leafCount(const BvhNode& n) { return bvhLeafCount(n); }
+
+/* shader twins -------------------------------------------------------- */
+static float sdAABB(const glm::vec3& p, const glm::vec3& mn, const glm::vec3& mx)
+{
+    glm::vec3 q = glm::max(mn - p, p - mx);
+    return glm::length(glm::max(q, glm::vec3(0.f))) +
+        std::min(std::max(q.x, std::max(q.y, q.z)), 0.f);
+}
+
+static float sdCyl(const glm::vec3& p, const CPUBranch& b)
+{
+    glm::vec3 a(b.startX, b.startY, b.startZ);
+    glm::vec3 ab = glm::vec3(b.endX, b.endY, b.endZ) - a;
+    float t = glm::clamp(glm::dot(p - a, ab) / glm::dot(ab, ab), 0.f, 1.f);
+    return glm::length(p - (a + ab * t)) - b.radius;
+}
+
+static float smin(float a, float b, float k)
+{
+    float h = glm::clamp(0.5f + 0.5f * (b - a) / k, 0.f, 1.f);
+    return glm::mix(b, a, h) - k * h * (1.f - h);
+}
+
+/* beyond(): smin's support ends kBlend past d, a box that far out
+   cannot change it                                                 */
+static const float kBlend = 0.005f;
+static bool beyond(float dn, float d) { return dn >= d + kBlend; }
+
+/* ---------- CPU replica of sceneSDFStack() (counts only) -------------- */
+/* nodes = box tests: the root, then both children of every node opened;
+   the farther child is pushed first and rides on its push distance     */
+static void countVisits(const BuiltBVH& bvh, const std::vector<CPUBranch>& br,
+    const glm::vec3& p, uint32_t& nodes, uint32_t& leafTests)
+{
+    float d = 1e9f;
+
+    uint32_t stack[kShaderStackSize]; float stackD[kShaderStackSize];
+    int sp = 0; stack[sp] = 0u; stackD[sp++] = 0.f;
+    ++nodes;
+    while (sp > 0)
+    {
+        --sp;
+        if (beyond(stackD[sp], d)) continue;
+        const uint32_t ni = stack[sp];
+        const BvhNode& nd = bvh.nodes[ni];
+
+        if (isLeaf(nd)) {
+            for (uint32_t i = 0; i < leafCount(nd); ++i) {
+                ++leafTests;
+                d = smin(d, sdCyl(p, leafBranch(bvh, br, nd.lo + i)), kBlend);
+            }
+        }
+        else if (sp + 2 <= int(kShaderStackSize)) {
+            uint32_t a = ni + 1u, b = nd.hi;
+            float da = sdAABB(p, bvh.nodes[a].mn, bvh.nodes[a].mx);
+            float db = sdAABB(p, bvh.nodes[b].mn, bvh.nodes[b].mx);
+            nodes += 2;
+            if (da > db) { std::swap(a, b); std::swap(da, db); }
+            stack[sp] = b; stackD[sp++] = db;
+            stack[sp] = a; stackD[sp++] = da;
+        }
+    }
+}
+
+/* ---------- same scene, stackless walk over the skip links ------------ */
+static void countStackless(const BuiltBVH& bvh, const std::vector<CPUBranch>& br,
+    const glm::vec3& p, uint32_t& nodes)
+{
+    float d = 1e9f;
+    nodes += walkStackless(bvh,
+        [&](const BvhNode& n) { return beyond(sdAABB(p, n.mn, n.mx), d); },
+        [&](const BvhNode& n) {
+            for (uint32_t i = 0; i < leafCount(n); ++i)
+                d = smin(d, sdCyl(p, leafBranch(bvh, br, n.lo + i)), kBlend);
+        });
+}
+
+/* ---------- CPU replica of sceneSDFWide() ------------------------------ */
+/* children sorted nearest first: leaves are blended in that order until
+   one is beyond d, inner nodes pushed farthest first                   */
+static void countWideVisits(const WideBVH& w, const std::vector<CPUBranch>& br,
+    const glm::vec3& p, uint32_t& nodes, uint32_t& leafTests, uint32_t& stackUse)
+{
+    const uint32_t NW = WideBVH::NodeWords(w.width);
+    float d = 1e9f;
+    float dist[8];
+
+    uint32_t stack[kShaderStackSize]; float stackD[kShaderStackSize];
+    int sp = 0; stack[sp] = 0u; stackD[sp++] = 0.f;
+    while (sp > 0)
+    {
+        --sp;
+        if (beyond(stackD[sp], d)) continue;
+        uint32_t ni = stack[sp];
+        ++nodes;
+
+        uint32_t count = wideChildDistances(w, ni, p, dist);
+        const uint32_t* refs = &w.words[size_t(ni) * NW + 4];
+        uint32_t order[8];
+        for (uint32_t c = 0; c < count; ++c) {
+            uint32_t j = c;
+            for (; j > 0 && dist[order[j - 1]] > dist[c]; --j) order[j] = order[j - 1];
+            order[j] = c;
+        }
+
+        for (uint32_t j = 0; j < count; ++j) {
+            const uint32_t c = order[j];
+            if (beyond(dist[c], d)) break;
+            uint32_t ref = refs[c];
+            if (!wideRefIsLeaf(ref)) continue;
+            for (uint32_t i = 0; i < wideLeafCount(ref); ++i) {
+                ++leafTests;
+                uint32_t e = wideLeafStart(ref) + i;
+                CPUBranch b = br[w.prim(e)];
+                if (!w.leafIdx.empty() && !w.clip.empty()) b = clipBranch(b, w.clip[e]);
+                d = smin(d, sdCyl(p, b), kBlend);
+            }
+        }
+        for (uint32_t j = count; j-- > 0;) {
+            const uint32_t c = order[j];
+            if (beyond(dist[c], d) || wideRefIsLeaf(refs[c])) continue;
+            if (sp < int(kShaderStackSize)) {
+                stack[sp] = refs[c]; stackD[sp++] = dist[c];
+                stackUse = std::max(stackUse, uint32_t(sp));
+            }
+        }
+    }
+}
+
+/* ---------- public entry ----------------------------------------------- */
+BvhStats analyzeBVH(const BuiltBVH& bvh,
+    const std::vector<CPUBranch>& br,
+    uint32_t numQueries, uint32_t seed)
+{
+    BvhStats s;
+    s.nodeCount = (uint32_t)bvh.nodes.size();
+    if (bvh.nodes.empty() || br.empty()) return s;
+
+    const float kTraverse = 1.f;    /* cost of one box test               */
+    const float kIntersect = 1.f;    /* cost of one capsule test           */
+    const float rootArea = std::max(boxArea(bvh.nodes[0].mn, bvh.nodes[0].mx), 1e-12f);
+
+    /* walk the tree once: depth, stack occupancy, SAH, overlap ---------- */
+    struct Item { uint32_t node, depth, stackUse; };
+    std::vector<Item> todo{ { 0u, 0u, 1u } };
+    uint64_t depthSum = 0;
+
+    while (!todo.empty())
+    {
+        Item it = todo.back(); todo.pop_back();
+        const BvhNode& n = bvh.nodes[it.node];
+        float area = boxArea(n.mn, n.mx);
+        s.totalNodeArea += area;
+        s.maxDepth = std::max(s.maxDepth, it.depth);
+
+        if (isLeaf(n)) {
+            uint32_t cnt = leafCount(n);
+            ++s.leafCount;
+            s.primRefs += cnt;
+            depthSum += it.depth;
+            s.sahCost += kIntersect * cnt * area / rootArea;
+            if (s.leafSizeHistogram.size() <= cnt) s.leafSizeHistogram.resize(cnt + 1, 0u);
+            ++s.leafSizeHistogram[cnt];
+            continue;
+        }
+
+        s.sahCost += kTraverse * area / rootArea;
+
+        const BvhNode& l = bvh.nodes[it.node + 1u];
+        const BvhNode& r = bvh.nodes[n.hi];
+        s.siblingOverlap += boxVolume(glm::max(l.mn, r.mn), glm::min(l.mx, r.mx));
+
+        /* the shader pushes the farther child first, so it stays on the
+           stack for the whole nearer subtree - which one that is depends
+           on the point, so either may run on top of its sibling          */
+        uint32_t below = it.stackUse - 1u;
+        s.maxStackUse = std::max(s.maxStackUse, below + 2u);
+        todo.push_back({ it.node + 1u, it.depth + 1u, below + 2u });
+        todo.push_back({ n.hi, it.depth + 1u, below + 2u });
+    }
+    s.avgLeafDepth = s.leafCount ? float(depthSum) / float(s.leafCount) : 0.f;
+
+    /* random point queries ---------------------------------------------- */
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> u01(0.f, 1.f);
+    const glm::vec3 mn = bvh.nodes[0].mn, ext = bvh.nodes[0].mx - bvh.nodes[0].mn;
+
+    uint64_t nodeSum = 0, testSum = 0, slSum = 0;
+    for (uint32_t q = 0; q < numQueries; ++q) {
+        glm::vec3 p = mn + ext * glm::vec3(u01(gen), u01(gen), u01(gen));
+        uint32_t nodes = 0, tests = 0, slNodes = 0;
+        countVisits(bvh, br, p, nodes, tests);
+        countStackless(bvh, br, p, slNodes);
+        nodeSum += nodes; testSum += tests; slSum += slNodes;
+    }
+    if (numQueries) {
+        s.avgNodeVisits = float(nodeSum) / float(numQueries);
+        s.avgLeafTests = float(testSum) / float(numQueries);
+        s.avgNodeVisitsStackless = float(slSum) / float(numQueries);
+    }
+    return s;
+}
+
+WideBvhStats analyzeWideBVH(const WideBVH& wide,
+    const std::vector<CPUBranch>& br,
+    uint32_t numQueries, uint32_t seed)
+{
+    WideBvhStats s;
+    s.width = wide.width;
+    s.nodeCount = wide.nodeCount();
+    s.bytes = uint32_t(wide.words.size() * sizeof(uint32_t));
+    if (s.nodeCount == 0 || br.empty()) return s;
+
+    /* root box = union of the decoded root children, so the query
+       points cover the same volume analyzeBVH() samples              */
+    const uint32_t* n = wide.words.data();
+    const uint32_t rowWords = wide.width / 4u, count = n[3] >> 24;
+    const uint8_t* q = reinterpret_cast<const uint8_t*>(n + 4 + wide.width);
+    glm::vec3 mn(FLT_MAX), mx(-FLT_MAX);
+    for (int a = 0; a < 3; ++a) {
+        float org; std::memcpy(&org, &n[a], 4);
+        float scale = std::ldexp(1.f, int(int8_t((n[3] >> (8 * a)) & 0xffu)));
+        for (uint32_t c = 0; c < count; ++c) {
+            mn[a] = std::min(mn[a], org + float(q[(2 * a) * rowWords * 4 + c]) * scale);
+            mx[a] = std::max(mx[a], org + float(q[(2 * a + 1) * rowWords * 4 + c]) * scale);
+        }
+    }
+
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> u01(0.f, 1.f);
+    const glm::vec3 ext = mx - mn;
+
+    uint64_t nodeSum = 0, testSum = 0;
+    for (uint32_t q = 0; q < numQueries; ++q) {
+        glm::vec3 p = mn + ext * glm::vec3(u01(gen), u01(gen), u01(gen));
+        uint32_t nodes = 0, tests = 0;
+        countWideVisits(wide, br, p, nodes, tests, s.maxStackUse);
+        nodeSum += nodes; testSum += tests;
+    }
+    if (numQueries) {
+        s.avgNodeVisits = float(nodeSum) / float(numQueries);
+        s.avgLeafTests = float(testSum) / float(numQueries);
+    }
+    return s;
+}
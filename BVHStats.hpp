@@ -0,0 +1,59 @@
+#pragma once
+#include "BVH.hpp"
+#include "WideBVH.hpp"
+#include <cstdint>
+#include <vector>
+
+/* --------------------------------------------------------------------------
+   BVH quality metrics - a GPU-free proxy for raymarch cost.
+
+   * SAH cost   : Ct * sum(A_inner) + Ci * sum(A_leaf * n), / A_root
+   * overlap    : summed intersection volume of sibling boxes
+   * depth      : max / average leaf depth, plus the worst-case occupancy
+                  of the shader's fixed  uint stack[64]
+   * visits     : box and capsule tests of a CPU replica of sceneSDF()
+                  (kBlend cull, nearest first) at random points inside
+                  the root box
+   --------------------------------------------------------------------------*/
+struct BvhStats {
+    uint32_t nodeCount = 0;
+    uint32_t leafCount = 0;
+    uint32_t primRefs = 0;     /* leaf references (>= branches w/ splits) */
+
+    float sahCost = 0.f;
+    float totalNodeArea = 0.f;      /* sum of node surface areas (world)  */
+    float siblingOverlap = 0.f;      /* sum of sibling overlap volumes     */
+
+    uint32_t maxDepth = 0;
+    float    avgLeafDepth = 0.f;
+    uint32_t maxStackUse = 0;        /* worst case, either child on top    */
+
+    std::vector<uint32_t> leafSizeHistogram;    /* [size] -> leaf count   */
+
+    float avgNodeVisits = 0.f;       /* box tests per query point          */
+    float avgLeafTests = 0.f;
+    float avgNodeVisitsStackless = 0.f;  /* walkStackless(), same points   */
+};
+
+/* size of the per-invocation stack in raymarch_comp.glsl */
+constexpr uint32_t kShaderStackSize = 64u;
+
+BvhStats analyzeBVH(const BuiltBVH& bvh,
+    const std::vector<CPUBranch>& br,
+    uint32_t numQueries = 4096,
+    uint32_t seed = 1);
+
+/* same visit replay for the collapsed tree (sceneSDFWide() in the shader) */
+struct WideBvhStats {
+    uint32_t width = 0;
+    uint32_t nodeCount = 0;
+    uint32_t bytes = 0;              /* node words only, leafIdx excluded  */
+    uint32_t maxStackUse = 0;        /* observed over the query points     */
+    float    avgNodeVisits = 0.f;
+    float    avgLeafTests = 0.f;
+};
+
+WideBvhStats analyzeWideBVH(const WideBVH& wide,
+    const std::vector<CPUBranch>& br,
+    uint32_t numQueries = 4096,
+    uint32_t seed = 1);
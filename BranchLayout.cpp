@@ -0,0 +1,74 @@
+/* --------------------------------------------------------------------------
+   BranchLayout.cpp  -  builds the binding-1 words createBranchBuffer
+   uploads and CpuRaymarcher reads (see shaders/branch_layout.h)
+   --------------------------------------------------------------------------*/
+#include "BranchLayout.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+/* ---------- helpers ---------------------------------------------------- */
+static uint32_t floatBits(float f) { uint32_t u; std::memcpy(&u, &f, 4); return u; }
+
+uint32_t branchRecordVec4s(uint32_t format)
+{
+    switch (format) {
+    case BRANCH_FORMAT_F32: return BRANCH_F32_VEC4S;
+    case BRANCH_FORMAT_Q16: return BRANCH_Q16_VEC4S;
+    }
+    throw std::runtime_error("unknown branch buffer format");
+}
+
+/* ---------- packer ----------------------------------------------------- */
+std::vector<uint32_t> packBranches(const std::vector<CPUBranch>& src, uint32_t format)
+{
+    const uint32_t n = uint32_t(src.size());
+    const uint32_t side = BRANCH_HEADER_VEC4S + n * branchRecordVec4s(format);
+    std::vector<uint32_t> w(4u * (side + n * BRANCH_SIDE_VEC4S), 0u);
+
+    /* AABB over both end points of every record - the Q16 grid */
+    glm::vec3 org(0.f), ext(0.f);
+    if (n) {
+        glm::vec3 mn(src[0].startX, src[0].startY, src[0].startZ), mx = mn;
+        for (const CPUBranch& b : src) {
+            glm::vec3 s(b.startX, b.startY, b.startZ), e(b.endX, b.endY, b.endZ);
+            mn = glm::min(mn, glm::min(s, e));
+            mx = glm::max(mx, glm::max(s, e));
+        }
+        org = mn; ext = mx - mn;
+    }
+
+    uint32_t* h = w.data();
+    h[0] = BRANCH_LAYOUT_VERSION; h[1] = format; h[2] = n; h[3] = side;
+    h[4] = floatBits(org.x); h[5] = floatBits(org.y); h[6] = floatBits(org.z);
+    h[8] = floatBits(ext.x); h[9] = floatBits(ext.y); h[10] = floatBits(ext.z);
+
+    /* one axis onto the 16-bit grid; a flat axis stays 0 */
+    auto q = [&](float v, int axis) -> float
+        {
+            return ext[axis] > 0.f ? (v - org[axis]) / ext[axis] : 0.f;
+        };
+
+    for (uint32_t i = 0; i < n; ++i) {
+        const CPUBranch& b = src[i];
+        uint32_t* r = w.data() + 4u * (BRANCH_HEADER_VEC4S + i * branchRecordVec4s(format));
+        if (format == BRANCH_FORMAT_F32) {
+            r[0] = floatBits(b.startX); r[1] = floatBits(b.startY);
+            r[2] = floatBits(b.startZ); r[3] = floatBits(b.radius);
+            r[4] = floatBits(b.endX);   r[5] = floatBits(b.endY);
+            r[6] = floatBits(b.endZ);   r[7] = floatBits(b.bfsDepth);
+        }
+        else {
+            r[0] = glm::packUnorm2x16(glm::vec2(q(b.startX, 0), q(b.startY, 1)));
+            r[1] = glm::packUnorm2x16(glm::vec2(q(b.startZ, 2), q(b.endX, 0)));
+            r[2] = glm::packUnorm2x16(glm::vec2(q(b.endY, 1), q(b.endZ, 2)));
+            r[3] = glm::packHalf2x16(glm::vec2(b.radius, b.bfsDepth));
+        }
+
+        uint32_t* a = w.data() + 4u * (side + i * BRANCH_SIDE_VEC4S);
+        a[0] = b.parentIndex < 0 ? 0xffffffffu : uint32_t(b.parentIndex);
+        a[1] = floatBits(b.birth);
+        a[2] = floatBits(b.grown);
+    }
+    return w;
+}
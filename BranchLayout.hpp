@@ -0,0 +1,25 @@
+#pragma once
+#include "BFSSystem.hpp"
+#include "shaders/branch_layout.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+/* --------------------------------------------------------------------------
+   Branch buffer (binding 1) packer - the layout itself lives in
+   shaders/branch_layout.h so the shaders and this file cannot drift.
+
+   * F32 : two aligned vec4s per branch (start + radius, end + bfs)
+   * Q16 : one uvec4 per branch, positions as 16-bit unorm over the
+           AABB of all records, radius and bfs as halves
+
+   Parent index, birth and grown go to the side table behind the
+   records; the shader only reads them near joints and while growing.
+   --------------------------------------------------------------------------*/
+
+/* uvec4s one record takes in `format` */
+uint32_t branchRecordVec4s(uint32_t format);
+
+/* header + records + side table, 4 words per uvec4, ready to memcpy */
+std::vector<uint32_t> packBranches(const std::vector<CPUBranch>& src,
+    uint32_t format = BRANCH_FORMAT_F32);
@@ -0,0 +1,1144 @@
+/* --------------------------------------------------------------------------
+   CpuRaymarcher.cpp  -  CPU port of shaders/cone_comp.glsl (cone
+   prepass), raymarch_comp.glsl (march pass), shade_comp.glsl (shade
+   pass) and the raymarch_common.glsl / scene_sdf.glsl includes
+
+   Keep the function names and order in step with the shaders; every
+   GLSL helper below has the same name and the same arithmetic.
+   --------------------------------------------------------------------------*/
+#include "CpuRaymarcher.hpp"
+#include "WideBVH.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+/* ---------- GLSL-ish helpers ------------------------------------------- */
+float    bitsFloat(uint32_t u) { float f; std::memcpy(&f, &u, 4); return f; }
+uint32_t floatBits(float f) { uint32_t u; std::memcpy(&u, &f, 4); return u; }
+float    clamp01(float x) { return std::min(std::max(x, 0.f), 1.f); }
+
+/* a workgroup's shared node cache (scene_sdf.glsl) */
+struct NodeCache {
+    std::vector<uint32_t> words;           /* nodeCache                      */
+    std::vector<uint32_t> ref;             /* nodeCacheRef                   */
+};
+
+struct Ctx {
+    const CpuScene& s;
+    const CpuPush& pc;
+    const NodeCache* cache = nullptr;      /* none: everything from binding 2 */
+};
+
+/* ---------- raymarch_common.glsl --------------------------------------- */
+const uint32_t kProxyBit = 0x80000000u;
+const uint32_t kNoParent = 0xffffffffu;
+const float    kFar = 50.f;
+const int      kConeTile = 8;
+
+struct Branch { glm::vec3 s; float r; glm::vec3 e; float bfs; float birth; float grown; };
+
+/* binding 1 as uvec4s */
+const uint32_t* br(const Ctx& c, uint32_t v) { return c.s.branchWords.data() + 4u * v; }
+
+glm::vec3 bitsVec3(const uint32_t* u) { return { bitsFloat(u[0]), bitsFloat(u[1]), bitsFloat(u[2]) }; }
+
+Branch branch(const Ctx& c, uint32_t i)
+{
+    Branch b;
+    if (c.s.branchFormat == BRANCH_FORMAT_Q16) {
+        const uint32_t* q = br(c, BRANCH_HEADER_VEC4S + i);
+        glm::vec3 org = bitsVec3(br(c, 1)), ext = bitsVec3(br(c, 2));
+        glm::vec2 a = glm::unpackUnorm2x16(q[0]), cc = glm::unpackUnorm2x16(q[1]);
+        glm::vec2 d = glm::unpackUnorm2x16(q[2]), rb = glm::unpackHalf2x16(q[3]);
+        b.s = org + ext * glm::vec3(a.x, a.y, cc.x);
+        b.e = org + ext * glm::vec3(cc.y, d.x, d.y);
+        b.r = rb.x; b.bfs = rb.y;
+    }
+    else {
+        const uint32_t* o = br(c, BRANCH_HEADER_VEC4S + i * BRANCH_F32_VEC4S);
+        b.s = bitsVec3(o); b.r = bitsFloat(o[3]);
+        b.e = bitsVec3(o + 4); b.bfs = bitsFloat(o[7]);
+    }
+
+    /* the side table only matters while the clock runs */
+    b.birth = 0.f; b.grown = 0.f;
+    if (c.pc.flags.w < 1.f) {
+        const uint32_t* x = br(c, br(c, 0)[3] + i * BRANCH_SIDE_VEC4S);
+        b.birth = bitsFloat(x[1]); b.grown = bitsFloat(x[2]);
+    }
+    return b;
+}
+
+uint32_t parentOf(const Ctx& c, uint32_t i)
+{
+    return br(c, br(c, 0)[3] + i * BRANCH_SIDE_VEC4S)[0];
+}
+
+bool grow(const Ctx& c, Branch& b)
+{
+    float t = c.pc.flags.w;
+    if (t >= b.grown) return true;
+    if (t <= b.birth) return false;
+    float g = (t - b.birth) / (b.grown - b.birth);
+    b.e = b.s + (b.e - b.s) * g;
+    b.r *= g;
+    return true;
+}
+
+bool unborn(const Ctx& c, uint32_t ai)
+{
+    return c.pc.flags.w < 1.f && c.s.nodeAux[ai].birth >= c.pc.flags.w;
+}
+
+/* ---------- node cache ------------------------------------------------- */
+const uint32_t kCachedBit = 0x80000000u;
+
+uint32_t nodeWords(const Ctx& c)
+{
+    return c.s.bvhWidth > 2u ? WideBVH::NodeWords(c.s.bvhWidth) : 8u;
+}
+
+uint32_t cacheSlots(const Ctx& c)
+{
+    uint32_t slots = 0u, level = 1u;
+    for (uint32_t l = 0u; l < c.s.nodeCacheDepth; ++l) { slots += level; level *= c.s.bvhWidth; }
+    return slots;
+}
+
+uint32_t rootRef(const Ctx& c, uint32_t base)
+{
+    return c.cache && cacheSlots(c) > 0u && base == 0u && c.pc.flags.z < 0.5f ? kCachedBit : 0u;
+}
+
+uint32_t childRef(const Ctx& c, uint32_t e, uint32_t ch, uint32_t ref)
+{
+    if ((e & kCachedBit) == 0u) return ref;
+    uint32_t s = (e & ~kCachedBit) * c.s.bvhWidth + 1u + ch;
+    return s < cacheSlots(c) ? kCachedBit | s : ref;
+}
+
+uint32_t nodeIndex(const Ctx& c, uint32_t e)
+{
+    return (e & kCachedBit) != 0u ? c.cache->ref[e & ~kCachedBit] : e;
+}
+
+uint32_t nodeWord(const Ctx& c, uint32_t base, uint32_t e, uint32_t stride, uint32_t k)
+{
+    if ((e & kCachedBit) != 0u) return c.cache->words[(e & ~kCachedBit) * nodeWords(c) + k];
+    return c.s.nodeWords[base + e * stride + k];
+}
+
+uint32_t cacheSlotNode(const Ctx& c, const NodeCache& nc, uint32_t s)
+{
+    if (s == 0u) return 0u;
+    const uint32_t W = c.s.bvhWidth;
+    uint32_t ps = (s - 1u) / W, ch = (s - 1u) % W;
+    if (nc.ref[ps] == kNoParent) return kNoParent;
+    const uint32_t* w = &nc.words[ps * nodeWords(c)];
+    if (W == 2u) {
+        if ((w[7] & 0x80000000u) != 0u) return kNoParent;
+        return ch == 0u ? nc.ref[ps] + 1u : w[7];
+    }
+    if (ch >= w[3] >> 24) return kNoParent;
+    return (w[4 + ch] & 0x80000000u) != 0u ? kNoParent : w[4 + ch];
+}
+
+/* loadNodeCache(): one level per barrier round - every workgroup ends
+   up with the same copy, so one fill serves them all here             */
+NodeCache loadNodeCache(const Ctx& c)
+{
+    NodeCache nc;
+    const uint32_t slots = cacheSlots(c), nw = nodeWords(c);
+    nc.words.assign(size_t(slots) * nw, 0u);
+    nc.ref.assign(slots, kNoParent);
+    if (slots == 0u || c.pc.flags.z >= 0.5f) return nc;
+    for (uint32_t s = 0u; s < slots; ++s) {       /* heap order: parents first */
+        uint32_t ni = cacheSlotNode(c, nc, s);
+        nc.ref[s] = ni;
+        if (ni != kNoParent)
+            std::memcpy(&nc.words[size_t(s) * nw], &c.s.nodeWords[size_t(ni) * nw], nw * 4u);
+    }
+    return nc;
+}
+
+struct Node { glm::vec3 mn, mx; uint32_t lo, hi; bool leaf; uint32_t skip; };
+
+Node node(const Ctx& c, uint32_t base, uint32_t i)
+{
+    uint32_t w[8];
+    for (uint32_t k = 0u; k < 8u; ++k) w[k] = nodeWord(c, base, i, 8u, k);
+    Node n;
+    n.mn = { bitsFloat(w[0]), bitsFloat(w[1]), bitsFloat(w[2]) };
+    n.mx = { bitsFloat(w[3]), bitsFloat(w[4]), bitsFloat(w[5]) };
+    n.lo = w[6];
+    n.hi = w[7];
+    n.leaf = (n.hi & 0x80000000u) != 0u;
+    n.skip = n.leaf ? (n.hi >> 8) & 0x7fffffu : 0u;
+    if (n.leaf) n.hi &= 0xffu;
+    return n;
+}
+
+float sdAABB(const glm::vec3& p, const glm::vec3& mn, const glm::vec3& mx)
+{
+    glm::vec3 q = glm::max(mn - p, p - mx);
+    return glm::length(glm::max(q, glm::vec3(0.f))) + std::min(std::max(q.x, std::max(q.y, q.z)), 0.f);
+}
+
+float sdCyl(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, float r, glm::vec3& g)
+{
+    glm::vec3 ab = b - a;
+    float t = clamp01(glm::dot(p - a, ab) / glm::dot(ab, ab));
+    glm::vec3 v = p - (a + ab * t);
+    float l = glm::length(v);
+    g = v / std::max(l, 1e-8f);
+    return l - r;
+}
+
+float sdCyl(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, float r)
+{
+    glm::vec3 ab = b - a;
+    float t = clamp01(glm::dot(p - a, ab) / glm::dot(ab, ab));
+    return glm::length(p - (a + ab * t)) - r;
+}
+
+/* the variant's constants (ids 5..7) */
+float kBlend(const Ctx& c) { return c.s.blend; }
+int   kSteps(const Ctx& c) { return int(c.s.steps); }
+float kEps(const Ctx& c)   { return c.s.eps; }
+
+float smoothWeight(const Ctx& c, float d, float d0)
+{
+    if (kBlend(c) <= 0.f) return d < d0 ? 0.f : 1.f;
+    return clamp01(0.5f + 0.5f * (d - d0) / kBlend(c));
+}
+
+glm::vec3 rayDir(const Ctx& c, float px, float py)
+{
+    const float W = c.pc.scr.x, H = c.pc.scr.y;
+    float u = px / W, v = py / H;
+    v = 1.f - v;
+    glm::vec2 ndc(u * 2.f - 1.f, v * 2.f - 1.f); ndc.x *= W / H;
+    return glm::normalize(glm::vec3(c.pc.camF) + ndc.x * glm::vec3(c.pc.camR) + ndc.y * glm::vec3(c.pc.camU));
+}
+
+void cameraRay(const Ctx& c, int x, int y, glm::vec3& ro, glm::vec3& rd)
+{
+    ro = glm::vec3(c.pc.camPos);
+    rd = rayDir(c, float(x) + 0.5f, float(y) + 0.5f);
+}
+
+/* ---------- scene_sdf.glsl --------------------------------------------- */
+struct Sdf { float d; uint32_t id; uint32_t inst; float tests; };
+
+void blend(const Ctx& c, Sdf& s, float d, uint32_t id)
+{
+    if (d >= s.d + kBlend(c)) return;
+    float h = smoothWeight(c, d, s.d);
+    if (h < 0.5f) s.id = id;
+    s.d = d + (s.d - d) * h - kBlend(c) * h * (1.f - h);
+}
+
+bool beyond(const Ctx& c, float dn, const Sdf& s)
+{
+    return dn >= s.d + kBlend(c);
+}
+
+/* ---------- wide node access ------------------------------------------- */
+uint32_t wideWord(const Ctx& c, uint32_t base, uint32_t ni, uint32_t k)
+{
+    return nodeWord(c, base, ni, nodeWords(c), k);
+}
+
+uint32_t planeByte(const Ctx& c, uint32_t base, uint32_t ni, uint32_t row, uint32_t ch)
+{
+    const uint32_t W = c.s.bvhWidth;
+    uint32_t w = wideWord(c, base, ni, 4u + W + row * (W / 4u) + (ch >> 2));
+    return (w >> ((ch & 3u) * 8u)) & 0xffu;
+}
+
+/* ---------- scene SDF -------------------------------------------------- */
+
+bool lodNode(const Ctx& c, float size, float lod)
+{
+    return size < lod && c.pc.flags.w >= 1.f;
+}
+
+void proxySDF(const Ctx& c, const glm::vec3& p, uint32_t ai, Sdf& s)
+{
+    const BvhNodeAux& x = c.s.nodeAux[ai];
+    s.tests += 1.f;
+    blend(c, s, sdCyl(p, x.a, x.b, x.r), kProxyBit | ai);
+}
+
+void sceneSDFWide(const Ctx& c, const glm::vec3& p, uint32_t base, uint32_t brBase,
+    uint32_t auxBase, float lod, Sdf& s)
+{
+    uint32_t stack[64]; float stackD[64]; int sp = 0;
+    stack[sp] = rootRef(c, base); stackD[sp++] = 0.f;
+
+    while (sp > 0)
+    {
+        --sp;
+        if (beyond(c, stackD[sp], s)) continue;
+        uint32_t ni = stack[sp];
+        s.tests += 1.f;
+
+        uint32_t hdr = wideWord(c, base, ni, 3u);
+        uint32_t cnt = hdr >> 24;
+        glm::vec3 org(bitsFloat(wideWord(c, base, ni, 0u)), bitsFloat(wideWord(c, base, ni, 1u)),
+            bitsFloat(wideWord(c, base, ni, 2u)));
+        glm::vec3 scl(std::ldexp(1.f, int8_t(hdr & 0xffu)), std::ldexp(1.f, int8_t((hdr >> 8) & 0xffu)),
+            std::ldexp(1.f, int8_t((hdr >> 16) & 0xffu)));
+
+        float dc[8], sz[8]; uint32_t order[8];
+        for (uint32_t ch = 0u; ch < cnt; ++ch)
+        {
+            glm::vec3 lo(float(planeByte(c, base, ni, 0u, ch)), float(planeByte(c, base, ni, 2u, ch)),
+                float(planeByte(c, base, ni, 4u, ch)));
+            glm::vec3 hi(float(planeByte(c, base, ni, 1u, ch)), float(planeByte(c, base, ni, 3u, ch)),
+                float(planeByte(c, base, ni, 5u, ch)));
+            dc[ch] = sdAABB(p, org + lo * scl, org + hi * scl);
+            sz[ch] = glm::length((hi - lo) * scl);
+            uint32_t j = ch;
+            for (; j > 0u && dc[order[j - 1u]] > dc[ch]; --j) order[j] = order[j - 1u];
+            order[j] = ch;
+        }
+
+        for (uint32_t j = 0u; j < cnt; ++j)
+        {
+            uint32_t ch = order[j];
+            if (beyond(c, dc[ch], s)) break;
+            uint32_t ref = wideWord(c, base, ni, 4u + ch);
+            if ((ref & 0x80000000u) != 0u)
+            {
+                uint32_t start = ref & 0x00ffffffu;
+                uint32_t n = (ref >> 24) & 0x7fu;
+                for (uint32_t i = 0u; i < n; ++i)
+                {
+                    s.tests += 1.f;
+                    Branch b = branch(c, brBase + start + i);
+                    if (!grow(c, b)) continue;
+                    blend(c, s, sdCyl(p, b.s, b.e, b.r), brBase + start + i);
+                }
+            }
+            else if (lodNode(c, sz[ch], lod)) proxySDF(c, p, auxBase + ref, s);
+        }
+        for (uint32_t j = cnt; j-- > 0u;)
+        {
+            uint32_t ch = order[j];
+            if (beyond(c, dc[ch], s)) continue;
+            uint32_t ref = wideWord(c, base, ni, 4u + ch);
+            if ((ref & 0x80000000u) != 0u || lodNode(c, sz[ch], lod)) continue;
+            if (sp < 64 && !unborn(c, auxBase + ref)) { stack[sp] = childRef(c, ni, ch, ref); stackD[sp++] = dc[ch]; }
+        }
+    }
+}
+
+void leafSDF(const Ctx& c, const glm::vec3& p, const Node& nd, uint32_t brBase, Sdf& s)
+{
+    for (uint32_t i = 0u; i < nd.hi; ++i)
+    {
+        s.tests += 1.f;
+        Branch b = branch(c, brBase + nd.lo + i);
+        if (!grow(c, b)) continue;
+        blend(c, s, sdCyl(p, b.s, b.e, b.r), brBase + nd.lo + i);
+    }
+}
+
+void sceneSDFStackless(const Ctx& c, const glm::vec3& p, uint32_t base, uint32_t brBase,
+    uint32_t auxBase, float lod, Sdf& s)
+{
+    Node root = node(c, base, 0u);
+    uint32_t end = root.leaf ? 1u : root.lo;
+
+    uint32_t ni = 0u;
+    while (ni < end)
+    {
+        s.tests += 1.f;
+        Node nd = node(c, base, ni);
+        bool cull = beyond(c, sdAABB(p, nd.mn, nd.mx), s) || unborn(c, auxBase + ni);
+        if (nd.leaf)
+        {
+            if (!cull) leafSDF(c, p, nd, brBase, s);
+            ni += 1u + nd.skip;
+        }
+        else if (!cull && lodNode(c, glm::length(nd.mx - nd.mn), lod))
+        {
+            proxySDF(c, p, auxBase + ni, s);
+            ni = nd.lo;
+        }
+        else ni = cull ? nd.lo : ni + 1u;
+    }
+}
+
+void sceneSDFStack(const Ctx& c, const glm::vec3& p, uint32_t base, uint32_t brBase,
+    uint32_t auxBase, float lod, Sdf& s)
+{
+    uint32_t stack[64]; float stackD[64]; int sp = 0;
+    stack[sp] = rootRef(c, base); stackD[sp++] = 0.f;
+    s.tests += 1.f;
+
+    while (sp > 0)
+    {
+        --sp;
+        if (beyond(c, stackD[sp], s)) continue;
+        uint32_t e = stack[sp], ni = nodeIndex(c, e);
+
+        Node nd = node(c, base, e);
+        if (unborn(c, auxBase + ni)) continue;
+
+        if (nd.leaf) leafSDF(c, p, nd, brBase, s);
+        else if (lodNode(c, glm::length(nd.mx - nd.mn), lod)) proxySDF(c, p, auxBase + ni, s);
+        else if (sp + 2 <= 64)
+        {
+            uint32_t a = childRef(c, e, 0u, ni + 1u), b = childRef(c, e, 1u, nd.hi);
+            Node na = node(c, base, a), nb = node(c, base, b);
+            s.tests += 2.f;
+            float da = sdAABB(p, na.mn, na.mx), db = sdAABB(p, nb.mn, nb.mx);
+            if (da > db) { std::swap(a, b); std::swap(da, db); }
+            stack[sp] = b; stackD[sp++] = db;
+            stack[sp] = a; stackD[sp++] = da;
+        }
+    }
+}
+
+void plantSDF(const Ctx& c, const glm::vec3& p, uint32_t base, uint32_t brBase,
+    uint32_t auxBase, float lod, Sdf& s)
+{
+    if (c.s.bvhWidth > 2u) sceneSDFWide(c, p, base, brBase, auxBase, lod, s);
+    else if (c.s.stackless) sceneSDFStackless(c, p, base, brBase, auxBase, lod, s);
+    else sceneSDFStack(c, p, base, brBase, auxBase, lod, s);
+}
+
+void instanceSDF(const Ctx& c, const glm::vec3& p, uint32_t k, float lod, Sdf& s)
+{
+    const glm::vec4* r = &c.s.instances[k * 4u];
+    const glm::vec3 r0(r[0]), r1(r[1]), r2(r[2]);
+    glm::vec3 q = p - glm::vec3(r[0].w, r[1].w, r[2].w);
+    glm::vec3 pl(glm::dot(r0, q), glm::dot(r1, q), glm::dot(r2, q));
+
+    uint32_t id = s.id; s.id = kNoParent;
+    s.d /= r[3].x;
+    plantSDF(c, pl, floatBits(r[3].y), floatBits(r[3].z), floatBits(r[3].w),
+        lod / r[3].x, s);
+    s.d *= r[3].x;
+    if (s.id == kNoParent) s.id = id; else s.inst = k;
+}
+
+Sdf sceneSDF(const Ctx& c, const glm::vec3& p)
+{
+    Sdf s{ 1e9f, 0u, 0u, 0.f };
+
+    float lod = c.pc.camPos.w * glm::length(p - glm::vec3(c.pc.camPos));
+
+    uint32_t nInst = uint32_t(c.pc.flags.z);
+    if (nInst == 0u) { plantSDF(c, p, 0u, 0u, 0u, lod, s); return s; }
+
+    Node root = node(c, 0u, 0u);
+    uint32_t end = root.leaf ? 1u : root.lo;
+    uint32_t ni = 0u;
+    while (ni < end)
+    {
+        s.tests += 1.f;
+        Node nd = node(c, 0u, ni);
+        bool cull = beyond(c, sdAABB(p, nd.mn, nd.mx), s);
+        if (nd.leaf)
+        {
+            if (!cull)
+                for (uint32_t k = 0u; k < nd.hi; ++k) instanceSDF(c, p, nd.lo + k, lod, s);
+            ni += 1u + nd.skip;
+        }
+        else ni = cull ? nd.lo : ni + 1u;
+    }
+    return s;
+}
+
+/* ---------- cone_comp.glsl -------------------------------------------- */
+/* the prepass's main() for tile (tx, ty): safe start depth, kFar = empty */
+float conePixel(const Ctx& c, int tx, int ty, float& tests)
+{
+    const float x0 = float(tx * kConeTile), y0 = float(ty * kConeTile);
+    const float x1 = x0 + kConeTile, y1 = y0 + kConeTile;
+    glm::vec3 ro(c.pc.camPos);
+    glm::vec3 rd = rayDir(c, 0.5f * (x0 + x1), 0.5f * (y0 + y1));
+    float k = std::max(std::max(glm::length(rayDir(c, x0, y0) - rd), glm::length(rayDir(c, x1, y0) - rd)),
+                       std::max(glm::length(rayDir(c, x0, y1) - rd), glm::length(rayDir(c, x1, y1) - rd)));
+
+    float t = 0.f;
+    for (int i = 0; i < kSteps(c); ++i)
+    {
+        Sdf s = sceneSDF(c, ro + rd * t);
+        tests += s.tests;
+        float step = (s.d - t * k) / (1.f + k);
+        if (step < kEps(c)) break;
+        t += step; if (t > kFar) break;
+    }
+    return std::min(t, kFar);
+}
+
+/* ---------- raymarch_comp.glsl ----------------------------------------- */
+struct Trace { float t, cnt; uint32_t steps; Sdf hit; float graze; };
+
+
+Trace sphereMarch(const Ctx& c, const glm::vec3& ro, const glm::vec3& rd, float t0)
+{
+    float t = t0, tot = 0.f;
+    for (int i = 0; i < kSteps(c); ++i)
+    {
+        Sdf s = sceneSDF(c, ro + rd * t);
+        tot += s.tests;
+        if (s.d < kEps(c)) return { t, tot, uint32_t(i + 1), s, kFar };
+        t += s.d; if (t > kFar) return { kFar, tot, uint32_t(i + 1), Sdf{ kFar, 0u, 0u, 0.f }, kFar };
+    }
+    return { kFar, tot, uint32_t(kSteps(c)), Sdf{ kFar, 0u, 0u, 0.f }, kFar };
+}
+
+/* ---------- interval marching ------------------------------------------ */
+bool slab(const Ctx& c, const glm::vec3& ro, const glm::vec3& inv, const glm::vec3& mn, const glm::vec3& mx,
+    float& ta, float& tb)
+{
+    glm::vec3 a = (mn - kBlend(c) - ro) * inv, b = (mx + kBlend(c) - ro) * inv;
+    glm::vec3 lo = glm::min(a, b), hi = glm::max(a, b);
+    ta = std::max(std::max(lo.x, lo.y), lo.z);
+    tb = std::min(std::min(hi.x, hi.y), hi.z);
+    return ta <= tb;
+}
+
+float capsuleHit(const glm::vec3& ro, const glm::vec3& rd, const glm::vec3& pa, const glm::vec3& pb, float r)
+{
+    if (sdCyl(ro, pa, pb, r) <= 0.f) return 0.f;
+    glm::vec3 ba = pb - pa, oa = ro - pa;
+    float baba = glm::dot(ba, ba), bard = glm::dot(ba, rd), baoa = glm::dot(ba, oa);
+    float rdrd = glm::dot(rd, rd), rdoa = glm::dot(rd, oa), oaoa = glm::dot(oa, oa);
+    float a = baba * rdrd - bard * bard;
+    float b = baba * rdoa - baoa * bard;
+    float cc = baba * oaoa - baoa * baoa - r * r * baba;
+    float h = b * b - a * cc;
+    if (h < 0.f) return -1.f;
+
+    float t = (-b - std::sqrt(h)) / a;
+    float y = baoa + t * bard;
+    if (y > 0.f && y < baba) return t;
+
+    glm::vec3 oc = y <= 0.f ? oa : ro - pb;
+    b = glm::dot(rd, oc); cc = glm::dot(oc, oc) - r * r;
+    h = b * b - rdrd * cc;
+    return h > 0.f ? (-b - std::sqrt(h)) / rdrd : -1.f;
+}
+
+void hitCapsule(const Ctx& c, const glm::vec3& ro, const glm::vec3& rd, float ta, const glm::vec3& a, const glm::vec3& b,
+    float r, float eps, uint32_t id, uint32_t k, Trace& tr)
+{
+    tr.cnt += 1.f;
+    float t = capsuleHit(ro, rd, a, b, r + eps);
+    if (t >= 0.f) { if (ta + t < tr.t) { tr.t = ta + t; tr.hit = Sdf{ 0.f, id, k, 0.f }; } }
+    else
+    {
+        t = capsuleHit(ro, rd, a, b, r + eps + 0.25f * kBlend(c));
+        if (t >= 0.f) tr.graze = std::min(tr.graze, ta + t);
+    }
+}
+
+void hitSpan(const Ctx& c, const glm::vec3& ro0, const glm::vec3& rd, float sc, float ta,
+    uint32_t lo, uint32_t n, uint32_t k, Trace& tr)
+{
+    const glm::vec3 ro = ro0 + rd * ta;
+    const float eps = kEps(c) / sc;
+    tr.steps += 1u;
+    if ((lo & kProxyBit) != 0u)
+    {
+        const BvhNodeAux& x = c.s.nodeAux[lo & ~kProxyBit];
+        hitCapsule(c, ro, rd, ta, x.a, x.b, x.r, eps, lo, k, tr);
+        return;
+    }
+    for (uint32_t j = 0u; j < n; ++j)
+    {
+        Branch b = branch(c, lo + j);
+        if (!grow(c, b)) { tr.cnt += 1.f; continue; }
+        hitCapsule(c, ro, rd, ta, b.s, b.e, b.r, eps, lo + j, k, tr);
+    }
+}
+
+void marchSpan(const Ctx& c, const glm::vec3& ro, const glm::vec3& rd, float sc, float ta, float tb,
+    uint32_t lo, uint32_t n, uint32_t k, Trace& tr)
+{
+    if (c.s.marchMode == 2u) { hitSpan(c, ro, rd, sc, ta, lo, n, k, tr); return; }
+    tb = std::min(tb, tr.t);
+    float t = ta;
+    for (int i = 0; i < kSteps(c) && t <= tb; ++i)
+    {
+        glm::vec3 p = ro + rd * t;
+        Sdf s{ 1e9f, 0u, k, 0.f };
+        if ((lo & kProxyBit) != 0u) proxySDF(c, p, lo & ~kProxyBit, s);
+        else for (uint32_t j = 0u; j < n; ++j)
+        {
+            s.tests += 1.f;
+            Branch b = branch(c, lo + j);
+            if (!grow(c, b)) continue;
+            blend(c, s, sdCyl(p, b.s, b.e, b.r), lo + j);
+        }
+        tr.cnt += s.tests; tr.steps += 1u;
+        if (s.d * sc < kEps(c)) { tr.t = t; tr.hit = s; return; }
+        t += s.d * sc;
+    }
+}
+
+bool span(const Ctx& c, const glm::vec3& ro, const glm::vec3& inv, const glm::vec3& mn, const glm::vec3& mx,
+    float t0, float tBest, float& ta, float& tb)
+{
+    if (!slab(c, ro, inv, mn, mx, ta, tb) || tb < t0 || ta > tBest) return false;
+    ta = std::max(ta, t0);
+    return true;
+}
+
+void spansStackless(const Ctx& c, const glm::vec3& ro, const glm::vec3& rd, float sc, uint32_t base,
+    uint32_t brBase, uint32_t auxBase, uint32_t k, float t0, Trace& tr)
+{
+    const glm::vec3 inv = 1.f / rd;
+    Node root = node(c, base, 0u);
+    uint32_t end = root.leaf ? 1u : root.lo;
+
+    uint32_t ni = 0u;
+    while (ni < end)
+    {
+        tr.cnt += 1.f;
+        Node nd = node(c, base, ni);
+        float ta, tb;
+        bool cull = !span(c, ro, inv, nd.mn, nd.mx, t0, tr.t, ta, tb) || unborn(c, auxBase + ni);
+        if (nd.leaf)
+        {
+            if (!cull) marchSpan(c, ro, rd, sc, ta, tb, brBase + nd.lo, nd.hi, k, tr);
+            ni += 1u + nd.skip;
+        }
+        else if (!cull && lodNode(c, glm::length(nd.mx - nd.mn), c.pc.camPos.w * ta / sc))
+        {
+            marchSpan(c, ro, rd, sc, ta, tb, kProxyBit | (auxBase + ni), 0u, k, tr);
+            ni = nd.lo;
+        }
+        else ni = cull ? nd.lo : ni + 1u;
+    }
+}
+
+void spansStack(const Ctx& c, const glm::vec3& ro, const glm::vec3& rd, float sc, uint32_t base,
+    uint32_t brBase, uint32_t auxBase, uint32_t k, float t0, Trace& tr)
+{
+    const glm::vec3 inv = 1.f / rd;
+    uint32_t stack[64]; glm::vec2 stackT[64]; int sp = 0;
+
+    float ta, tb;
+    tr.cnt += 1.f;
+    uint32_t e = rootRef(c, base);
+    Node root = node(c, base, e);
+    if (!span(c, ro, inv, root.mn, root.mx, t0, tr.t, ta, tb) || unborn(c, auxBase)) return;
+    stack[sp] = e; stackT[sp++] = { ta, tb };
+
+    while (sp > 0)
+    {
+        --sp;
+        if (stackT[sp].x > tr.t) continue;
+        e = stack[sp];
+        uint32_t ni = nodeIndex(c, e);
+        Node nd = node(c, base, e);
+        if (nd.leaf)
+        {
+            marchSpan(c, ro, rd, sc, stackT[sp].x, stackT[sp].y, brBase + nd.lo, nd.hi, k, tr);
+            continue;
+        }
+        if (lodNode(c, glm::length(nd.mx - nd.mn), c.pc.camPos.w * stackT[sp].x / sc))
+        {
+            marchSpan(c, ro, rd, sc, stackT[sp].x, stackT[sp].y, kProxyBit | (auxBase + ni), 0u, k, tr);
+            continue;
+        }
+
+        uint32_t ch[2] = { ni + 1u, nd.hi };
+        glm::vec2 ct[2]; bool hit[2];
+        for (int j = 0; j < 2; ++j)
+        {
+            tr.cnt += 1.f;
+            uint32_t ce = childRef(c, e, uint32_t(j), ch[j]);
+            Node cn = node(c, base, ce);
+            hit[j] = span(c, ro, inv, cn.mn, cn.mx, t0, tr.t, ta, tb) && !unborn(c, auxBase + ch[j]);
+            ch[j] = ce;
+            ct[j] = { ta, tb };
+        }
+        int nearC = (hit[0] && hit[1] && ct[1].x < ct[0].x) ? 1 : 0;
+        for (int j = 0; j < 2; ++j)
+        {
+            int cj = j == 0 ? 1 - nearC : nearC;
+            if (hit[cj] && sp < 64) { stack[sp] = ch[cj]; stackT[sp++] = ct[cj]; }
+        }
+    }
+}
+
+void spansWide(const Ctx& c, const glm::vec3& ro, const glm::vec3& rd, float sc, uint32_t base,
+    uint32_t brBase, uint32_t auxBase, uint32_t k, float t0, Trace& tr)
+{
+    const glm::vec3 inv = 1.f / rd;
+    uint32_t stack[64]; float stackT[64]; int sp = 0;
+    stack[sp] = rootRef(c, base); stackT[sp++] = t0;
+
+    while (sp > 0)
+    {
+        --sp;
+        if (stackT[sp] > tr.t) continue;
+        uint32_t ni = stack[sp];
+        tr.cnt += 1.f;
+
+        uint32_t hdr = wideWord(c, base, ni, 3u);
+        uint32_t cnt = hdr >> 24;
+        glm::vec3 org(bitsFloat(wideWord(c, base, ni, 0u)), bitsFloat(wideWord(c, base, ni, 1u)),
+            bitsFloat(wideWord(c, base, ni, 2u)));
+        glm::vec3 scl(std::ldexp(1.f, int8_t(hdr & 0xffu)), std::ldexp(1.f, int8_t((hdr >> 8) & 0xffu)),
+            std::ldexp(1.f, int8_t((hdr >> 16) & 0xffu)));
+
+        glm::vec2 ct[8]; float sz[8]; uint32_t order[8]; uint32_t m = 0u;
+        for (uint32_t ch = 0u; ch < cnt; ++ch)
+        {
+            glm::vec3 lo(float(planeByte(c, base, ni, 0u, ch)), float(planeByte(c, base, ni, 2u, ch)),
+                float(planeByte(c, base, ni, 4u, ch)));
+            glm::vec3 hi(float(planeByte(c, base, ni, 1u, ch)), float(planeByte(c, base, ni, 3u, ch)),
+                float(planeByte(c, base, ni, 5u, ch)));
+            float ta, tb;
+            if (!span(c, ro, inv, org + lo * scl, org + hi * scl, t0, tr.t, ta, tb)) continue;
+            ct[ch] = { ta, tb };
+            sz[ch] = glm::length((hi - lo) * scl);
+            uint32_t j = m++;
+            for (; j > 0u && ct[order[j - 1u]].x > ta; --j) order[j] = order[j - 1u];
+            order[j] = ch;
+        }
+
+        for (uint32_t j = 0u; j < m; ++j)
+        {
+            uint32_t ch = order[j];
+            uint32_t ref = wideWord(c, base, ni, 4u + ch);
+            if ((ref & 0x80000000u) != 0u)
+                marchSpan(c, ro, rd, sc, ct[ch].x, ct[ch].y,
+                    brBase + (ref & 0x00ffffffu), (ref >> 24) & 0x7fu, k, tr);
+            else if (lodNode(c, sz[ch], c.pc.camPos.w * ct[ch].x / sc))
+                marchSpan(c, ro, rd, sc, ct[ch].x, ct[ch].y, kProxyBit | (auxBase + ref), 0u, k, tr);
+        }
+        for (uint32_t j = m; j-- > 0u;)
+        {
+            uint32_t ch = order[j];
+            uint32_t ref = wideWord(c, base, ni, 4u + ch);
+            if ((ref & 0x80000000u) != 0u || lodNode(c, sz[ch], c.pc.camPos.w * ct[ch].x / sc)) continue;
+            if (sp < 64 && !unborn(c, auxBase + ref)) { stack[sp] = childRef(c, ni, ch, ref); stackT[sp++] = ct[ch].x; }
+        }
+    }
+}
+
+void plantSpans(const Ctx& c, const glm::vec3& ro, const glm::vec3& rd, float sc, uint32_t base,
+    uint32_t brBase, uint32_t auxBase, uint32_t k, float t0, Trace& tr)
+{
+    if (c.s.bvhWidth > 2u) spansWide(c, ro, rd, sc, base, brBase, auxBase, k, t0, tr);
+    else if (c.s.stackless) spansStackless(c, ro, rd, sc, base, brBase, auxBase, k, t0, tr);
+    else spansStack(c, ro, rd, sc, base, brBase, auxBase, k, t0, tr);
+}
+
+Trace intervalMarch(const Ctx& c, const glm::vec3& ro, const glm::vec3& rd, float t0)
+{
+    Trace tr{ kFar, 0.f, 0u, Sdf{ kFar, 0u, 0u, 0.f }, kFar };
+
+    uint32_t nInst = uint32_t(c.pc.flags.z);
+    if (nInst == 0u) { plantSpans(c, ro, rd, 1.f, 0u, 0u, 0u, 0u, t0, tr); return tr; }
+
+    const glm::vec3 inv = 1.f / rd;
+    Node root = node(c, 0u, 0u);
+    uint32_t end = root.leaf ? 1u : root.lo;
+    uint32_t ni = 0u;
+    while (ni < end)
+    {
+        tr.cnt += 1.f;
+        Node nd = node(c, 0u, ni);
+        float ta, tb;
+        bool cull = !span(c, ro, inv, nd.mn, nd.mx, t0, tr.t, ta, tb);
+        if (nd.leaf)
+        {
+            if (!cull)
+                for (uint32_t j = 0u; j < nd.hi; ++j)
+                {
+                    uint32_t k = nd.lo + j;
+                    const glm::vec4* r = &c.s.instances[k * 4u];
+                    const glm::vec3 r0(r[0]), r1(r[1]), r2(r[2]);
+                    glm::vec3 q = ro - glm::vec3(r[0].w, r[1].w, r[2].w);
+                    plantSpans(c, glm::vec3(glm::dot(r0, q), glm::dot(r1, q), glm::dot(r2, q)),
+                        glm::vec3(glm::dot(r0, rd), glm::dot(r1, rd), glm::dot(r2, rd)), r[3].x,
+                        floatBits(r[3].y), floatBits(r[3].z), floatBits(r[3].w), k, t0, tr);
+                }
+            ni += 1u + nd.skip;
+        }
+        else ni = cull ? nd.lo : ni + 1u;
+    }
+    return tr;
+}
+
+void refineJoint(const Ctx& c, const glm::vec3& ro, const glm::vec3& rd, float t0, Trace& tr)
+{
+    const int JOINT_STEPS = 8;
+    float t;
+    if (tr.graze < tr.t) t = std::max(t0, tr.graze);
+    else
+    {
+        Sdf s = sceneSDF(c, ro + rd * tr.t);
+        tr.cnt += s.tests; tr.steps += 1u;
+        if (s.d >= 0.f) return;
+        t = std::max(t0, tr.t - kBlend(c));
+    }
+
+    for (int i = 0; i < JOINT_STEPS && t < tr.t; ++i)
+    {
+        Sdf s = sceneSDF(c, ro + rd * t);
+        tr.cnt += s.tests; tr.steps += 1u;
+        if (s.d < kEps(c)) { tr.t = t; tr.hit = s; return; }
+        t += s.d;
+    }
+}
+
+Trace raymarch(const Ctx& c, const glm::vec3& ro, const glm::vec3& rd, float t0)
+{
+    if (c.s.marchMode == 0u) return sphereMarch(c, ro, rd, t0);
+    Trace tr = intervalMarch(c, ro, rd, t0);
+    if (c.s.marchMode == 2u && std::min(tr.t, tr.graze) < kFar) refineJoint(c, ro, rd, t0, tr);
+    return tr;
+}
+
+/* the march pass's main(): one visibility texel */
+struct Vis { uint32_t x, y, z, w; };
+
+Vis marchPixel(const Ctx& c, int x, int y, float t0)
+{
+    glm::vec3 ro, rd;
+    cameraRay(c, x, y, ro, rd);
+    Trace tr = raymarch(c, ro, rd, t0);
+    return { floatBits(tr.t), tr.hit.id,
+             (tr.hit.inst & 0xffffu) | (std::min(tr.steps, 0xffffu) << 16),
+             uint32_t(tr.cnt) };
+}
+
+/* ---------- shade_comp.glsl -------------------------------------------- */
+glm::vec3 hitGrad(const Ctx& c, const glm::vec3& p, uint32_t id)
+{
+    glm::vec3 g;
+    if ((id & kProxyBit) != 0u)
+    {
+        const BvhNodeAux& x = c.s.nodeAux[id & ~kProxyBit];
+        sdCyl(p, x.a, x.b, x.r, g);
+        return g;
+    }
+
+    Branch b = branch(c, id);
+    grow(c, b);
+    float d = sdCyl(p, b.s, b.e, b.r, g);
+
+    uint32_t pi = parentOf(c, id);
+    if (pi == kNoParent) return g;
+    Branch q = branch(c, pi);
+    if (!grow(c, q)) return g;
+    glm::vec3 gq; float dq = sdCyl(p, q.s, q.e, q.r, gq);
+    if (dq >= d + kBlend(c)) return g;
+    return gq + (g - gq) * smoothWeight(c, dq, d);
+}
+
+/* world-space gradient (unnormalised) of the hit capsule at p */
+glm::vec3 hitGradWorld(const Ctx& c, const glm::vec3& p, uint32_t id, uint32_t k)
+{
+    if (c.pc.flags.z < 0.5f) return hitGrad(c, p, id);
+
+    const glm::vec4* r = &c.s.instances[k * 4u];
+    const glm::vec3 r0(r[0]), r1(r[1]), r2(r[2]);
+    glm::vec3 q = p - glm::vec3(r[0].w, r[1].w, r[2].w);
+    glm::vec3 g = hitGrad(c, glm::vec3(glm::dot(r0, q), glm::dot(r1, q), glm::dot(r2, q)), id);
+    return r0 * g.x + r1 * g.y + r2 * g.z;
+}
+
+glm::vec3 hitNormal(const Ctx& c, const glm::vec3& p, uint32_t id, uint32_t k)
+{
+    return glm::normalize(hitGradWorld(c, p, id, k));
+}
+
+glm::vec3 shade(const Ctx& c, const glm::vec3& p, const glm::vec3& n)
+{
+    glm::vec3 base(0.4f, 0.3f, 0.2f);
+    glm::vec3 L = glm::normalize(glm::vec3(1, 1, -0.5f));
+    glm::vec3 V = glm::normalize(glm::vec3(c.pc.camPos) - p);
+    glm::vec3 H = glm::normalize(L + V);
+
+    glm::vec3 amb = 0.15f * base;
+    glm::vec3 dif = 0.75f * base * std::max(glm::dot(n, L), 0.f);
+    float sp = std::pow(std::max(glm::dot(n, H), 0.f), 16.f) * 0.2f;
+    return amb + dif + glm::vec3(sp);
+}
+
+/* ---------- skeleton overlay ------------------------------------------- */
+const float kLinePixels = 0.75f;
+
+bool nearAxis(const glm::vec3& ro, const glm::vec3& rd, const glm::vec3& a, const glm::vec3& b, float ang)
+{
+    glm::vec3 ab = b - a, ao = ro - a;
+    float ab2 = glm::dot(ab, ab), d = glm::dot(rd, ab), e = glm::dot(ao, ab), f = glm::dot(rd, ao);
+    float den = ab2 - d * d;
+    float u = den > 1e-9f ? clamp01((e - d * f) / den) : 0.f;
+    float t = std::max(d * u - f, 0.f);
+    u = clamp01((e + d * t) / std::max(ab2, 1e-12f));
+    return glm::length(ao + rd * t - ab * u) < ang * t;
+}
+
+bool nearBox(const glm::vec3& ro, const glm::vec3& inv, const glm::vec3& mn, const glm::vec3& mx, float ang)
+{
+    float w = ang * glm::length(glm::max(glm::abs(mn - ro), glm::abs(mx - ro)));
+    glm::vec3 a = (mn - w - ro) * inv, b = (mx + w - ro) * inv;
+    glm::vec3 lo = glm::min(a, b), hi = glm::max(a, b);
+    float ta = std::max(std::max(lo.x, lo.y), lo.z), tb = std::min(std::min(hi.x, hi.y), hi.z);
+    return ta <= tb && tb >= 0.f;
+}
+
+bool nearLeaf(const Ctx& c, const glm::vec3& ro, const glm::vec3& rd, uint32_t lo, uint32_t n, float ang)
+{
+    for (uint32_t i = 0u; i < n; ++i)
+    {
+        Branch b = branch(c, lo + i);
+        if (grow(c, b) && nearAxis(ro, rd, b.s, b.e, ang)) return true;
+    }
+    return false;
+}
+
+bool skeletonHit(const Ctx& c, const glm::vec3& ro, const glm::vec3& rd)
+{
+    float ang = kLinePixels * 2.f / c.pc.scr.y;
+    glm::vec3 inv = 1.f / rd;
+
+    if (c.s.bvhWidth > 2u)
+    {
+        uint32_t stack[64]; int sp = 0;
+        stack[sp++] = 0u;
+        while (sp > 0)
+        {
+            uint32_t ni = stack[--sp];
+            uint32_t hdr = wideWord(c, 0u, ni, 3u);
+            uint32_t cnt = hdr >> 24;
+            glm::vec3 org(bitsFloat(wideWord(c, 0u, ni, 0u)), bitsFloat(wideWord(c, 0u, ni, 1u)),
+                bitsFloat(wideWord(c, 0u, ni, 2u)));
+            glm::vec3 scl(std::ldexp(1.f, int8_t(hdr & 0xffu)), std::ldexp(1.f, int8_t((hdr >> 8) & 0xffu)),
+                std::ldexp(1.f, int8_t((hdr >> 16) & 0xffu)));
+            for (uint32_t ch = 0u; ch < cnt; ++ch)
+            {
+                glm::vec3 lo(planeByte(c, 0u, ni, 0u, ch), planeByte(c, 0u, ni, 2u, ch), planeByte(c, 0u, ni, 4u, ch));
+                glm::vec3 hi(planeByte(c, 0u, ni, 1u, ch), planeByte(c, 0u, ni, 3u, ch), planeByte(c, 0u, ni, 5u, ch));
+                if (!nearBox(ro, inv, org + lo * scl, org + hi * scl, ang)) continue;
+                uint32_t ref = wideWord(c, 0u, ni, 4u + ch);
+                if ((ref & 0x80000000u) != 0u)
+                {
+                    if (nearLeaf(c, ro, rd, ref & 0x00ffffffu, (ref >> 24) & 0x7fu, ang)) return true;
+                }
+                else if (sp < 64 && !unborn(c, ref)) stack[sp++] = ref;
+            }
+        }
+        return false;
+    }
+
+    Node root = node(c, 0u, 0u);
+    uint32_t end = root.leaf ? 1u : root.lo;
+    uint32_t ni = 0u;
+    while (ni < end)
+    {
+        Node nd = node(c, 0u, ni);
+        bool cull = !nearBox(ro, inv, nd.mn, nd.mx, ang) || unborn(c, ni);
+        if (nd.leaf)
+        {
+            if (!cull && nearLeaf(c, ro, rd, nd.lo, nd.hi, ang)) return true;
+            ni += 1u + nd.skip;
+        }
+        else ni = cull ? nd.lo : ni + 1u;
+    }
+    return false;
+}
+
+/* the shade pass's main() for one pixel; returns linear RGBA like imageStore */
+glm::vec4 shadePixel(const Ctx& c, int x, int y, float cone, const Vis& vis)
+{
+    glm::vec3 ro, rd;
+    cameraRay(c, x, y, ro, rd);
+
+    if (c.s.skeleton && c.pc.flags.z < 0.5f && skeletonHit(c, ro, rd)) return glm::vec4(1.f);
+
+    if (cone >= kFar) return glm::vec4(0.f, 0.15f, 0.2f, 1.f);
+
+    float t = bitsFloat(vis.x);
+    if (t > kFar - 0.1f) return glm::vec4(0.f, 0.15f, 0.2f, 1.f);
+
+    if (c.s.visMode == 2u)
+    {
+        float m = clamp01(float(vis.w) / c.pc.scr.z);
+        return glm::vec4(m, 0.f, 1.f - m, 1.f);
+    }
+    if (c.s.visMode == 1u)
+    {
+        float bfs = (vis.y & kProxyBit) != 0u ? c.pc.scr.w : branch(c, vis.y).bfs;
+        float cc = clamp01(bfs / c.pc.scr.w);
+        return glm::vec4(cc, 1.f - cc, 0.f, 1.f);
+    }
+    glm::vec3 pos = ro + rd * t;
+    return glm::vec4(shade(c, pos, hitNormal(c, pos, vis.y, vis.z & 0xffffu)), 1.f);
+}
+
+/* rgba8 UNORM store */
+uint8_t unorm8(float v) { return uint8_t(std::lround(clamp01(v) * 255.f)); }
+
+} // namespace
+
+/* ---------- scene setup ------------------------------------------------ */
+CpuScene cpuScenePlant(const std::vector<CPUBranch>& br, uint32_t bvhWidth,
+    uint32_t branchFormat)
+{
+    BvhBuildOptions opt;
+    opt.builder = BvhBuilder::Topology;
+    opt.leafOrder = true;
+    BuiltBVH b = buildBVH(br, opt);
+
+    CpuScene s;
+    s.bvhWidth = bvhWidth;
+    s.branchFormat = branchFormat;
+    std::vector<CPUBranch> slots = reorderBranches(br, b.order, b.clip);
+    s.branchWords = packBranches(slots, branchFormat);
+    s.numBranches = uint32_t(slots.size());
+    std::vector<BvhNodeAux> aux = bvhNodeAux(b, slots);
+    if (bvhWidth > 2u) {
+        WideBVH w = collapseBVH(b, bvhWidth);
+        s.nodeWords = w.words;
+        for (uint32_t n : w.binNode) s.nodeAux.push_back(aux[n]);
+    }
+    else {
+        s.nodeWords.resize(b.nodes.size() * (sizeof(BvhNode) / 4));
+        std::memcpy(s.nodeWords.data(), b.nodes.data(), b.nodes.size() * sizeof(BvhNode));
+        s.nodeAux = aux;
+    }
+    return s;
+}
+
+CpuScene cpuSceneForest(const TwoLevelBVH& f, uint32_t bvhWidth,
+    uint32_t branchFormat)
+{
+    CpuScene s;
+    s.bvhWidth = bvhWidth;
+    s.branchFormat = branchFormat;
+    s.branchWords = packBranches(f.branches, branchFormat);
+    s.numBranches = uint32_t(f.branches.size());
+    s.nodeWords = f.nodeWords;
+    s.instances = f.instanceData;
+    s.nodeAux = f.nodeAux;
+    return s;
+}
+
+CpuPush cpuOrbitCamera(float centerY, float dist, float yawDeg, float pitchDeg,
+    uint32_t width, uint32_t height)
+{
+    float yawR = glm::radians(yawDeg);
+    float pitchR = glm::radians(pitchDeg);
+    glm::vec3 fwd{ std::cos(pitchR) * std::cos(yawR), std::sin(pitchR), std::cos(pitchR) * std::sin(yawR) };
+
+    glm::vec3 target{ 0, centerY, 0 };
+    glm::vec3 pos = target - fwd * dist;
+    glm::vec3 right = glm::normalize(glm::cross(fwd, glm::vec3(0, 1, 0)));
+    glm::vec3 up = glm::normalize(glm::cross(right, fwd));
+
+    CpuPush pc{};
+    pc.camPos = glm::vec4(pos, 0);
+    pc.camR = glm::vec4(right, 0);
+    pc.camU = glm::vec4(up, 0);
+    pc.camF = glm::vec4(glm::normalize(fwd), 0);
+    pc.scr = glm::vec4(float(width), float(height), 0, 0);
+    pc.flags = glm::vec4(1.f, 0.f, 0.f, 1.f);
+    return pc;
+}
+
+CpuSdfSample cpuSceneSDF(const CpuScene& scene, const CpuPush& pc, const glm::vec3& p)
+{
+    Ctx c{ scene, pc };
+    Sdf s = sceneSDF(c, p);
+    CpuSdfSample r{ s.d, glm::vec3(0.f, 1.f, 0.f), 0.f, s.id, s.inst, s.tests };
+    if (s.d < 1e9f) {
+        r.grad = hitGradWorld(c, p, s.id, s.inst);
+        r.bfs = (s.id & kProxyBit) != 0u ? pc.scr.w : branch(c, s.id).bfs;
+    }
+    return r;
+}
+
+/* ---------- renderer --------------------------------------------------- */
+CpuRenderStats cpuRaymarch(const CpuScene& scene, const CpuPush& pc,
+    std::vector<uint8_t>& rgba, uint32_t threads)
+{
+    const int W = int(pc.scr.x), H = int(pc.scr.y);
+    const int kTile = 16;                          /* shader local size */
+    const int tilesX = (W + kTile - 1) / kTile, tilesY = (H + kTile - 1) / kTile;
+    rgba.assign(size_t(W) * H * 4, 0);
+
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<uint32_t>(threads, uint32_t(std::max(1, tilesX * tilesY)));
+
+    const NodeCache nodeCache = loadNodeCache(Ctx{ scene, pc });
+    const Ctx c{ scene, pc, &nodeCache };
+    const int coneW = (W + kConeTile - 1) / kConeTile, coneH = (H + kConeTile - 1) / kConeTile;
+    std::vector<float> cone(size_t(coneW) * coneH), coneTests(cone.size(), 0.f);
+    std::vector<uint32_t> tiles(cone.size());      /* binding 7 */
+    std::atomic<uint32_t> numTiles{ 0 };
+    std::vector<Vis> vis(size_t(W) * H);
+
+    /* one dispatch: workgroups 0..n-1 pulled from a shared counter,
+       pool joined at the end                                          */
+    auto dispatch = [&](int n, auto group) {
+        std::atomic<int> next{ 0 };
+        auto worker = [&]() {
+            for (int g; (g = next.fetch_add(1)) < n;) group(g);
+        };
+        std::vector<std::thread> pool;
+        for (uint32_t i = 1; i < threads; ++i) pool.emplace_back(worker);
+        worker();
+        for (auto& th : pool) th.join();
+    };
+    /* a w x h grid in 16 x 16 workgroups, fn(x, y) for every cell */
+    auto grid = [&](int w, int h, auto fn) {
+        const int tx = (w + kTile - 1) / kTile, ty = (h + kTile - 1) / kTile;
+        dispatch(tx * ty, [&](int g) {
+            const int x0 = (g % tx) * kTile, y0 = (g / tx) * kTile;
+            for (int y = y0; y < std::min(y0 + kTile, h); ++y)
+                for (int x = x0; x < std::min(x0 + kTile, w); ++x) fn(x, y);
+        });
+    };
+
+    const auto t0 = std::chrono::steady_clock::now();
+    grid(coneW, coneH, [&](int x, int y) {
+        size_t i = size_t(y) * coneW + x;
+        cone[i] = conePixel(c, x, y, coneTests[i]);
+        if (cone[i] < kFar) tiles[numTiles.fetch_add(1)] = uint32_t(x) | (uint32_t(y) << 16);
+    });
+    /* indirect: one kConeTile^2 workgroup per listed tile */
+    dispatch(int(numTiles.load()), [&](int g) {
+        const int tx = int(tiles[g] & 0xffffu), ty = int(tiles[g] >> 16);
+        const float t0 = cone[size_t(ty) * coneW + tx];
+        for (int y = ty * kConeTile; y < std::min((ty + 1) * kConeTile, H); ++y)
+            for (int x = tx * kConeTile; x < std::min((tx + 1) * kConeTile, W); ++x)
+                vis[size_t(y) * W + x] = marchPixel(c, x, y, t0);
+    });
+    grid(W, H, [&](int x, int y) {
+        glm::vec4 col = shadePixel(c, x, y, cone[size_t(y / kConeTile) * coneW + x / kConeTile],
+            vis[size_t(y) * W + x]);
+        uint8_t* px = &rgba[(size_t(y) * W + x) * 4];
+        px[0] = unorm8(col.x); px[1] = unorm8(col.y);
+        px[2] = unorm8(col.z); px[3] = unorm8(col.w);
+    });
+
+    CpuRenderStats st;
+    st.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    st.threads = threads;
+    st.marchedTiles = double(numTiles.load()) / double(std::max<size_t>(1, cone.size()));
+    for (const Vis& v : vis) { st.avgTests += double(v.w); st.avgSteps += double(v.z >> 16); }
+    for (float t : coneTests) st.avgTests += double(t);
+    st.avgTests /= std::max(1, W * H);
+    st.avgSteps /= std::max(1, W * H);
+    return st;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "BVH.hpp"
+#include "BranchLayout.hpp"
+#include "TwoLevelBVH.hpp"
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+/* --------------------------------------------------------------------------
+   CPU reference raymarcher - a line-by-line port of cone_comp.glsl (cone
+   prepass), raymarch_comp.glsl (march pass) and shade_comp.glsl (shade
+   pass).
+
+   Same bindings, same push block, same maths (sdCyl, smin with kBlend
+   0.005, the binary / stackless / wide traversals, instances, LOD
+   proxies, growth clock, visibility buffer, skeleton overlay, vis
+   modes, sphere / interval / analytic marching), so it doubles as a correctness oracle for shader changes and
+   as a GPU-free renderer.
+
+   Output is RGBA8, row 0 = top, W * H * 4 bytes - what captureFrameToPNG
+   hands to stbi_write_png.  Each pass runs workgroups (16 x 16 cells,
+   8 x 8 pixels per listed tile for the march pass) pulled from a shared
+   counter by a pool of threads.
+   --------------------------------------------------------------------------*/
+
+/* the GPU bindings, exactly as uploaded */
+struct CpuScene {
+    std::vector<uint32_t>   branchWords;   /* binding 1, packBranches()      */
+    std::vector<uint32_t>   nodeWords;     /* binding 2                       */
+    std::vector<glm::vec4>  instances;     /* binding 3                       */
+    std::vector<BvhNodeAux> nodeAux;       /* binding 4                       */
+
+    uint32_t bvhWidth = 4;                 /* specialisation constant 0      */
+    bool     stackless = true;             /* specialisation constant 1      */
+    uint32_t marchMode = 0;                /* specialisation constant 2:
+                                              sphere, BVH spans, analytic   */
+    uint32_t branchFormat = BRANCH_FORMAT_F32; /* specialisation constant 3 */
+    uint32_t nodeCacheDepth = 0;           /* specialisation constant 4:
+                                              nodeCacheDepth() levels        */
+    uint32_t numBranches = 0;              /* records in branchWords         */
+
+    /* the per-frame variant (pipelineVariant) */
+    float    blend = 0.005f;               /* specialisation constant 5, 0 = min */
+    uint32_t steps = 64;                   /* 6 } quality tier               */
+    float    eps = 0.001f;                 /* 7 }                            */
+    uint32_t visMode = 0;                  /* 8: shade, BFS depth, tests      */
+    bool     skeleton = false;             /* 9: wire-frame overlay           */
+};
+
+/* push constants, same layout and meaning as the shader's PC block */
+struct CpuPush {
+    glm::vec4 camPos, camR, camU, camF;
+    glm::vec4 scr;                         /* (W, H, numBranches, maxBFS)    */
+    glm::vec4 flags;                       /* (-, -, instances, clock)       */
+};
+
+struct CpuRenderStats {
+    double   ms = 0.0;
+    uint32_t threads = 0;
+    double   avgTests = 0.0;               /* BVH node + primitive tests / px,
+                                              cone prepass included          */
+    double   avgSteps = 0.0;               /* march-pass steps / px          */
+    double   marchedTiles = 0.0;           /* share of 8 x 8 tiles on the list */
+};
+
+/* one plant as maybeRegeneratePlant() uploads it (Topology, leaf order) */
+CpuScene cpuScenePlant(const std::vector<CPUBranch>& br, uint32_t bvhWidth = 4,
+    uint32_t branchFormat = BRANCH_FORMAT_F32);
+
+/* a forest as buildForest() uploads it */
+CpuScene cpuSceneForest(const TwoLevelBVH& f, uint32_t bvhWidth,
+    uint32_t branchFormat = BRANCH_FORMAT_F32);
+
+/* the viewer's orbit camera (recordCommandBuffer) around (0, centerY, 0);
+   scr.z / scr.w and flags are left for the caller                        */
+CpuPush cpuOrbitCamera(float centerY, float dist, float yawDeg, float pitchDeg,
+    uint32_t width, uint32_t height);
+
+/* threads = 0 -> std::thread::hardware_concurrency() */
+CpuRenderStats cpuRaymarch(const CpuScene& scene, const CpuPush& pc,
+    std::vector<uint8_t>& rgba, uint32_t threads = 0);
+
+/* the march pass's Sdf sample plus what the shade pass derives from it:
+   distance, analytic gradient of the dominant capsule (smin-blended with
+   its parent near the joint, world space), its BFS depth, the dominant
+   id (branch slot, or 0x80000000 | node-aux index for an LOD proxy),
+   the instance it belongs to, tests                                     */
+struct CpuSdfSample {
+    float     d;
+    glm::vec3 grad;
+    float     bfs;
+    uint32_t  branch;
+    uint32_t  instance;
+    float     tests;
+};
+
+/* sceneSDF() at one point */
+CpuSdfSample cpuSceneSDF(const CpuScene& scene, const CpuPush& pc, const glm::vec3& p);
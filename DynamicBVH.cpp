@@ -0,0 +1,351 @@
+/* --------------------------------------------------------------------------
+   DynamicBVH.cpp  -  SAH insertion, tree rotations, incremental flattening
+
+   Insertion cost of making node S the new leaf's sibling (Bittner et al.,
+   as used by Box2D's dynamic tree):
+       A(S u L) + sum over ancestors P of S of ( A(P u L) - A(P) )
+   The second term only grows going down, which bounds the search.
+   --------------------------------------------------------------------------*/
+#include "DynamicBVH.hpp"
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <stdexcept>
+
+/* ---------- helpers ---------------------------------------------------- */
+static float halfArea(const glm::vec3& mn, const glm::vec3& mx)
+{
+    glm::vec3 e = glm::max(mx - mn, glm::vec3(0.f));
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+static float unionArea(const glm::vec3& amn, const glm::vec3& amx,
+    const glm::vec3& bmn, const glm::vec3& bmx)
+{
+    return halfArea(glm::min(amn, bmn), glm::max(amx, bmx));
+}
+
+/* ---------- node pool -------------------------------------------------- */
+uint32_t DynamicBVH::allocNode()
+{
+    if (!m_free.empty()) {
+        uint32_t n = m_free.back(); m_free.pop_back();
+        m_nodes[n] = Node{};
+        return n;
+    }
+    m_nodes.emplace_back();
+    return uint32_t(m_nodes.size() - 1);
+}
+
+void DynamicBVH::freeNode(uint32_t n)
+{
+    m_nodes[n].leaves = 0;
+    m_free.push_back(n);
+}
+
+/* ---------- best sibling: branch and bound ----------------------------- */
+uint32_t DynamicBVH::findSibling(const glm::vec3& mn, const glm::vec3& mx) const
+{
+    const float leafArea = halfArea(mn, mx);
+    uint32_t best = m_root;
+    float bestCost = unionArea(m_nodes[m_root].mn, m_nodes[m_root].mx, mn, mx);
+
+    /* (lower bound, node, inherited cost) - cheapest bound first */
+    struct Cand { float bound; uint32_t node; float inherited; };
+    auto worse = [](const Cand& a, const Cand& b) { return a.bound > b.bound; };
+    std::priority_queue<Cand, std::vector<Cand>, decltype(worse)> pq(worse);
+    pq.push({ 0.f, m_root, 0.f });
+
+    while (!pq.empty()) {
+        Cand c = pq.top(); pq.pop();
+        if (c.bound >= bestCost) break;
+
+        const Node& n = m_nodes[c.node];
+        float direct = unionArea(n.mn, n.mx, mn, mx);
+        float cost = direct + c.inherited;
+        if (cost < bestCost) { bestCost = cost; best = c.node; }
+
+        if (n.left == kNone) continue;
+        float inherited = c.inherited + direct - halfArea(n.mn, n.mx);
+        float bound = leafArea + inherited;
+        if (bound < bestCost) {
+            pq.push({ bound, n.left, inherited });
+            pq.push({ bound, n.right, inherited });
+        }
+    }
+    return best;
+}
+
+/* ---------- rotations -------------------------------------------------- */
+/* Try swapping one child of `a` with a grandchild under the other child;
+   keep the swap that shrinks that child's box the most.  a's own box is
+   unchanged (same leaves), so only one inner box changes per rotation.  */
+void DynamicBVH::rotate(uint32_t a)
+{
+    Node& A = m_nodes[a];
+    if (A.left == kNone) return;
+    const uint32_t b = A.left, c = A.right;
+
+    float bestGain = 0.f;
+    uint32_t moveUp = kNone, moveDown = kNone, target = kNone;
+
+    auto consider = [&](uint32_t down, uint32_t side) {
+        /* side is an internal child of a; down is side's sibling      */
+        const Node& S = m_nodes[side];
+        if (S.left == kNone) return;
+        const Node& D = m_nodes[down];
+        const float before = halfArea(S.mn, S.mx);
+        const uint32_t kids[2] = { S.left, S.right };
+        for (int k = 0; k < 2; ++k) {
+            const Node& keep = m_nodes[kids[1 - k]];
+            float gain = before - unionArea(D.mn, D.mx, keep.mn, keep.mx);
+            if (gain > bestGain) {
+                bestGain = gain; moveUp = kids[k]; moveDown = down; target = side;
+            }
+        }
+    };
+    consider(b, c);
+    consider(c, b);
+    if (target == kNone) return;
+
+    /* moveDown takes moveUp's place under target, and vice versa */
+    Node& T = m_nodes[target];
+    if (T.left == moveUp) T.left = moveDown; else T.right = moveDown;
+    if (A.left == moveDown) A.left = moveUp; else A.right = moveUp;
+    m_nodes[moveDown].parent = target;
+    m_nodes[moveUp].parent = a;
+
+    const Node& l = m_nodes[T.left];
+    const Node& r = m_nodes[T.right];
+    T.mn = glm::min(l.mn, r.mn);
+    T.mx = glm::max(l.mx, r.mx);
+    T.leaves = l.leaves + r.leaves;
+    T.dirty = true;
+}
+
+/* ---------- refit the path to the root --------------------------------- */
+void DynamicBVH::refitUp(uint32_t n)
+{
+    while (n != kNone) {
+        Node& N = m_nodes[n];
+        const Node& l = m_nodes[N.left];
+        const Node& r = m_nodes[N.right];
+        N.mn = glm::min(l.mn, r.mn);
+        N.mx = glm::max(l.mx, r.mx);
+        N.leaves = l.leaves + r.leaves;
+        N.dirty = true;
+        rotate(n);
+        n = m_nodes[n].parent;
+    }
+}
+
+/* ---------- public API ------------------------------------------------- */
+void DynamicBVH::insert(uint32_t branch, const CPUBranch& b)
+{
+    if (contains(branch))
+        throw std::runtime_error("DynamicBVH::insert: branch already present");
+    if (branch >= m_leafOf.size()) m_leafOf.resize(size_t(branch) + 1, kNone);
+
+    uint32_t leaf = allocNode();
+    {
+        Node& L = m_nodes[leaf];
+        L.mn = glm::min(glm::vec3(b.startX, b.startY, b.startZ),
+            glm::vec3(b.endX, b.endY, b.endZ)) - b.radius;
+        L.mx = glm::max(glm::vec3(b.startX, b.startY, b.startZ),
+            glm::vec3(b.endX, b.endY, b.endZ)) + b.radius;
+        L.right = branch;
+        L.leaves = 1;
+    }
+    m_leafOf[branch] = leaf;
+    ++m_leafCount;
+
+    if (m_root == kNone) { m_root = leaf; return; }
+
+    const uint32_t sib = findSibling(m_nodes[leaf].mn, m_nodes[leaf].mx);
+    const uint32_t oldParent = m_nodes[sib].parent;
+
+    /* the new parent takes over the sibling's region */
+    uint32_t p = allocNode();
+    Node& P = m_nodes[p];
+    P.parent = oldParent;
+    P.slot = m_nodes[sib].slot;
+    P.cap = m_nodes[sib].cap;
+    P.left = sib;
+    P.right = leaf;
+    m_nodes[sib].parent = p;
+    m_nodes[leaf].parent = p;
+
+    if (oldParent == kNone) m_root = p;
+    else {
+        Node& O = m_nodes[oldParent];
+        if (O.left == sib) O.left = p; else O.right = p;
+    }
+    refitUp(p);
+}
+
+void DynamicBVH::remove(uint32_t branch)
+{
+    if (!contains(branch))
+        throw std::runtime_error("DynamicBVH::remove: branch not present");
+
+    const uint32_t leaf = m_leafOf[branch];
+    m_leafOf[branch] = kNone;
+    --m_leafCount;
+
+    const uint32_t p = m_nodes[leaf].parent;
+    freeNode(leaf);
+    if (p == kNone) { m_root = kNone; return; }
+
+    /* the sibling takes the parent's place */
+    const Node& P = m_nodes[p];
+    const uint32_t sib = (P.left == leaf) ? P.right : P.left;
+    const uint32_t g = P.parent;
+    m_nodes[sib].parent = g;
+    freeNode(p);
+
+    if (g == kNone) { m_root = sib; m_nodes[sib].dirty = true; return; }
+    Node& G = m_nodes[g];
+    if (G.left == p) G.left = sib; else G.right = sib;
+    refitUp(g);
+}
+
+bool DynamicBVH::contains(uint32_t branch) const
+{
+    return branch < m_leafOf.size() && m_leafOf[branch] != kNone;
+}
+
+void DynamicBVH::clear()
+{
+    *this = DynamicBVH{};
+}
+
+/* ---------- flatten to the shader layout ------------------------------- */
+static BvhNode leafNode(const glm::vec3& mn, const glm::vec3& mx,
+    uint32_t branch, uint32_t skip)
+{
+    if (skip > 0x7fffffu)
+        throw std::runtime_error("DynamicBVH: leaf slack does not fit the node");
+    BvhNode n;
+    n.mn = mn; n.mx = mx;
+    n.lo = branch;
+    n.hi = 0x80000000u | (skip << 8) | 1u;
+    return n;
+}
+
+const BuiltBVH& DynamicBVH::serialize(std::vector<BvhDirtyRange>& dirty)
+{
+    dirty.clear();
+    if (m_root == kNone) {
+        /* same dummy leaf buildBVH() emits for an empty plant */
+        if (m_out.nodes.empty()) m_out.nodes.resize(1);
+        m_out.nodes[0] = leafNode(glm::vec3(0), glm::vec3(0), 0u, 0u);
+        m_out.nodes[0].hi = 0x80000000u;
+        dirty.push_back({ 0u, 1u });
+        return m_out;
+    }
+
+    /* root region = whole array; double it when the tree outgrows it */
+    const uint32_t need = 2u * m_nodes[m_root].leaves - 1u;
+    bool respread = false;
+    if (m_out.nodes.size() < need) {
+        m_out.nodes.resize(std::max<size_t>(2u * size_t(need), 64u));
+        respread = true;
+    }
+    const uint32_t total = uint32_t(m_out.nodes.size());
+
+    /* place(node, region): keep children where they are when they still
+       fit, otherwise split the region's slack by leaf count.  Once a
+       region is re-spread, everything below it is laid out afresh.     */
+    struct Item { uint32_t node, pos, cap; bool spread; };
+    std::vector<Item> todo{ { m_root, 0u, total, respread } };
+    std::vector<uint32_t> written;
+
+    while (!todo.empty()) {
+        Item it = todo.back(); todo.pop_back();
+        Node& N = m_nodes[it.node];
+
+        if (!it.spread && !N.dirty && N.slot == it.pos && N.cap == it.cap) continue;
+
+        /* the GPU copy mirrors m_out: identical bytes need no upload */
+        auto put = [&](const BvhNode& o) {
+            BvhNode& dst = m_out.nodes[it.pos];
+            if (std::memcmp(&dst, &o, sizeof(BvhNode)) == 0) return;
+            dst = o;
+            written.push_back(it.pos);
+        };
+
+        if (N.left == kNone) {
+            put(leafNode(N.mn, N.mx, N.right, it.cap - 1u));
+            N.slot = it.pos; N.cap = it.cap; N.dirty = false;
+            continue;
+        }
+
+        const Node& L = m_nodes[N.left];
+        const Node& R = m_nodes[N.right];
+        const uint32_t sL = 2u * L.leaves - 1u, sR = 2u * R.leaves - 1u;
+        const uint32_t room = it.cap - 1u;          /* for both children */
+        const uint32_t rEnd = it.pos + it.cap;
+
+        uint32_t capL;
+        bool spread = it.spread;
+        if (!spread && L.slot == it.pos + 1u && L.cap >= sL && L.cap <= room - sR)
+            capL = L.cap;                              /* left stays   */
+        else if (!spread && R.slot != kNone && R.slot + R.cap == rEnd &&
+            R.cap >= sR && R.cap <= room - sL)
+            capL = room - R.cap;                       /* right stays  */
+        else {
+            const uint64_t slack = room - sL - sR;
+            capL = sL + uint32_t((slack * L.leaves + N.leaves / 2u) / N.leaves);
+            spread = true;
+        }
+
+        BvhNode o;
+        o.mn = N.mn; o.mx = N.mx;
+        o.lo = rEnd;                                   /* skip link    */
+        o.hi = it.pos + 1u + capL;                     /* right child  */
+        put(o);
+        N.slot = it.pos; N.cap = it.cap; N.dirty = false;
+
+        todo.push_back({ N.right, it.pos + 1u + capL, room - capL, spread });
+        todo.push_back({ N.left, it.pos + 1u, capL, spread });
+    }
+
+    /* sorted, adjacent writes merged */
+    std::sort(written.begin(), written.end());
+    for (uint32_t w : written) {
+        if (!dirty.empty() && dirty.back().first + dirty.back().count == w) ++dirty.back().count;
+        else dirty.push_back({ w, 1u });
+    }
+    if (respread) dirty.assign(1, { 0u, total });
+    return m_out;
+}
+
+BuiltBVH DynamicBVH::flatten() const
+{
+    BuiltBVH out;
+    if (m_root == kNone) {
+        out.nodes.push_back(leafNode(glm::vec3(0), glm::vec3(0), 0u, 0u));
+        out.nodes[0].hi = 0x80000000u;
+        return out;
+    }
+    out.nodes.resize(2u * m_nodes[m_root].leaves - 1u);
+
+    struct Item { uint32_t node, pos; };
+    std::vector<Item> todo{ { m_root, 0u } };
+    while (!todo.empty()) {
+        Item it = todo.back(); todo.pop_back();
+        const Node& N = m_nodes[it.node];
+        if (N.left == kNone) {
+            out.nodes[it.pos] = leafNode(N.mn, N.mx, N.right, 0u);
+            continue;
+        }
+        const uint32_t right = it.pos + 2u * m_nodes[N.left].leaves;
+        BvhNode& o = out.nodes[it.pos];
+        o.mn = N.mn; o.mx = N.mx;
+        o.lo = it.pos + 2u * N.leaves - 1u;           /* skip link */
+        o.hi = right;
+        todo.push_back({ N.right, right });
+        todo.push_back({ N.left, it.pos + 1u });
+    }
+    return out;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "BVH.hpp"
+#include <cstdint>
+#include <vector>
+
+/* --------------------------------------------------------------------------
+   Dynamic BVH - incremental tree for plants that grow branch by branch.
+
+   One leaf per branch.  insert() picks the sibling with the lowest SAH
+   cost (branch-and-bound over the tree), refits the path to the root and
+   applies the local tree rotations of dynamic AABB trees on the way up.
+   remove() splices the leaf out the same way.  Both cost O(log N) for a
+   reasonably balanced tree.
+
+   serialize() keeps a flat copy in the shader's BvhNode layout (preorder,
+   skip links).  A leaf's lo is the branch index itself, so leafIdx stays
+   empty and the branch SSBO is simply the source array in append order.
+   Every subtree owns a fixed region of that array; leaves keep unused
+   slots behind them (BvhNode leaf skip), so an insertion only rewrites
+   its path to the root plus the few nodes of the region it lands in.
+   When a region runs out, the smallest enclosing region with room is
+   re-spread; when the root runs out, capacity doubles.
+   --------------------------------------------------------------------------*/
+struct BvhDirtyRange {
+    uint32_t first = 0;        /* node index                              */
+    uint32_t count = 0;
+};
+
+class DynamicBVH {
+public:
+    /* branch indices are the caller's (position in its CPUBranch array) */
+    void insert(uint32_t branch, const CPUBranch& b);
+    void remove(uint32_t branch);
+    bool contains(uint32_t branch) const;
+    void clear();
+
+    uint32_t size() const { return m_leafCount; }
+
+    /* Update the flat copy.  dirty receives the node ranges written since
+       the last call (sorted, merged).  The array only grows, and only by
+       doubling; a grown array comes back as one full range.            */
+    const BuiltBVH& serialize(std::vector<BvhDirtyRange>& dirty);
+    const BuiltBVH& built() const { return m_out; }
+
+    /* one-shot tight copy (no slack), for the static buildBVH() path */
+    BuiltBVH flatten() const;
+
+private:
+    static constexpr uint32_t kNone = 0xffffffffu;
+
+    struct Node {
+        glm::vec3 mn, mx;
+        uint32_t parent = kNone;
+        uint32_t left = kNone;       /* kNone = leaf                     */
+        uint32_t right = kNone;      /* leaf: branch index               */
+        uint32_t leaves = 0;         /* leaves below (1 for a leaf)      */
+        uint32_t slot = kNone;       /* region in m_out: [slot, slot+cap) */
+        uint32_t cap = 0;
+        bool     dirty = true;
+    };
+
+    uint32_t allocNode();
+    void     freeNode(uint32_t n);
+    uint32_t findSibling(const glm::vec3& mn, const glm::vec3& mx) const;
+    void     refitUp(uint32_t n);
+    void     rotate(uint32_t a);
+
+    std::vector<Node>     m_nodes;
+    std::vector<uint32_t> m_free;
+    std::vector<uint32_t> m_leafOf;  /* branch -> leaf node, kNone = absent */
+    uint32_t m_root = kNone;
+    uint32_t m_leafCount = 0;
+
+    BuiltBVH m_out;
+};
@@ -14,6 +14,7 @@
 struct Symbol {
     char               name;              // e.g. 'F'  '+'  '&'
     std::vector<float> params;            // may be empty
+    int                gen = 0;           // expansion pass that wrote it
 };
 
 struct OutputSymbol {
@@ -0,0 +1,320 @@
+/* --------------------------------------------------------------------------
+   SdfBatch.cpp  -  8-wide packet evaluation of the plant SDF
+
+   The kernels are written once against F8 / M8 (8 floats / 8 lane
+   masks); those map to one __m256, two __m128 or a plain array.
+   --------------------------------------------------------------------------*/
+#include "SdfBatch.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SDFBATCH_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SDFBATCH_SSE 1
+#endif
+
+namespace {
+
+const float kBlend = 0.005f;          /* smin k in raymarch_comp.glsl */
+const float kMinAb2 = 1e-20f;         /* zero-length pieces: t = 0     */
+
+/* ---------- 8-lane float / mask ---------------------------------------- */
+#if defined(SDFBATCH_AVX2)
+struct F8 { __m256 v; };
+struct M8 { __m256 v; };
+inline F8 set1(float x) { return { _mm256_set1_ps(x) }; }
+inline F8 load(const float* p) { return { _mm256_loadu_ps(p) }; }
+inline void store(float* p, F8 a) { _mm256_storeu_ps(p, a.v); }
+inline F8 operator+(F8 a, F8 b) { return { _mm256_add_ps(a.v, b.v) }; }
+inline F8 operator-(F8 a, F8 b) { return { _mm256_sub_ps(a.v, b.v) }; }
+inline F8 operator*(F8 a, F8 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+inline F8 operator/(F8 a, F8 b) { return { _mm256_div_ps(a.v, b.v) }; }
+inline F8 vmin(F8 a, F8 b) { return { _mm256_min_ps(a.v, b.v) }; }
+inline F8 vmax(F8 a, F8 b) { return { _mm256_max_ps(a.v, b.v) }; }
+inline F8 vsqrt(F8 a) { return { _mm256_sqrt_ps(a.v) }; }
+inline M8 operator<(F8 a, F8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+inline uint32_t bits(M8 m) { return uint32_t(_mm256_movemask_ps(m.v)); }
+inline M8 fromBits(uint32_t b)
+{
+    const __m256i lane = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i m = _mm256_and_si256(_mm256_set1_epi32(int(b)), lane);
+    return { _mm256_castsi256_ps(_mm256_cmpeq_epi32(m, lane)) };
+}
+inline M8 operator&(M8 a, M8 b) { return { _mm256_and_ps(a.v, b.v) }; }
+inline F8 select(M8 m, F8 a, F8 b) { return { _mm256_blendv_ps(b.v, a.v, m.v) }; }
+#elif defined(SDFBATCH_SSE)
+struct F8 { __m128 lo, hi; };
+struct M8 { __m128 lo, hi; };
+inline F8 set1(float x) { return { _mm_set1_ps(x), _mm_set1_ps(x) }; }
+inline F8 load(const float* p) { return { _mm_loadu_ps(p), _mm_loadu_ps(p + 4) }; }
+inline void store(float* p, F8 a) { _mm_storeu_ps(p, a.lo); _mm_storeu_ps(p + 4, a.hi); }
+inline F8 operator+(F8 a, F8 b) { return { _mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi) }; }
+inline F8 operator-(F8 a, F8 b) { return { _mm_sub_ps(a.lo, b.lo), _mm_sub_ps(a.hi, b.hi) }; }
+inline F8 operator*(F8 a, F8 b) { return { _mm_mul_ps(a.lo, b.lo), _mm_mul_ps(a.hi, b.hi) }; }
+inline F8 operator/(F8 a, F8 b) { return { _mm_div_ps(a.lo, b.lo), _mm_div_ps(a.hi, b.hi) }; }
+inline F8 vmin(F8 a, F8 b) { return { _mm_min_ps(a.lo, b.lo), _mm_min_ps(a.hi, b.hi) }; }
+inline F8 vmax(F8 a, F8 b) { return { _mm_max_ps(a.lo, b.lo), _mm_max_ps(a.hi, b.hi) }; }
+inline F8 vsqrt(F8 a) { return { _mm_sqrt_ps(a.lo), _mm_sqrt_ps(a.hi) }; }
+inline M8 operator<(F8 a, F8 b) { return { _mm_cmplt_ps(a.lo, b.lo), _mm_cmplt_ps(a.hi, b.hi) }; }
+inline uint32_t bits(M8 m) { return uint32_t(_mm_movemask_ps(m.lo) | (_mm_movemask_ps(m.hi) << 4)); }
+inline M8 fromBits(uint32_t b)
+{
+    const __m128i lane = _mm_setr_epi32(1, 2, 4, 8);
+    __m128i lo = _mm_and_si128(_mm_set1_epi32(int(b)), lane);
+    __m128i hi = _mm_and_si128(_mm_set1_epi32(int(b >> 4)), lane);
+    return { _mm_castsi128_ps(_mm_cmpeq_epi32(lo, lane)), _mm_castsi128_ps(_mm_cmpeq_epi32(hi, lane)) };
+}
+inline M8 operator&(M8 a, M8 b) { return { _mm_and_ps(a.lo, b.lo), _mm_and_ps(a.hi, b.hi) }; }
+inline F8 select(M8 m, F8 a, F8 b)
+{
+    return { _mm_or_ps(_mm_and_ps(m.lo, a.lo), _mm_andnot_ps(m.lo, b.lo)),
+             _mm_or_ps(_mm_and_ps(m.hi, a.hi), _mm_andnot_ps(m.hi, b.hi)) };
+}
+#else
+struct F8 { float v[8]; };
+struct M8 { uint32_t b; };
+template<class Op> inline F8 map2(F8 a, F8 b, Op op) { F8 r; for (int i = 0; i < 8; ++i) r.v[i] = op(a.v[i], b.v[i]); return r; }
+inline F8 set1(float x) { F8 r; for (float& v : r.v) v = x; return r; }
+inline F8 load(const float* p) { F8 r; std::memcpy(r.v, p, sizeof r.v); return r; }
+inline void store(float* p, F8 a) { std::memcpy(p, a.v, sizeof a.v); }
+inline F8 operator+(F8 a, F8 b) { return map2(a, b, [](float x, float y) { return x + y; }); }
+inline F8 operator-(F8 a, F8 b) { return map2(a, b, [](float x, float y) { return x - y; }); }
+inline F8 operator*(F8 a, F8 b) { return map2(a, b, [](float x, float y) { return x * y; }); }
+inline F8 operator/(F8 a, F8 b) { return map2(a, b, [](float x, float y) { return x / y; }); }
+inline F8 vmin(F8 a, F8 b) { return map2(a, b, [](float x, float y) { return x < y ? x : y; }); }
+inline F8 vmax(F8 a, F8 b) { return map2(a, b, [](float x, float y) { return x > y ? x : y; }); }
+inline F8 vsqrt(F8 a) { for (float& v : a.v) v = std::sqrt(v); return a; }
+inline M8 operator<(F8 a, F8 b) { M8 m{ 0 }; for (int i = 0; i < 8; ++i) m.b |= uint32_t(a.v[i] < b.v[i]) << i; return m; }
+inline uint32_t bits(M8 m) { return m.b; }
+inline M8 fromBits(uint32_t b) { return { b }; }
+inline M8 operator&(M8 a, M8 b) { return { a.b & b.b }; }
+inline F8 select(M8 m, F8 a, F8 b) { for (int i = 0; i < 8; ++i) if (!((m.b >> i) & 1u)) a.v[i] = b.v[i]; return a; }
+#endif
+
+inline uint32_t popcount8(uint32_t m)
+{
+    uint32_t n = 0;
+    for (; m; m &= m - 1u) ++n;
+    return n;
+}
+
+/* ---------- shared maths (scalar + packet use the same expressions) ---- */
+inline float vmin(float a, float b) { return std::min(a, b); }
+inline float vmax(float a, float b) { return std::max(a, b); }
+inline float vsqrt(float a) { return std::sqrt(a); }
+inline float set1f(float x) { return x; }
+
+template<class T, class S>
+inline T sdAABB(T px, T py, T pz, const BvhNode& n, S s)
+{
+    T qx = vmax(s(n.mn.x) - px, px - s(n.mx.x));
+    T qy = vmax(s(n.mn.y) - py, py - s(n.mx.y));
+    T qz = vmax(s(n.mn.z) - pz, pz - s(n.mx.z));
+    T ox = vmax(qx, s(0.f)), oy = vmax(qy, s(0.f)), oz = vmax(qz, s(0.f));
+    return vsqrt(ox * ox + oy * oy + oz * oz) + vmin(vmax(qx, vmax(qy, qz)), s(0.f));
+}
+
+template<class T, class S>
+inline T sdCyl(T px, T py, T pz, const SdfScene& sc, uint32_t i, S s)
+{
+    const float abx = sc.bx[i] - sc.ax[i], aby = sc.by[i] - sc.ay[i], abz = sc.bz[i] - sc.az[i];
+    T pax = px - s(sc.ax[i]), pay = py - s(sc.ay[i]), paz = pz - s(sc.az[i]);
+    T t = (pax * s(abx) + pay * s(aby) + paz * s(abz)) / s(sc.ab2[i]);
+    t = vmin(vmax(t, s(0.f)), s(1.f));
+    T qx = px - (s(sc.ax[i]) + s(abx) * t);
+    T qy = py - (s(sc.ay[i]) + s(aby) * t);
+    T qz = pz - (s(sc.az[i]) + s(abz) * t);
+    return vsqrt(qx * qx + qy * qy + qz * qz) - s(sc.r[i]);
+}
+
+template<class T, class S>
+inline T smin(T a, T b, S s)
+{
+    T h = vmin(vmax(s(0.5f) + s(0.5f) * (b - a) / s(kBlend), s(0.f)), s(1.f));
+    return b + (a - b) * h - s(kBlend) * h * (s(1.f) - h);
+}
+
+/* ---------- packets ---------------------------------------------------- */
+struct Packet {
+    uint32_t node = 0;                 /* next node of the skip-link walk */
+    uint32_t count = 0;                /* live lanes (packed at 0..count) */
+    float px[8], py[8], pz[8], d[8];
+    uint32_t idx[8];
+
+    bool operator<(const Packet& o) const { return node > o.node; }   /* min-heap */
+};
+
+void moveLane(Packet& dst, const Packet& src, uint32_t l)
+{
+    const uint32_t k = dst.count++;
+    dst.px[k] = src.px[l]; dst.py[k] = src.py[l]; dst.pz[k] = src.pz[l];
+    dst.d[k] = src.d[l]; dst.idx[k] = src.idx[l];
+}
+
+/* split a packet when fewer lanes than kSplitLanes enter a subtree of at
+   least kSplitNodes nodes; smaller subtrees are cheaper to walk masked   */
+const uint32_t kSplitLanes = 2;
+const uint32_t kSplitNodes = 128;
+
+/* Walks until the end of the tree (lanes written to out) or until the
+   packet diverges (the two halves are pushed back on the heap).      */
+void runPacket(const SdfScene& sc, Packet& pk, float* out,
+    std::priority_queue<Packet>& heap, SdfBatchStats& st)
+{
+    const std::vector<BvhNode>& nodes = sc.bvh->nodes;
+    const uint32_t end = bvhIsLeaf(nodes[0]) ? 1u : nodes[0].lo;
+    const uint32_t live = (1u << pk.count) - 1u;
+
+    /* dead lanes: copies of lane 0, masked off */
+    for (uint32_t l = pk.count; l < 8; ++l) {
+        pk.px[l] = pk.px[0]; pk.py[l] = pk.py[0]; pk.pz[l] = pk.pz[0]; pk.d[l] = pk.d[0];
+    }
+    const F8 px = load(pk.px), py = load(pk.py), pz = load(pk.pz);
+    F8 d = load(pk.d);
+    ++st.packets;
+
+    uint32_t i = pk.node;
+    while (i < end) {
+        const BvhNode& n = nodes[i];
+        /* not beyond(): closer than kBlend past the lane's distance */
+        const uint32_t act = bits(sdAABB(px, py, pz, n, set1) < d + set1(kBlend)) & live;
+        ++st.nodeSteps;
+        st.activeLanes += popcount8(act);
+
+        if (bvhIsLeaf(n)) {
+            if (act) {
+                const M8 m = fromBits(act);
+                for (uint32_t k = 0; k < bvhLeafCount(n); ++k)
+                    d = select(m, smin(d, sdCyl(px, py, pz, sc, n.lo + k, set1), set1), d);
+            }
+            i += 1u + bvhLeafSkip(n);
+        }
+        else if (act == 0u) i = n.lo;
+        else if (act != live && popcount8(act) < kSplitLanes && n.lo - i >= kSplitNodes) {
+            /* survivors descend, the others resume past the subtree */
+            store(pk.d, d);
+            Packet in, past;
+            in.node = i + 1u; past.node = n.lo;
+            for (uint32_t l = 0; l < pk.count; ++l) moveLane((act >> l) & 1u ? in : past, pk, l);
+            heap.push(in); heap.push(past);
+            ++st.splits;
+            return;
+        }
+        else ++i;
+    }
+
+    store(pk.d, d);
+    for (uint32_t l = 0; l < pk.count; ++l) out[pk.idx[l]] = pk.d[l];
+}
+
+/* 10 bits per axis, interleaved */
+uint32_t morton3(uint32_t x, uint32_t y, uint32_t z)
+{
+    auto spread = [](uint32_t v) {
+        v = (v | (v << 16)) & 0x030000ffu;
+        v = (v | (v << 8)) & 0x0300f00fu;
+        v = (v | (v << 4)) & 0x030c30c3u;
+        v = (v | (v << 2)) & 0x09249249u;
+        return v;
+        };
+    return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+}
+
+} // namespace
+
+/* ---------- public entry ----------------------------------------------- */
+SdfScene makeSdfScene(const BuiltBVH& bvh, const std::vector<CPUBranch>& br)
+{
+    SdfScene s;
+    s.bvh = &bvh;
+
+    uint32_t entries = 0;
+    for (const BvhNode& n : bvh.nodes)
+        if (bvhIsLeaf(n)) entries = std::max(entries, n.lo + bvhLeafCount(n));
+
+    s.ax.resize(entries); s.ay.resize(entries); s.az.resize(entries);
+    s.bx.resize(entries); s.by.resize(entries); s.bz.resize(entries);
+    s.ab2.resize(entries); s.r.resize(entries);
+    for (uint32_t i = 0; i < entries; ++i) {
+        const CPUBranch b = leafBranch(bvh, br, i);
+        s.ax[i] = b.startX; s.ay[i] = b.startY; s.az[i] = b.startZ;
+        s.bx[i] = b.endX;   s.by[i] = b.endY;   s.bz[i] = b.endZ;
+        const glm::vec3 ab(b.endX - b.startX, b.endY - b.startY, b.endZ - b.startZ);
+        s.ab2[i] = std::max(glm::dot(ab, ab), kMinAb2);
+        s.r[i] = b.radius;
+    }
+    return s;
+}
+
+float sdfEval(const SdfScene& s, const glm::vec3& p)
+{
+    float d = 1e9f;
+    if (!s.bvh || s.bvh->nodes.empty()) return d;
+    walkStackless(*s.bvh,
+        [&](const BvhNode& n) { return !(sdAABB(p.x, p.y, p.z, n, set1f) < d + kBlend); },
+        [&](const BvhNode& n) {
+            for (uint32_t k = 0; k < bvhLeafCount(n); ++k)
+                d = smin(d, sdCyl(p.x, p.y, p.z, s, n.lo + k, set1f), set1f);
+        });
+    return d;
+}
+
+void sdfEvalBatch(const SdfScene& s, const glm::vec3* p, size_t n, float* out,
+    SdfBatchStats* stats)
+{
+    SdfBatchStats st;
+    if (!s.bvh || s.bvh->nodes.empty()) {
+        std::fill(out, out + n, 1e9f);
+        if (stats) *stats = st;
+        return;
+    }
+
+    /* Morton order over the query bounds: neighbours share a packet */
+    glm::vec3 mn(1e30f), mx(-1e30f);
+    for (size_t i = 0; i < n; ++i) { mn = glm::min(mn, p[i]); mx = glm::max(mx, p[i]); }
+    const glm::vec3 ext = glm::max(mx - mn, glm::vec3(1e-30f));
+    std::vector<std::pair<uint32_t, uint32_t>> keyed(n);
+    for (size_t i = 0; i < n; ++i) {
+        glm::vec3 q = (p[i] - mn) / ext * 1023.f;
+        keyed[i] = { morton3(uint32_t(q.x), uint32_t(q.y), uint32_t(q.z)), uint32_t(i) };
+    }
+    std::sort(keyed.begin(), keyed.end());
+
+    /* kChunk points at a time; within a chunk the lowest node runs first,
+       so split halves meet up again where they can                       */
+    const size_t kChunk = 64 * 8;
+    std::priority_queue<Packet> heap;
+    for (size_t chunk = 0; chunk < n; chunk += kChunk) {
+        for (size_t first = chunk; first < std::min(chunk + kChunk, n); first += 8) {
+            Packet pk;
+            for (size_t i = first; i < std::min(first + 8, n); ++i) {
+                const uint32_t k = pk.count++, src = keyed[i].second;
+                pk.px[k] = p[src].x; pk.py[k] = p[src].y; pk.pz[k] = p[src].z;
+                pk.d[k] = 1e9f; pk.idx[k] = src;
+            }
+            heap.push(pk);
+        }
+
+        while (!heap.empty()) {
+            Packet pk = heap.top(); heap.pop();
+            while (pk.count < 8 && !heap.empty() && heap.top().node == pk.node) {
+                Packet o = heap.top(); heap.pop();
+                uint32_t l = 0;
+                for (; l < o.count && pk.count < 8; ++l) moveLane(pk, o, l);
+                if (l < o.count) {                 /* leftovers wait again */
+                    Packet rest; rest.node = o.node;
+                    for (; l < o.count; ++l) moveLane(rest, o, l);
+                    heap.push(rest);
+                }
+                ++st.merges;
+            }
+            runPacket(s, pk, out, heap, st);
+        }
+    }
+    if (stats) *stats = st;
+}
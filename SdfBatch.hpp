@@ -0,0 +1,62 @@
+#pragma once
+#include "BVH.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* --------------------------------------------------------------------------
+   Batched scene SDF on the CPU - 8 query points per packet.
+
+   Same field as the shader's sceneSDF() for one fully grown plant
+   (sdCyl + smin, k = 0.005, a box culled once it is k or more beyond the
+   running distance, as beyond() does).
+   For mesh extraction, collision, camera framing and the like, where
+   thousands of points need a distance at once.
+
+   * capsules are copied to SoA arrays in leaf-entry order (a, b, |ab|^2, r)
+   * a packet walks the stackless skip-link order once for all 8 lanes;
+     each lane keeps its own distance and is masked off a subtree whose
+     box is beyond it
+   * a packet whose lanes diverge is split (survivors continue into the
+     subtree, the rest resume at its skip link) and small packets that
+     resume at the same node are merged again, so lanes stay busy and
+     every lane still sees exactly its own scalar walk
+
+   AVX2 when the compiler targets it, else SSE2, else plain loops.
+   --------------------------------------------------------------------------*/
+struct SdfScene {
+    const BuiltBVH* bvh = nullptr;
+    std::vector<float> ax, ay, az;     /* per leaf entry: capsule start    */
+    std::vector<float> bx, by, bz;     /*                  capsule end     */
+    std::vector<float> ab2;            /*                  |b - a|^2       */
+    std::vector<float> r;              /*                  radius          */
+};
+
+struct SdfBatchStats {
+    uint64_t packets = 0;          /* packet runs, after splits / merges  */
+    uint64_t splits = 0;
+    uint64_t merges = 0;
+    uint64_t nodeSteps = 0;        /* nodes visited by packets            */
+    uint64_t activeLanes = 0;      /* lanes not culled, summed over steps */
+
+    double laneUtilisation() const { return nodeSteps ? double(activeLanes) / (8.0 * nodeSteps) : 0.0; }
+};
+
+/* bvh must outlive the scene; br as for leafBranch() (the reordered array
+   when bvh was built in leaf order)                                      */
+SdfScene makeSdfScene(const BuiltBVH& bvh, const std::vector<CPUBranch>& br);
+
+/* one point - the scalar reference the packets reproduce */
+float sdfEval(const SdfScene& s, const glm::vec3& p);
+
+/* n points -> out[n]; points may come in any order */
+void sdfEvalBatch(const SdfScene& s, const glm::vec3* p, size_t n, float* out,
+    SdfBatchStats* stats = nullptr);
+
+inline std::vector<float> sdfEvalBatch(const SdfScene& s, const std::vector<glm::vec3>& p,
+    SdfBatchStats* stats = nullptr)
+{
+    std::vector<float> d(p.size());
+    sdfEvalBatch(s, p.data(), p.size(), d.data(), stats);
+    return d;
+}
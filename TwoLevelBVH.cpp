@@ -0,0 +1,109 @@
+/* --------------------------------------------------------------------------
+   TwoLevelBVH.cpp  -  shared per-species BLAS + instance TLAS
+   --------------------------------------------------------------------------*/
+#include "TwoLevelBVH.hpp"
+#include "WideBVH.hpp"
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+/* ---------- helpers ---------------------------------------------------- */
+static float bitsFloat(uint32_t u) { float f; std::memcpy(&f, &u, 4); return f; }
+
+/* columns of R (yaw about +Y) */
+static void yawBasis(float yaw, glm::vec3& ex, glm::vec3& ey, glm::vec3& ez)
+{
+    const float c = std::cos(yaw), s = std::sin(yaw);
+    ex = glm::vec3(c, 0.f, -s);
+    ey = glm::vec3(0.f, 1.f, 0.f);
+    ez = glm::vec3(s, 0.f, c);
+}
+
+/* ---------- public entry ----------------------------------------------- */
+TwoLevelBVH buildTwoLevel(const std::vector<std::vector<CPUBranch>>& species,
+    const std::vector<PlantInstance>& instances,
+    uint32_t blasWidth,
+    BvhBuildOptions opt)
+{
+    if (blasWidth != 2u && blasWidth != 4u && blasWidth != 8u)
+        throw std::runtime_error("buildTwoLevel: BLAS width must be 2, 4 or 8");
+
+    TwoLevelBVH out;
+    opt.leafOrder = true;
+
+    /* BLAS: build every species once --------------------------------- */
+    std::vector<std::vector<uint32_t>> blasWords(species.size());
+    for (size_t s = 0; s < species.size(); ++s) {
+        BuiltBVH b = buildBVH(species[s], opt);
+
+        const uint32_t base = uint32_t(out.branches.size());
+        const std::vector<CPUBranch> slots = reorderBranches(species[s], b.order, b.clip);
+        for (CPUBranch c : slots) {
+            if (c.parentIndex >= 0) c.parentIndex += int(base);
+            out.branches.push_back(c);
+        }
+        out.blasBranch.push_back(base);
+
+        const std::vector<BvhNodeAux> aux = bvhNodeAux(b, slots);
+        out.blasAux.push_back(uint32_t(out.nodeAux.size()));
+        if (blasWidth > 2u) {
+            WideBVH w = collapseBVH(b, blasWidth);
+            blasWords[s] = w.words;
+            for (uint32_t n : w.binNode) out.nodeAux.push_back(aux[n]);
+        }
+        else {
+            blasWords[s].resize(b.nodes.size() * (sizeof(BvhNode) / 4));
+            std::memcpy(blasWords[s].data(), b.nodes.data(), b.nodes.size() * sizeof(BvhNode));
+            out.nodeAux.insert(out.nodeAux.end(), aux.begin(), aux.end());
+        }
+        out.blas.push_back(std::move(b));
+    }
+
+    /* instance world boxes = transformed BLAS root box ------------------ */
+    std::vector<glm::vec3> imn(instances.size()), imx(instances.size());
+    for (size_t i = 0; i < instances.size(); ++i) {
+        const PlantInstance& in = instances[i];
+        if (in.species >= species.size())
+            throw std::runtime_error("buildTwoLevel: instance species out of range");
+
+        const BvhNode& root = out.blas[in.species].nodes[0];
+        glm::vec3 ex, ey, ez;
+        yawBasis(in.yaw, ex, ey, ez);
+        imn[i] = glm::vec3(FLT_MAX); imx[i] = glm::vec3(-FLT_MAX);
+        for (int c = 0; c < 8; ++c) {
+            glm::vec3 l((c & 1) ? root.mx.x : root.mn.x,
+                (c & 2) ? root.mx.y : root.mn.y,
+                (c & 4) ? root.mx.z : root.mn.z);
+            glm::vec3 w = in.position + (ex * l.x + ey * l.y + ez * l.z) * in.scale;
+            imn[i] = glm::min(imn[i], w);
+            imx[i] = glm::max(imx[i], w);
+        }
+    }
+    out.tlas = buildBoxBVH(imn, imx, 2u);
+
+    /* binding 2: TLAS first, then the BLASes ---------------------------- */
+    out.nodeWords.resize(out.tlas.nodes.size() * (sizeof(BvhNode) / 4));
+    std::memcpy(out.nodeWords.data(), out.tlas.nodes.data(), out.tlas.nodes.size() * sizeof(BvhNode));
+    for (const auto& w : blasWords) {
+        out.blasWord.push_back(uint32_t(out.nodeWords.size()));
+        out.nodeWords.insert(out.nodeWords.end(), w.begin(), w.end());
+    }
+
+    /* binding 3: instance records in TLAS leaf order --------------------- */
+    out.instanceData.reserve(out.tlas.order.size() * 4);
+    for (uint32_t slot : out.tlas.order) {
+        const PlantInstance& in = instances[slot];
+        glm::vec3 ex, ey, ez;
+        yawBasis(in.yaw, ex, ey, ez);
+        const float inv = 1.f / in.scale;
+        out.instanceData.push_back(glm::vec4(ex * inv, in.position.x));
+        out.instanceData.push_back(glm::vec4(ey * inv, in.position.y));
+        out.instanceData.push_back(glm::vec4(ez * inv, in.position.z));
+        out.instanceData.push_back(glm::vec4(in.scale,
+            bitsFloat(out.blasWord[in.species]),
+            bitsFloat(out.blasBranch[in.species]),
+            bitsFloat(out.blasAux[in.species])));
+    }
+    return out;
+}
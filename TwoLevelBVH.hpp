@@ -0,0 +1,57 @@
+#pragma once
+#include "BVH.hpp"
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+/* --------------------------------------------------------------------------
+   Two-level BVH for forests.
+
+   * BLAS : one BuiltBVH per species, built once in leaf order and shared
+            by every instance of that species.
+   * TLAS : binary BvhNode tree over the instances' world boxes, leaves
+            address a run of instance records.
+
+   GPU layout (one buffer per existing binding, plus instances):
+     binding 1  branches of every species back to back, each run in its
+                BLAS leaf order (parentIndex stays inside the run)
+     binding 2  TLAS nodes (binary, word 0), then each BLAS (binary or
+                collapsed WideBVH words) at its own word offset
+     binding 3  4 x vec4 per instance, TLAS leaf order:
+                  v0..v2 = ( row i of R^T / scale , translation[i] )
+                  v3     = ( scale, BLAS word offset, branch offset,
+                             BLAS node offset into binding 4 )
+     binding 4  BvhNodeAux of each BLAS, back to back (LOD proxies)
+                (offsets are uint bits)  ->  p_local = rows . (p - t)
+
+   Instances are rigid motions with uniform scale, so a local distance
+   times scale is still a true world distance.
+   --------------------------------------------------------------------------*/
+struct PlantInstance {
+    glm::vec3 position{ 0.f };
+    float     yaw = 0.f;             /* radians about +Y                 */
+    float     scale = 1.f;
+    uint32_t  species = 0;           /* index into the species list      */
+};
+
+struct TwoLevelBVH {
+    BuiltBVH tlas;                             /* order: slot -> instance */
+    std::vector<BuiltBVH> blas;                /* per species, leaf order */
+    std::vector<uint32_t> blasWord;            /* word offset per species */
+    std::vector<uint32_t> blasBranch;          /* branch offset per species */
+    std::vector<uint32_t> blasAux;             /* node offset per species */
+
+    std::vector<CPUBranch> branches;           /* binding 1 */
+    std::vector<uint32_t>  nodeWords;          /* binding 2 */
+    std::vector<glm::vec4> instanceData;       /* binding 3 */
+    std::vector<BvhNodeAux> nodeAux;           /* binding 4 */
+
+    uint32_t instanceCount() const { return uint32_t(instanceData.size() / 4); }
+};
+
+/* blasWidth 2 keeps binary BLAS nodes, 4/8 collapses them (WideBVH);
+   it must match the shader's kBvhWidth.  opt.leafOrder is forced on.  */
+TwoLevelBVH buildTwoLevel(const std::vector<std::vector<CPUBranch>>& species,
+    const std::vector<PlantInstance>& instances,
+    uint32_t blasWidth = 2,
+    BvhBuildOptions opt = {});
@@ -5,12 +5,14 @@
 // ????????????????????????????????????????????????????????????????????????
 #include "VulkanBackend.hpp"
 #include "FileUtils.hpp"
+#include "WideBVH.hpp"
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
 #include <algorithm>
 #include <array>
+#include <cstddef>
 #include <cstring>
 #include <set>
 #include <stdexcept>
@@ -57,6 +59,7 @@ void VulkanRaymarchApp::initVulkan()
     createSwapChainImageViews();
     createCommandPool();
     createComputeResources();
+    createStagingRing();
     createDescriptorSetLayout();
     createComputePipeline();
     createDescriptorPoolAndSets();
@@ -343,27 +346,163 @@ void VulkanRaymarchApp::createComputeResources()
     createStorageImage();
 }
 
+// The shaders read the branch / node / instance / aux SSBOs in their
+// innermost loops, so those go to device-local memory through a staging
+// ring.  An integrated GPU shares memory with the host: if it has a
+// device-local, host-visible type the SSBOs use that and skip the copy.
+void VulkanRaymarchApp::createStagingRing()
+{
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &props);
+    VkPhysicalDeviceMemoryProperties mp;
+    vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &mp);
+
+    const VkMemoryPropertyFlags shared = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    m_uma = false;
+    if (props.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ||
+        props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU)
+        for (uint32_t i = 0; i < mp.memoryTypeCount; ++i)
+            if ((mp.memoryTypes[i].propertyFlags & shared) == shared) m_uma = true;
+
+    VkFenceCreateInfo fi{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+    fi.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    if (vkCreateFence(m_device, &fi, nullptr, &m_uploadFence) != VK_SUCCESS)
+        throw std::runtime_error("Upload fence creation failed");
+
+    // the ring exists on UMA devices too: growth replay patches the live
+    // node buffer through it instead of writing under frames in flight
+
+    VkBufferCreateInfo bc{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bc.size = m_stagingBytes;
+    bc.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bc.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateBuffer(m_device, &bc, nullptr, &m_stagingBuf) != VK_SUCCESS)
+        throw std::runtime_error("Staging buffer creation failed");
+
+    VkMemoryRequirements req;
+    vkGetBufferMemoryRequirements(m_device, m_stagingBuf, &req);
+
+    const VkMemoryPropertyFlags want =
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    uint32_t memIdx = UINT32_MAX;
+    for (uint32_t i = 0; i < mp.memoryTypeCount; ++i)
+    {
+        if ((req.memoryTypeBits & (1u << i)) &&
+            (mp.memoryTypes[i].propertyFlags & want) == want)
+        {
+            memIdx = i;
+            break;
+        }
+    }
+    if (memIdx == UINT32_MAX)
+        throw std::runtime_error("Suitable memory type for staging ring not found");
+
+    VkMemoryAllocateInfo ai{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+    ai.allocationSize = req.size;
+    ai.memoryTypeIndex = memIdx;
+    if (vkAllocateMemory(m_device, &ai, nullptr, &m_stagingMem) != VK_SUCCESS)
+        throw std::runtime_error("Staging memory alloc failed");
+    vkBindBufferMemory(m_device, m_stagingBuf, m_stagingMem, 0);
+
+    void* ptr = nullptr;
+    vkMapMemory(m_device, m_stagingMem, 0, m_stagingBytes, 0, &ptr);
+    m_stagingPtr = static_cast<uint8_t*>(ptr);
+
+    VkCommandBufferAllocateInfo cai{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+    cai.commandPool = m_cmdPool; cai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY; cai.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(m_device, &cai, &m_uploadCmd) != VK_SUCCESS)
+        throw std::runtime_error("Upload command buffer allocation failed");
+}
+
 void VulkanRaymarchApp::createStorageImage()
 {
-    VkImageCreateInfo ci{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
-    ci.imageType = VK_IMAGE_TYPE_2D;
-    ci.format = VK_FORMAT_R8G8B8A8_UNORM;
-    ci.extent = { m_swapChainExtent.width,
-                       m_swapChainExtent.height,
-                       1 };
-    ci.mipLevels = 1;
-    ci.arrayLayers = 1;
-    ci.samples = VK_SAMPLE_COUNT_1_BIT;
-    ci.tiling = VK_IMAGE_TILING_OPTIMAL;
-    ci.usage = VK_IMAGE_USAGE_STORAGE_BIT |
-        VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-    ci.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-
-    if (vkCreateImage(m_device, &ci, nullptr, &m_storageImage) != VK_SUCCESS)
-        throw std::runtime_error("Storage image creation failed");
+    auto make = [&](VkFormat fmt, VkImageUsageFlags usage, uint32_t div,
+        VkImage& img, VkDeviceMemory& mem, VkImageView& view)
+        {
+            VkImageCreateInfo ci{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+            ci.imageType = VK_IMAGE_TYPE_2D;
+            ci.format = fmt;
+            ci.extent = { (m_swapChainExtent.width + div - 1) / div,
+                               (m_swapChainExtent.height + div - 1) / div,
+                               1 };
+            ci.mipLevels = 1;
+            ci.arrayLayers = 1;
+            ci.samples = VK_SAMPLE_COUNT_1_BIT;
+            ci.tiling = VK_IMAGE_TILING_OPTIMAL;
+            ci.usage = usage;
+            ci.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            if (vkCreateImage(m_device, &ci, nullptr, &img) != VK_SUCCESS)
+                throw std::runtime_error("Storage image creation failed");
+
+            VkMemoryRequirements req;
+            vkGetImageMemoryRequirements(m_device, img, &req);
+
+            VkPhysicalDeviceMemoryProperties mp;
+            vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &mp);
+
+            uint32_t memIdx = UINT32_MAX;
+            for (uint32_t i = 0; i < mp.memoryTypeCount; ++i)
+            {
+                if ((req.memoryTypeBits & (1u << i)) &&
+                    (mp.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+                {
+                    memIdx = i;
+                    break;
+                }
+            }
+            if (memIdx == UINT32_MAX)
+                throw std::runtime_error("Suitable memory type for storage image not found");
+
+            VkMemoryAllocateInfo ai{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+            ai.allocationSize = req.size;
+            ai.memoryTypeIndex = memIdx;
+
+            if (vkAllocateMemory(m_device, &ai, nullptr, &mem) != VK_SUCCESS)
+                throw std::runtime_error("Storage image memory alloc failed");
+
+            vkBindImageMemory(m_device, img, mem, 0);
+
+            VkImageViewCreateInfo vi{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+            vi.image = img;
+            vi.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            vi.format = fmt;
+            vi.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            vi.subresourceRange.levelCount = vi.subresourceRange.layerCount = 1;
+
+            if (vkCreateImageView(m_device, &vi, nullptr, &view) != VK_SUCCESS)
+                throw std::runtime_error("Storage image-view creation failed");
+        };
+
+    // colour target, copied to the swap-chain by recordCommandBuffer
+    make(VK_FORMAT_R8G8B8A8_UNORM,
+        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, 1,
+        m_storageImage, m_storageMem, m_storageView);
+
+    // visibility buffer: march pass -> shade pass (t, hit id, instance|steps, tests)
+    make(VK_FORMAT_R32G32B32A32_UINT, VK_IMAGE_USAGE_STORAGE_BIT, 1,
+        m_visImage, m_visMem, m_visView);
+
+    // cone prepass: safe start depth per kConeTile x kConeTile pixels
+    make(VK_FORMAT_R32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT, kConeTile,
+        m_coneImage, m_coneMem, m_coneView);
+
+    // tile list: VkDispatchIndirectCommand + pad, then one word per tile
+    const uint32_t tiles = ((m_swapChainExtent.width + kConeTile - 1) / kConeTile) *
+        ((m_swapChainExtent.height + kConeTile - 1) / kConeTile);
+
+    VkBufferCreateInfo bc{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bc.size = 16 + 4 * VkDeviceSize(tiles);
+    bc.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bc.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(m_device, &bc, nullptr, &m_tileBuf) != VK_SUCCESS)
+        throw std::runtime_error("Tile-list buffer creation failed");
 
     VkMemoryRequirements req;
-    vkGetImageMemoryRequirements(m_device, m_storageImage, &req);
+    vkGetBufferMemoryRequirements(m_device, m_tileBuf, &req);
 
     VkPhysicalDeviceMemoryProperties mp;
     vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &mp);
@@ -379,26 +518,16 @@ void VulkanRaymarchApp::createStorageImage()
         }
     }
     if (memIdx == UINT32_MAX)
-        throw std::runtime_error("Suitable memory type for storage image not found");
+        throw std::runtime_error("Suitable memory type for tile list not found");
 
     VkMemoryAllocateInfo ai{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
     ai.allocationSize = req.size;
     ai.memoryTypeIndex = memIdx;
 
-    if (vkAllocateMemory(m_device, &ai, nullptr, &m_storageMem) != VK_SUCCESS)
-        throw std::runtime_error("Storage image memory alloc failed");
-
-    vkBindImageMemory(m_device, m_storageImage, m_storageMem, 0);
+    if (vkAllocateMemory(m_device, &ai, nullptr, &m_tileMem) != VK_SUCCESS)
+        throw std::runtime_error("Tile-list memory alloc failed");
 
-    VkImageViewCreateInfo vi{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
-    vi.image = m_storageImage;
-    vi.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    vi.format = VK_FORMAT_R8G8B8A8_UNORM;
-    vi.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    vi.subresourceRange.levelCount = vi.subresourceRange.layerCount = 1;
-
-    if (vkCreateImageView(m_device, &vi, nullptr, &m_storageView) != VK_SUCCESS)
-        throw std::runtime_error("Storage image-view creation failed");
+    vkBindBufferMemory(m_device, m_tileBuf, m_tileMem, 0);
 }
 
 // ????????????????????????????????????????????????????????????????????????
@@ -406,7 +535,7 @@ void VulkanRaymarchApp::createStorageImage()
 // ????????????????????????????????????????????????????????????????????????
 void VulkanRaymarchApp::createDescriptorSetLayout()
 {
-    VkDescriptorSetLayoutBinding b0{}, b1{}, b2{}, b3{};
+    VkDescriptorSetLayoutBinding b0{}, b1{}, b2{}, b3{}, b4{}, b5{}, b6{}, b7{};
 
     // binding 0  storage image
     b0.binding = 0;
@@ -419,13 +548,25 @@ void VulkanRaymarchApp::createDescriptorSetLayout()
     b1.binding = 1;
     b1.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 
-    // binding 2  BVH nodes
+    // binding 2  BVH nodes (leaves index the leaf-ordered branch SSBO)
     b2 = b1; b2.binding = 2;
 
-    // binding 3  BVH leaf-indices
+    // binding 3 - forest instance records (TwoLevelBVH)
     b3 = b1; b3.binding = 3;
 
-    std::array<VkDescriptorSetLayoutBinding, 4> bindings{ b0,b1,b2,b3 };
+    // binding 4 - per BVH node: LOD proxy capsule + earliest birth
+    b4 = b1; b4.binding = 4;
+
+    // binding 5 - visibility buffer (march pass writes, shade pass reads)
+    b5 = b0; b5.binding = 5;
+
+    // binding 6 - cone prepass depths (cone pass writes, march pass reads)
+    b6 = b0; b6.binding = 6;
+
+    // binding 7 - occupied-tile list + the march pass's indirect dispatch
+    b7 = b1; b7.binding = 7;
+
+    std::array<VkDescriptorSetLayoutBinding, 8> bindings{ b0,b1,b2,b3,b4,b5,b6,b7 };
 
     VkDescriptorSetLayoutCreateInfo ci{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
     ci.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -437,16 +578,6 @@ void VulkanRaymarchApp::createDescriptorSetLayout()
 
 void VulkanRaymarchApp::createComputePipeline()
 {
-    auto bin = readFile("shaders/raymarch_comp.spv");
-
-    VkShaderModuleCreateInfo smci{ VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
-    smci.codeSize = bin.size();
-    smci.pCode = reinterpret_cast<const uint32_t*>(bin.data());
-
-    VkShaderModule shader;
-    if (vkCreateShaderModule(m_device, &smci, nullptr, &shader) != VK_SUCCESS)
-        throw std::runtime_error("Compute shader module creation failed");
-
     VkPushConstantRange pc{};
     pc.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
     pc.offset = 0;
@@ -461,19 +592,106 @@ void VulkanRaymarchApp::createComputePipeline()
     if (vkCreatePipelineLayout(m_device, &plci, nullptr, &m_pipeLayout) != VK_SUCCESS)
         throw std::runtime_error("Pipeline-layout creation failed");
 
-    VkPipelineShaderStageCreateInfo stage{ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
-    stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-    stage.module = shader;
-    stage.pName = "main";
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &props);
+    m_nodeCacheDepth = nodeCacheDepth(m_bvhWidth, m_stackless,
+        std::min(m_nodeCacheBytes, props.limits.maxComputeSharedMemorySize));
+
+    // the variants the first frame binds; the rest come on first use
+    pipelineVariant(kConePass);
+    pipelineVariant(kMarchPass);
+    pipelineVariant(kShadePass);
+}
+
+// cone, march + shade pass share the layout, the push block and the set;
+// each is specialised into per-frame variants, cached by key:
+//   bits 0-1 pass, 2-3 quality tier, 4 blend, 5-6 vis mode, 7 skeleton,
+//   8-10 workgroup shape, 11 binary growth replay
+// with the bits a pass never reads left 0, so e.g. a vis-mode switch
+// rebuilds only the shade pass.
+VkPipeline VulkanRaymarchApp::pipelineVariant(Pass pass)
+{
+    const bool marches = pass != kShadePass;
+    // growth replay patches DynamicBVH's binary nodes in place; a wide
+    // build walks them over skip links until the plant is grown
+    const bool replay = m_growing && m_bvhWidth > 2;
+    uint32_t key = uint32_t(pass) | (m_blend ? 1u << 4 : 0u) | (replay ? 1u << 11 : 0u);
+    if (marches) key |= m_quality << 2;
+    else         key |= m_visMode << 5 | (m_skeleton ? 1u << 7 : 0u);
+    const uint32_t shape = pass == kConePass ? m_coneShape : pass == kShadePass ? m_shadeShape : 0u;
+    key |= shape << 8;
+
+    auto it = m_pipelines.find(key);
+    if (it != m_pipelines.end()) return it->second;
+
+    // constant_id 0 : BVH width the shader decodes (must match uploadBVH)
+    // constant_id 1 : binary tree walked over skip links instead of a stack
+    // constant_id 2 : march pass - 0 sceneSDF, 1 BVH leaf spans, 2 analytic capsules
+    // constant_id 3 : branch record format (must match createBranchBuffer)
+    // constant_id 4 : BVH levels the cone + march pass keep in shared memory
+    // constant_id 5 : smooth-min width, 0 = plain min
+    // constant_id 6 : march steps       } quality tier
+    // constant_id 7 : hit distance      }
+    // constant_id 8 : shade vis mode - 0 shading, 1 BFS depth, 2 tests
+    // constant_id 9 : skeleton overlay
+    // constant_id 10, 11 : local_size_x / _y (cone + shade pass)
+    const QualityTier& q = kQualityTiers[marches ? m_quality : 1];
+    struct { uint32_t bvhWidth; VkBool32 stackless; uint32_t marchMode; uint32_t branchFormat;
+             uint32_t cacheDepth; float blend; int32_t steps; float eps; uint32_t visMode;
+             VkBool32 skeleton; uint32_t localX; uint32_t localY; } specData{
+        replay ? 2u : m_bvhWidth, replay || m_stackless ? VK_TRUE : VK_FALSE, m_marchMode, m_branchFormat,
+        marches && !replay ? m_nodeCacheDepth : 0u, // the skeleton query reads nodes uncached
+        m_blend ? 0.005f : 0.f, int32_t(q.steps), q.eps,
+        marches ? 0u : m_visMode, !marches && m_skeleton ? VK_TRUE : VK_FALSE,
+        kWorkgroupShapes[shape].x, kWorkgroupShapes[shape].y };
+    VkSpecializationMapEntry spec[12] = {
+        { 0, offsetof(decltype(specData), bvhWidth),  sizeof(uint32_t) },
+        { 1, offsetof(decltype(specData), stackless), sizeof(VkBool32) },
+        { 2, offsetof(decltype(specData), marchMode), sizeof(uint32_t) },
+        { 3, offsetof(decltype(specData), branchFormat), sizeof(uint32_t) },
+        { 4, offsetof(decltype(specData), cacheDepth), sizeof(uint32_t) },
+        { 5, offsetof(decltype(specData), blend),     sizeof(float) },
+        { 6, offsetof(decltype(specData), steps),     sizeof(int32_t) },
+        { 7, offsetof(decltype(specData), eps),       sizeof(float) },
+        { 8, offsetof(decltype(specData), visMode),   sizeof(uint32_t) },
+        { 9, offsetof(decltype(specData), skeleton),  sizeof(VkBool32) },
+        { 10, offsetof(decltype(specData), localX),   sizeof(uint32_t) },
+        { 11, offsetof(decltype(specData), localY),   sizeof(uint32_t) } };
+    VkSpecializationInfo si{ 12, spec, sizeof(specData), &specData };
+
+    static const char* const kPaths[3] = {
+        "shaders/cone_comp.spv", "shaders/raymarch_comp.spv", "shaders/shade_comp.spv" };
+    VkPipeline made = VK_NULL_HANDLE;
+    auto build = [&](const char* path, VkPipeline& pipe)
+        {
+            auto bin = readFile(path);
+
+            VkShaderModuleCreateInfo smci{ VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
+            smci.codeSize = bin.size();
+            smci.pCode = reinterpret_cast<const uint32_t*>(bin.data());
+
+            VkShaderModule shader;
+            if (vkCreateShaderModule(m_device, &smci, nullptr, &shader) != VK_SUCCESS)
+                throw std::runtime_error("Compute shader module creation failed");
+
+            VkPipelineShaderStageCreateInfo stage{ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
+            stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+            stage.module = shader;
+            stage.pName = "main";
+            stage.pSpecializationInfo = &si;
+
+            VkComputePipelineCreateInfo pci{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+            pci.stage = stage;
+            pci.layout = m_pipeLayout;
 
-    VkComputePipelineCreateInfo pci{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
-    pci.stage = stage;
-    pci.layout = m_pipeLayout;
+            if (vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pci, nullptr, &pipe) != VK_SUCCESS)
+                throw std::runtime_error("Compute pipeline creation failed");
 
-    if (vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pci, nullptr, &m_pipeline) != VK_SUCCESS)
-        throw std::runtime_error("Compute pipeline creation failed");
+            vkDestroyShaderModule(m_device, shader, nullptr);
+        };
 
-    vkDestroyShaderModule(m_device, shader, nullptr);
+    build(kPaths[pass], made);
+    return m_pipelines[key] = made;
 }
 
 // ????????????????????????????????????????????????????????????????????????
@@ -484,18 +702,20 @@ void VulkanRaymarchApp::createDescriptorPoolAndSets()
     uint32_t swapImages = static_cast<uint32_t>(m_swapChainImages.size());
     if (swapImages == 0) throw std::runtime_error("Swap-chain not initialised");
 
-    VkDescriptorPoolSize sizes[4]{};
-    sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;   // binding 0
-    sizes[0].descriptorCount = swapImages;
+    VkDescriptorPoolSize sizes[6]{};
+    sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;   // bindings 0, 5, 6
+    sizes[0].descriptorCount = 3 * swapImages;
 
     sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;  // binding 1
     sizes[1].descriptorCount = swapImages;  // branches
 
     sizes[2] = sizes[1];                   // binding 2  BVH nodes
-    sizes[3] = sizes[1];                   // binding 3  BVH leaves
+    sizes[3] = sizes[1];                   // binding 3 - forest instances
+    sizes[4] = sizes[1];                   // binding 4 - node aux (proxy, birth)
+    sizes[5] = sizes[1];                   // binding 7 - tile list
 
     VkDescriptorPoolCreateInfo pci{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
-    pci.poolSizeCount = 4;
+    pci.poolSizeCount = 6;
     pci.pPoolSizes = sizes;
     pci.maxSets = swapImages;
 
@@ -514,22 +734,41 @@ void VulkanRaymarchApp::createDescriptorPoolAndSets()
     if (vkAllocateDescriptorSets(m_device, &ai, m_descSets.data()) != VK_SUCCESS)
         throw std::runtime_error("Descriptor-set allocation failed");
 
-    // write binding 0 (storage image)  buffers are patched later
+    // write bindings 0, 5, 6 (storage images) and 7 (tile list)  buffers are patched later
     for (uint32_t i = 0; i < swapImages; ++i)
     {
-        VkDescriptorImageInfo ii{};
-        ii.imageView = m_storageView;
-        ii.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-
-        VkWriteDescriptorSet w{};
-        w.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        w.dstSet = m_descSets[i];
-        w.dstBinding = 0;                                  // binding 0
-        w.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-        w.descriptorCount = 1;
-        w.pImageInfo = &ii;
-
-        vkUpdateDescriptorSets(m_device, 1, &w, 0, nullptr);
+        VkDescriptorImageInfo ii[3]{};
+        ii[0].imageView = m_storageView;
+        ii[0].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        ii[1].imageView = m_visView;
+        ii[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        ii[2].imageView = m_coneView;
+        ii[2].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkWriteDescriptorSet w[4]{};
+        w[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        w[0].dstSet = m_descSets[i];
+        w[0].dstBinding = 0;                               // binding 0
+        w[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        w[0].descriptorCount = 1;
+        w[0].pImageInfo = &ii[0];
+
+        w[1] = w[0];
+        w[1].dstBinding = 5;                               // binding 5
+        w[1].pImageInfo = &ii[1];
+
+        w[2] = w[0];
+        w[2].dstBinding = 6;                               // binding 6
+        w[2].pImageInfo = &ii[2];
+
+        VkDescriptorBufferInfo bi{ m_tileBuf, 0, VK_WHOLE_SIZE };
+        w[3] = w[0];
+        w[3].dstBinding = 7;                               // binding 7
+        w[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        w[3].pImageInfo = nullptr;
+        w[3].pBufferInfo = &bi;
+
+        vkUpdateDescriptorSets(m_device, 4, w, 0, nullptr);
     }
 }
 
@@ -601,11 +840,22 @@ void VulkanRaymarchApp::recreateSwapChain()
     vkDestroyImage(m_device, m_storageImage, nullptr);
     vkDestroyImageView(m_device, m_storageView, nullptr);
     vkFreeMemory(m_device, m_storageMem, nullptr);
+    vkDestroyImage(m_device, m_visImage, nullptr);
+    vkDestroyImageView(m_device, m_visView, nullptr);
+    vkFreeMemory(m_device, m_visMem, nullptr);
+    vkDestroyImage(m_device, m_coneImage, nullptr);
+    vkDestroyImageView(m_device, m_coneView, nullptr);
+    vkFreeMemory(m_device, m_coneMem, nullptr);
+    vkDestroyBuffer(m_device, m_tileBuf, nullptr);
+    vkFreeMemory(m_device, m_tileMem, nullptr);
     createStorageImage();
 
     vkDestroyDescriptorPool(m_device, m_descPool, nullptr);
     createDescriptorPoolAndSets();
     updateDescriptorSetsWithBranchBuffer();
+    bindStorageBuffer(2, m_bvhNodeBuf);
+    bindStorageBuffer(3, m_instanceBuf);
+    bindStorageBuffer(4, m_nodeAuxBuf);
 
     vkFreeCommandBuffers(
         m_device, m_cmdPool,
@@ -0,0 +1,224 @@
+/* --------------------------------------------------------------------------
+   WideBVH.cpp  -  collapse a binary BuiltBVH into a quantised 4/8-wide BVH
+
+   Collapse: starting from a binary node, keep opening the internal child
+   with the largest surface area until W slots are used (or only leaves
+   remain).  Binary leaves become leaf refs as-is, so leafIdx is shared.
+   --------------------------------------------------------------------------*/
+#include "WideBVH.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WIDEBVH_SSE 1
+#endif
+
+/* ---------- helpers ---------------------------------------------------- */
+static bool isLeaf(const BvhNode& n) { return bvhIsLeaf(n); }
+
+static float boxArea(const BvhNode& n)
+{
+    glm::vec3 e = glm::max(n.mx - n.mn, glm::vec3(0.f));
+    return 2.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+static uint32_t floatBits(float f) { uint32_t u; std::memcpy(&u, &f, 4); return u; }
+static float    bitsFloat(uint32_t u) { float f; std::memcpy(&f, &u, 4); return f; }
+
+/* smallest e with 254 * 2^e >= extent (one code of head-room for rounding) */
+static int pickExponent(float extent)
+{
+    if (!(extent > 0.f)) return -100;
+    int e; std::frexp(extent / 254.f, &e);
+    return std::clamp(e, -100, 100);
+}
+
+static void setByte(uint32_t* row, uint32_t c, uint32_t v)
+{
+    row[c >> 2] = (row[c >> 2] & ~(0xffu << ((c & 3u) * 8u))) | (v << ((c & 3u) * 8u));
+}
+
+#ifndef WIDEBVH_SSE
+static uint32_t getByte(const uint32_t* row, uint32_t c)
+{
+    return (row[c >> 2] >> ((c & 3u) * 8u)) & 0xffu;
+}
+#endif
+
+/* ---------- recursive collapse ----------------------------------------- */
+static uint32_t emitNode(WideBVH& out, const BuiltBVH& bin, uint32_t binNode)
+{
+    const uint32_t W = out.width;
+    const uint32_t NW = WideBVH::NodeWords(W);
+    const BvhNode& self = bin.nodes[binNode];
+
+    std::vector<uint32_t> kids;
+    if (isLeaf(self)) kids.push_back(binNode);    /* tiny tree: root is a leaf */
+    else { kids.push_back(binNode + 1); kids.push_back(self.hi); }
+
+    while (kids.size() < W) {
+        int best = -1; float bestA = -1.f;
+        for (size_t k = 0; k < kids.size(); ++k) {
+            const BvhNode& n = bin.nodes[kids[k]];
+            if (!isLeaf(n) && boxArea(n) > bestA) { bestA = boxArea(n); best = int(k); }
+        }
+        if (best < 0) break;
+        const BvhNode& n = bin.nodes[kids[best]];
+        kids.push_back(n.hi);
+        kids[best] += 1;                           /* left child = i + 1 */
+    }
+
+    const uint32_t me = uint32_t(out.words.size() / NW);
+    const size_t   base = out.words.size();
+    out.words.resize(base + NW, 0u);
+    out.binNode.push_back(binNode);
+
+    /* header: origin + per-axis exponent -------------------------------- */
+    glm::vec3 org = self.mn, ext = self.mx - self.mn;
+    int   ex[3];
+    float scale[3];
+    for (int a = 0; a < 3; ++a) {
+        ex[a] = pickExponent(ext[a]);
+        scale[a] = std::ldexp(1.f, ex[a]);
+        out.words[base + a] = floatBits(org[a]);
+    }
+    out.words[base + 3] = (uint32_t(ex[0]) & 0xffu) | ((uint32_t(ex[1]) & 0xffu) << 8) |
+        ((uint32_t(ex[2]) & 0xffu) << 16) | (uint32_t(kids.size()) << 24);
+
+    /* quantised planes (empty slots: lo = 255, hi = 0) ------------------- */
+    const uint32_t rowWords = W / 4u;
+    for (uint32_t c = 0; c < W; ++c)
+        for (int a = 0; a < 3; ++a) {
+            uint32_t* lo = &out.words[base + 4 + W + (2 * a) * rowWords];
+            uint32_t* hi = &out.words[base + 4 + W + (2 * a + 1) * rowWords];
+            if (c >= kids.size()) { setByte(lo, c, 255u); setByte(hi, c, 0u); continue; }
+
+            const BvhNode& k = bin.nodes[kids[c]];
+            int ql = std::clamp(int(std::floor((k.mn[a] - org[a]) / scale[a])), 0, 255);
+            int qh = std::clamp(int(std::ceil((k.mx[a] - org[a]) / scale[a])), 0, 255);
+            while (ql > 0 && org[a] + float(ql) * scale[a] > k.mn[a]) --ql;
+            while (qh < 255 && org[a] + float(qh) * scale[a] < k.mx[a]) ++qh;
+            setByte(lo, c, uint32_t(ql));
+            setByte(hi, c, uint32_t(qh));
+        }
+
+    /* child refs - recursion appends, so index by base, never hold ptrs */
+    for (uint32_t c = 0; c < W; ++c) {
+        uint32_t ref = 0x80000000u;                /* empty = leaf of 0 */
+        if (c < kids.size()) {
+            const BvhNode& k = bin.nodes[kids[c]];
+            if (isLeaf(k)) {
+                uint32_t cnt = bvhLeafCount(k);
+                if (cnt > 0x7fu || k.lo > 0x00ffffffu)
+                    throw std::runtime_error("collapseBVH: leaf does not fit a wide ref");
+                ref = 0x80000000u | (cnt << 24) | k.lo;
+            }
+            else {
+                ref = emitNode(out, bin, kids[c]);
+            }
+        }
+        out.words[base + 4 + c] = ref;
+    }
+    return me;
+}
+
+/* ---------- public entry ----------------------------------------------- */
+WideBVH collapseBVH(const BuiltBVH& bin, uint32_t width)
+{
+    if (width != 4u && width != 8u)
+        throw std::runtime_error("collapseBVH: width must be 4 or 8");
+
+    WideBVH out;
+    out.width = width;
+    out.leafIdx = bin.leafIdx;
+    out.clip = bin.clip;
+    if (bin.nodes.empty()) return out;
+
+    out.words.reserve(bin.nodes.size() * WideBVH::NodeWords(width));
+    emitNode(out, bin, 0u);
+    return out;
+}
+
+/* ---------- child box distances ---------------------------------------- */
+#ifdef WIDEBVH_SSE
+static inline __m128 bytes4(uint32_t w)
+{
+    const __m128i z = _mm_setzero_si128();
+    __m128i v = _mm_cvtsi32_si128(int(w));
+    v = _mm_unpacklo_epi8(v, z);
+    v = _mm_unpacklo_epi16(v, z);
+    return _mm_cvtepi32_ps(v);
+}
+#endif
+
+uint32_t wideChildDistances(const WideBVH& w, uint32_t node,
+    const glm::vec3& p, float* outDist)
+{
+    const uint32_t W = w.width;
+    const uint32_t* n = &w.words[size_t(node) * WideBVH::NodeWords(W)];
+    const uint32_t hdr = n[3];
+    const uint32_t count = hdr >> 24;
+    const uint32_t rowWords = W / 4u;
+    const uint32_t* q = n + 4 + W;
+
+    float org[3], scale[3];
+    for (int a = 0; a < 3; ++a) {
+        org[a] = bitsFloat(n[a]);
+        scale[a] = std::ldexp(1.f, int(int8_t((hdr >> (8 * a)) & 0xffu)));
+    }
+
+#ifdef WIDEBVH_SSE
+    /* four children per pass: one 32-bit row word holds their 4 planes */
+    for (uint32_t g = 0; g < rowWords; ++g) {
+        __m128 outside = _mm_setzero_ps();
+        __m128 inside = _mm_set1_ps(-FLT_MAX);
+        for (int a = 0; a < 3; ++a) {
+            __m128 o = _mm_set1_ps(org[a]), s = _mm_set1_ps(scale[a]);
+            __m128 pa = _mm_set1_ps(p[a]);
+            __m128 mn = _mm_add_ps(o, _mm_mul_ps(bytes4(q[(2 * a) * rowWords + g]), s));
+            __m128 mx = _mm_add_ps(o, _mm_mul_ps(bytes4(q[(2 * a + 1) * rowWords + g]), s));
+            __m128 d = _mm_max_ps(_mm_sub_ps(mn, pa), _mm_sub_ps(pa, mx));
+            __m128 dp = _mm_max_ps(d, _mm_setzero_ps());
+            outside = _mm_add_ps(outside, _mm_mul_ps(dp, dp));
+            inside = _mm_max_ps(inside, d);
+        }
+        __m128 r = _mm_add_ps(_mm_sqrt_ps(outside), _mm_min_ps(inside, _mm_setzero_ps()));
+        _mm_storeu_ps(outDist + 4 * g, r);
+    }
+#else
+    for (uint32_t c = 0; c < W; ++c) {
+        float outside = 0.f, inside = -FLT_MAX;
+        for (int a = 0; a < 3; ++a) {
+            const uint32_t* lo = q + (2 * a) * rowWords;
+            const uint32_t* hi = q + (2 * a + 1) * rowWords;
+            float mn = org[a] + float(getByte(lo, c)) * scale[a];
+            float mx = org[a] + float(getByte(hi, c)) * scale[a];
+            float d = std::max(mn - p[a], p[a] - mx);
+            float dp = std::max(d, 0.f);
+            outside += dp * dp;
+            inside = std::max(inside, d);
+        }
+        outDist[c] = std::sqrt(outside) + std::min(inside, 0.f);
+    }
+#endif
+    for (uint32_t c = count; c < W; ++c) outDist[c] = FLT_MAX;
+    return count;
+}
+
+uint32_t nodeCacheDepth(uint32_t width, bool stackless, uint32_t bytes)
+{
+    if (width <= 2u && stackless) return 0u;
+    const uint32_t words = width > 2u ? WideBVH::NodeWords(width) : uint32_t(sizeof(BvhNode) / 4);
+
+    /* heap slots of the levels so far; + 2 words: the shader pads both
+       arrays by one                                                   */
+    uint32_t depth = 0u, slots = 0u, level = 1u;
+    while ((slots + level) * (words + 1u) * 4u + 8u <= bytes) {
+        slots += level; level *= width; ++depth;
+    }
+    return depth;
+}
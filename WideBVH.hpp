@@ -0,0 +1,58 @@
+#pragma once
+#include "BVH.hpp"
+#include <cstdint>
+#include <vector>
+
+/* --------------------------------------------------------------------------
+   Wide BVH - BuiltBVH collapsed to a 4- or 8-ary tree with child boxes
+   quantised to 8 bits per plane relative to the parent box.
+
+   One node = NodeWords(W) uint32 words, DFS preorder, root at 0:
+
+     [0..2]   origin xyz   (float bits, parent box min)
+     [3]      ex | ey<<8 | ez<<16 | childCount<<24   (ex.. are int8;
+              child scale per axis = 2^e, so 255 * 2^e >= parent extent)
+     [4..4+W) child refs
+                internal : wide node index           (bit 31 clear)
+                leaf     : 0x80000000 | count<<24 | first entry (prim())
+     [4+W..)  quantised child planes, 8 bit each, W/4 words per row,
+              rows = lo.x, hi.x, lo.y, hi.y, lo.z, hi.z
+
+   Decoding is  mn = origin + q_lo * 2^e,  mx = origin + q_hi * 2^e ; the
+   encoder rounds lo down and hi up, so decoded boxes always contain the
+   exact ones (traversal stays conservative, just slightly looser).
+   W = 4 -> 56 bytes / node,  W = 8 -> 96 bytes / node.
+   --------------------------------------------------------------------------*/
+struct WideBVH {
+    uint32_t width = 4;
+    std::vector<uint32_t> words;       /* nodeCount() * NodeWords(width)   */
+    std::vector<uint32_t> leafIdx;     /* same contract as BuiltBVH        */
+    std::vector<glm::vec2> clip;
+    std::vector<uint32_t> binNode;     /* per node: binary node it was
+                                          collapsed from (same subtree,
+                                          so bvhNodeAux() maps 1:1)      */
+
+    uint32_t prim(uint32_t i) const { return leafIdx.empty() ? i : leafIdx[i]; }
+    static constexpr uint32_t NodeWords(uint32_t w) { return 4u + w + (w * 3u) / 2u; }
+    uint32_t nodeCount() const { return uint32_t(words.size() / NodeWords(width)); }
+};
+
+/* width must be 4 or 8 (throws otherwise) */
+WideBVH collapseBVH(const BuiltBVH& bin, uint32_t width = 4);
+
+/* Signed box distance from p to every child of `node` (the sdAABB() the
+   shader uses), SSE when available.  Writes width entries to outDist -
+   unused slots get +FLT_MAX - and returns the node's child count.         */
+uint32_t wideChildDistances(const WideBVH& w, uint32_t node,
+    const glm::vec3& p, float* outDist);
+
+/* decoded helpers for CPU traversal */
+inline bool     wideRefIsLeaf(uint32_t ref) { return (ref & 0x80000000u) != 0u; }
+inline uint32_t wideLeafCount(uint32_t ref) { return (ref >> 24) & 0x7fu; }
+inline uint32_t wideLeafStart(uint32_t ref) { return ref & 0x00ffffffu; }
+
+/* Levels of the plant tree the cone and march passes keep in shared
+   memory (scene_sdf.glsl, specialisation constant 4): as many as fit in
+   `bytes`, each slot holding a node plus its index.  width 2 = BvhNode;
+   the binary skip-link walk (stackless) caches nothing.                  */
+uint32_t nodeCacheDepth(uint32_t width, bool stackless, uint32_t bytes);
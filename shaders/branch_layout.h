@@ -0,0 +1,34 @@
+/*--------------------------------------------------------------
+   branch_layout.h  -  binding 1 (branch records), shared by the
+   C++ packer (BranchLayout.cpp) and the shaders (raymarch_common.glsl)
+
+   #defines only, so it reads the same as C++ and as GLSL.  No stage
+   suffix either: compile.ps1 leaves it alone.  Bump the version
+   whenever anything below moves.
+
+   All offsets are in uvec4 (16-byte) units:
+     [0]        (version, format, branch count, side-table offset)
+     [1]        plant AABB origin.xyz (float bits), 0
+     [2]        plant AABB extent.xyz (float bits), 0
+     [3 ...]    one record per branch, leaf order:
+                  F32: (start.xyz, radius) (end.xyz, bfs)   as float bits
+                  Q16: (sx|sy, sz|ex, ey|ez, radius|bfs)
+                       positions 16-bit unorm over the AABB,
+                       radius and bfs as halves
+     [side ...] one per branch: (parent or ~0u, birth, grown, 0) -
+                only the joint blend and the growth clock read it
+  --------------------------------------------------------------*/
+#ifndef BRANCH_LAYOUT_H
+#define BRANCH_LAYOUT_H
+
+#define BRANCH_LAYOUT_VERSION 1u
+
+#define BRANCH_FORMAT_F32     0u     /* 32 bytes a branch              */
+#define BRANCH_FORMAT_Q16     1u     /* 16 bytes a branch              */
+
+#define BRANCH_HEADER_VEC4S   3u
+#define BRANCH_F32_VEC4S      2u
+#define BRANCH_Q16_VEC4S      1u
+#define BRANCH_SIDE_VEC4S     1u
+
+#endif
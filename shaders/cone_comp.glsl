@@ -0,0 +1,56 @@
+#version 460
+#pragma shader_stage(compute)
+#extension GL_GOOGLE_include_directive : require
+
+/*──────────────────────────────────────────────────────────────
+   Cone prepass: one thread per kConeTile x kConeTile pixel tile.
+   A cone around the tile's centre ray that contains every pixel ray
+   of the tile is marched until it touches a surface; the depth it
+   got to is safe for all of them.  Tiles the cone finds anything in
+   go on the tile list: the march pass is dispatched indirectly over
+   just those and starts at the depth, the rest is background.
+  ──────────────────────────────────────────────────────────────*/
+
+/*────────────────────────  CS layout  ────────────────────────*/
+/* tiles per workgroup: the shape tuneWorkgroups() picked (8 x 8 default) */
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1,
+       local_size_x_id = 10, local_size_y_id = 11) in;
+
+layout(binding = 6, r32f) uniform writeonly image2D coneImg;
+
+#include "raymarch_common.glsl"
+#include "scene_sdf.glsl"
+
+/*────────────────────────  main()  ───────────────────────────*/
+void main()
+{
+    loadNodeCache();
+
+    ivec2 tid = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 tiles = (ivec2(pc.scr.xy) + int(kConeTile) - 1) / int(kConeTile);
+    if (tid.x >= tiles.x || tid.y >= tiles.y) return;
+
+    /* unit directions over a pixel rectangle are farthest from the
+       centre one at a corner: at parameter t every pixel ray of the
+       tile is within t * k of the axis point                        */
+    vec2 p0 = vec2(tid * int(kConeTile)), p1 = p0 + float(kConeTile);
+    vec3 ro = pc.camPos.xyz;
+    vec3 rd = rayDir(0.5 * (p0 + p1));
+    float k = max(max(length(rayDir(p0) - rd), length(rayDir(vec2(p1.x, p0.y)) - rd)),
+                  max(length(rayDir(vec2(p0.x, p1.y)) - rd), length(rayDir(p1) - rd)));
+
+    /* at t + s a pixel ray is at most s + (t + s) k from the axis
+       point, so the empty ball of radius d around it holds every pixel
+       ray of the tile up to t + s while s <= (d - t k) / (1 + k): step
+       that far, stop once the step drops below kEps               */
+    float t = 0.0;
+    for (int i = 0; i < kSteps; ++i)
+    {
+        float step = (sceneSDF(ro + rd * t).d - t * k) / (1.0 + k);
+        if (step < kEps) break;
+        t += step; if (t > kFar) break;
+    }
+    imageStore(coneImg, tid, vec4(min(t, kFar)));
+    if (t < kFar)
+        tileList.tiles[atomicAdd(tileList.numTiles, 1u)] = uint(tid.x) | (uint(tid.y) << 16);
+}
@@ -0,0 +1,154 @@
+/*──────────────────────────────────────────────────────────────
+   raymarch_common.glsl  -  shared by the cone, march and shade passes
+
+   #included (no stage suffix, so compile.ps1 skips it on its own).
+   Push block, scene bindings, branch records, the growth clock and
+   the capsule SDF - everything the passes must agree on.
+  ──────────────────────────────────────────────────────────────*/
+
+#include "branch_layout.h"
+
+/* binding 1 layout (branch_layout.h): F32 or Q16 records, baked in   */
+layout(constant_id = 3) const uint kBranchFormat = BRANCH_FORMAT_F32;
+
+layout(std430, binding = 1) readonly buffer BranchBuf  { uvec4 br[];      };  // BranchLayout.hpp
+layout(std430, binding = 3) readonly buffer InstanceBuf { vec4 inst[]; };  // TwoLevelBVH.hpp
+layout(std430, binding = 4) readonly buffer NodeAuxBuf { vec4 nodeAux[]; };  // BvhNodeAux, 2 per node
+
+/*────────────────────────  push‑constants  ───────────────────*/
+layout(push_constant) uniform PC {
+    vec4 camPos, camR, camU, camF;   // camera basis; camPos.w = LOD pixel
+                                      // footprint per unit distance (0 = off)
+    vec4 scr;                        // (W, H, numBranches, maxBFS)
+    vec4 flags;                      // x, y unused (vis mode and skeleton
+                                      //   are baked: kVisMode, kSkeleton)
+                                      // z = plant instances (0 = one plant)
+                                      // w = growth clock 0..1 (1 = grown)
+} pc;
+
+/*────────────────────────  variants  ─────────────────────────*/
+/* baked per pipeline and picked per frame (pipelineVariant): the
+   quality tier's march budget and hit distance, and the smooth-min
+   width - 0 turns the blend into a plain min                        */
+layout(constant_id = 5) const float kBlend = 0.005;
+layout(constant_id = 6) const int   kSteps = 64;
+layout(constant_id = 7) const float kEps   = 0.001;
+
+/*────────────────────────  visibility buffer  ────────────────*/
+/* binding 5, rgba32ui, one texel per pixel:
+     x = hit distance t (float bits, 50 = miss)
+     y = hit id: branch slot, or kProxyBit | node‑aux index for an LOD proxy
+     z = instance (bits 0..15) | march steps (bits 16..31)
+     w = BVH node + primitive tests                                      */
+const uint  kProxyBit = 0x80000000u;
+const uint  kNoParent = 0xffffffffu;
+const float kFar = 50.0;
+
+/*────────────────────────  cone prepass  ─────────────────────*/
+/* binding 6, r32f, one texel per kConeTile² pixels: the depth every
+   ray of the tile can start at, kFar = nothing in the tile at all   */
+const uint  kConeTile = 8u;
+
+/* binding 7: the tiles that are not empty, x | y << 16, appended by
+   the prepass.  The header is the VkDispatchIndirectCommand of the
+   march pass (one kConeTile² workgroup per tile); the host resets it
+   to (0, 1, 1) every frame                                         */
+layout(std430, binding = 7) buffer TileListBuf {
+    uint numTiles, groupsY, groupsZ, pad;
+    uint tiles[];
+} tileList;
+
+/*────────────────────────  helpers  ──────────────────────────*/
+struct Branch { vec3 s; float r; vec3 e; float bfs; float birth; float grown; };
+Branch branch(uint i)
+{
+    Branch b;
+    if (kBranchFormat == BRANCH_FORMAT_Q16)
+    {
+        uvec4 q = br[BRANCH_HEADER_VEC4S + i];
+        vec3 org = uintBitsToFloat(br[1].xyz), ext = uintBitsToFloat(br[2].xyz);
+        vec2 a = unpackUnorm2x16(q.x), c = unpackUnorm2x16(q.y), d = unpackUnorm2x16(q.z);
+        vec2 rb = unpackHalf2x16(q.w);
+        b.s = org + ext * vec3(a, c.x);
+        b.e = org + ext * vec3(c.y, d);
+        b.r = rb.x; b.bfs = rb.y;
+    }
+    else
+    {
+        uint o = BRANCH_HEADER_VEC4S + i * BRANCH_F32_VEC4S;
+        vec4 a = uintBitsToFloat(br[o]), c = uintBitsToFloat(br[o + 1u]);
+        b.s = a.xyz; b.r = a.w;
+        b.e = c.xyz; b.bfs = c.w;
+    }
+
+    /* the side table only matters while the clock runs: grown = 0
+       lets grow() pass everything once it reaches 1                */
+    b.birth = 0.0; b.grown = 0.0;
+    if (pc.flags.w < 1.0)
+    {
+        uvec4 x = br[br[0].w + i * BRANCH_SIDE_VEC4S];
+        b.birth = uintBitsToFloat(x.y); b.grown = uintBitsToFloat(x.z);
+    }
+    return b;
+}
+
+uint parentOf(uint i)
+{
+    return br[br[0].w + i * BRANCH_SIDE_VEC4S].x;
+}
+
+/* growth clock: an ungrown segment is scaled from its start (the
+   parent's end); false while it is not born yet                   */
+bool grow(inout Branch b)
+{
+    float t = pc.flags.w;
+    if (t >= b.grown) return true;
+    if (t <= b.birth) return false;
+    float g = (t - b.birth) / (b.grown - b.birth);
+    b.e = b.s + (b.e - b.s) * g;
+    b.r *= g;
+    return true;
+}
+
+/* capsule distance; g = its gradient (unit, away from the axis) */
+float sdCyl(vec3 p, vec3 a, vec3 b, float r, out vec3 g)
+{
+    vec3 ab = b - a;
+    float t = clamp(dot(p - a, ab) / dot(ab, ab), 0.0, 1.0);
+    vec3 v = p - (a + ab * t);
+    float l = length(v);
+    g = v / max(l, 1e-8);
+    return l - r;
+}
+
+float sdCyl(vec3 p, vec3 a, vec3 b, float r)
+{
+    vec3 ab = b - a;
+    float t = clamp(dot(p - a, ab) / dot(ab, ab), 0.0, 1.0);
+    return length(p - (a + ab * t)) - r;
+}
+
+/* smooth‑min weight: smin(d, d0) = mix(d, d0, h) - k h (1 - h), its
+   gradient mix(g, g0, h) - h < 0.5 means d dominates                  */
+float smoothWeight(float d, float d0)
+{
+    if (kBlend <= 0.0) return d < d0 ? 0.0 : 1.0;
+    return clamp(0.5 + 0.5 * (d - d0) / kBlend, 0.0, 1.0);
+}
+
+/* ray direction through image position px (pixel units, y down) */
+vec3 rayDir(vec2 px)
+{
+    float W = pc.scr.x, H = pc.scr.y;
+    vec2 uv = px / vec2(W, H);
+    uv.y = 1.0 - uv.y;
+    vec2 ndc = uv * 2.0 - 1.0; ndc.x *= W / H;
+    return normalize(pc.camF.xyz + ndc.x * pc.camR.xyz + ndc.y * pc.camU.xyz);
+}
+
+/* primary ray through the centre of pixel gid */
+void cameraRay(ivec2 gid, out vec3 ro, out vec3 rd)
+{
+    ro = pc.camPos.xyz;
+    rd = rayDir(vec2(gid) + 0.5);
+}
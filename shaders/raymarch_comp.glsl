@@ -1,226 +1,409 @@
 #version 460
 #pragma shader_stage(compute)
+#extension GL_GOOGLE_include_directive : require
+
+/*──────────────────────────────────────────────────────────────
+   March pass: one ray per pixel through sceneSDF, and only what the
+   hit is - distance, branch, instance, step / test counts - goes to
+   the visibility buffer.  Dispatched indirectly, one workgroup per
+   tile on the prepass's tile list, and rays start at their tile's
+   cone depth (cone_comp.glsl); normals, vis modes and the skeleton
+   overlay are shade_comp.glsl's job, run over the whole image.
+  ──────────────────────────────────────────────────────────────*/
 
 /*────────────────────────  CS layout  ────────────────────────*/
-layout(local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;   // = kConeTile
 
-layout(binding = 0, rgba8) uniform writeonly image2D outImg;
+layout(binding = 5, rgba32ui) uniform writeonly uimage2D visImg;
+layout(binding = 6, r32f) uniform readonly image2D coneImg;
 
-layout(std430, binding = 1) readonly buffer BranchBuf  { float br[];      };
-layout(std430, binding = 2) readonly buffer BvhNodeBuf { float nodeData[]; };
-layout(std430, binding = 3) readonly buffer LeafIdxBuf { uint  leafIdx[];  };
+#include "raymarch_common.glsl"
+#include "scene_sdf.glsl"
 
-/*────────────────────────  push‑constants  ───────────────────*/
-layout(push_constant) uniform PC {
-    vec4 camPos, camR, camU, camF;   // camera basis
-    vec4 scr;                        // (W, H, numBranches, maxBFS)
-    vec4 flags;                      // x = vis‑mode  (0=shade,1=BFS,2=test)
-                                      // y > 0.5  → skeleton overlay
-} pc;
+/*────────────────────────  specialisation  ───────────────────*/
+/* 0 = sphere-trace sceneSDF, 1 = sphere-trace BVH leaf spans,
+   2 = analytic capsule hits through the BVH, sceneSDF at joints   */
+layout(constant_id = 2) const uint kMarchMode = 0u;
 
-/*────────────────────────  helpers  ──────────────────────────*/
-struct Branch { vec3 s; float r; vec3 e; float bfs; };
-Branch branch(uint i)
-{
-    uint o = i * 9u;
-    return Branch(vec3(br[o + 0], br[o + 1], br[o + 2]),
-                  br[o + 3],
-                  vec3(br[o + 4], br[o + 5], br[o + 6]),
-                  br[o + 7]);
-}
+/*────────────────────────  ray‑march  ────────────────────────*/
+/* hit = the sample that stopped the march; its branch and instance
+   are all the shade pass needs.  graze: analytic mode only, below  */
+struct Trace { float t, cnt; uint steps; Sdf hit; float graze; };
 
-struct Node { vec3 mn; vec3 mx; uint lo; uint hi; bool leaf; };
-Node node(uint i)
+Trace sphereMarch(vec3 ro, vec3 rd, float t0)
 {
-    uint o = i * 8u;
-    vec3 mn = vec3(nodeData[o + 0], nodeData[o + 1], nodeData[o + 2]);
-    vec3 mx = vec3(nodeData[o + 3], nodeData[o + 4], nodeData[o + 5]);
-    uint lo = floatBitsToUint(nodeData[o + 6]);
-    uint hi = floatBitsToUint(nodeData[o + 7]);
-    bool lf = (hi & 0x80000000u) != 0u;
-    hi &= 0x7fffffffu;
-    return Node(mn, mx, lo, hi, lf);
+    float t = t0, tot = 0.0;
+    for (int i = 0; i < kSteps; ++i)
+    {
+        Sdf s = sceneSDF(ro + rd * t);
+        tot += s.tests;
+        if (s.d < kEps) return Trace(t, tot, uint(i + 1), s, kFar);
+        t += s.d; if (t > kFar) return Trace(kFar, tot, uint(i + 1), Sdf(kFar, 0u, 0u, 0.0), kFar);
+    }
+    return Trace(kFar, tot, uint(kSteps), Sdf(kFar, 0u, 0u, 0.0), kFar);
 }
 
-float sdAABB(vec3 p, vec3 mn, vec3 mx)
+/*──────────  interval marching  ──────────────────────────────*/
+/* The ray walks the BVH with slab tests, nearest box first, and is
+   sphere-traced only over the spans where it is inside a leaf box,
+   against that leaf's branches alone (an LOD proxy's box: the proxy).
+   Boxes are grown by kBlend so the smin bulge at a joint stays inside.
+   Every surface lies in some leaf box, so the nearest span hit is the
+   hit; spans starting behind it are skipped.  Joints whose two
+   branches sit in different leaves lose their blend - the shade pass
+   still blends the normal with the parent.
+
+   ro / rd in the plant's space (rd not unit for an instance), t is
+   world distance along the ray, sc = world units per plant unit.    */
+bool slab(vec3 ro, vec3 inv, vec3 mn, vec3 mx, out float ta, out float tb)
 {
-    vec3 q = max(mn - p, p - mx);
-    return length(max(q, 0.0)) + min(max(q.x, max(q.y, q.z)), 0.0);
+    vec3 a = (mn - kBlend - ro) * inv, b = (mx + kBlend - ro) * inv;
+    vec3 lo = min(a, b), hi = max(a, b);
+    ta = max(max(lo.x, lo.y), lo.z);
+    tb = min(min(hi.x, hi.y), hi.z);
+    return ta <= tb;
 }
 
-float sdCyl(vec3 p, vec3 a, vec3 b, float r)
+/* ray / capsule: nearest t >= 0 on the surface, 0 = ro inside,
+   -1 = miss (IQ's capIntersect, with rd not unit for instance space) */
+float capsuleHit(vec3 ro, vec3 rd, vec3 pa, vec3 pb, float r)
 {
-    vec3 ab = b - a;
-    float t = clamp(dot(p - a, ab) / dot(ab, ab), 0.0, 1.0);
-    vec3 q = a + ab * t;
-    return length(p - q) - r;
+    if (sdCyl(ro, pa, pb, r) <= 0.0) return 0.0;
+    vec3 ba = pb - pa, oa = ro - pa;
+    float baba = dot(ba, ba), bard = dot(ba, rd), baoa = dot(ba, oa);
+    float rdrd = dot(rd, rd), rdoa = dot(rd, oa), oaoa = dot(oa, oa);
+    float a = baba * rdrd - bard * bard;
+    float b = baba * rdoa - baoa * bard;
+    float c = baba * oaoa - baoa * baoa - r * r * baba;
+    float h = b * b - a * c;
+    if (h < 0.0) return -1.0;
+
+    float t = (-b - sqrt(h)) / a;                  // body
+    float y = baoa + t * bard;
+    if (y > 0.0 && y < baba) return t;
+
+    vec3 oc = y <= 0.0 ? oa : ro - pb;             // end sphere
+    b = dot(rd, oc); c = dot(oc, oc) - r * r;
+    h = b * b - rdrd * c;
+    return h > 0.0 ? (-b - sqrt(h)) / rdrd : -1.0;
 }
 
-/* IQ smooth‑min */
-float smin(float a, float b, float k)
+/* One capsule of a span, grown by kEps like the sphere tracer's
+   stopping distance (thin twigs keep their silhouette).  A ray that
+   misses it can still meet the smin web between it and a neighbour,
+   which never reaches more than kBlend / 4 out: a hit on that shell
+   alone is a graze.  ro is the span entry (t = ta): the quadratic
+   cancels badly for millimetre twigs seen from 10+ units away.      */
+void hitCapsule(vec3 ro, vec3 rd, float ta, vec3 a, vec3 b, float r, float eps, uint id, uint k,
+                inout Trace tr)
 {
-    float h = clamp(0.5 + 0.5 * (b - a) / k, 0.0, 1.0);
-    return mix(b, a, h) - k * h * (1.0 - h);
+    tr.cnt += 1.0;
+    float t = capsuleHit(ro, rd, a, b, r + eps);
+    if (t >= 0.0) { if (ta + t < tr.t) { tr.t = ta + t; tr.hit = Sdf(0.0, id, k, 0.0); } }
+    else
+    {
+        t = capsuleHit(ro, rd, a, b, r + eps + 0.25 * kBlend);
+        if (t >= 0.0) tr.graze = min(tr.graze, ta + t);
+    }
 }
 
-/*────────────────────────  scene SDF  ────────────────────────*/
-float sceneSDF(vec3 p, out float bfs, out float tests)
+/* closest analytic hit among the span's capsules, d = 0 */
+void hitSpan(vec3 ro, vec3 rd, float sc, float ta, uint lo, uint n, uint k, inout Trace tr)
 {
-    bfs = 0.0; tests = 0.0;
-    float d = 1e9;
-
-    const float kBlend = 0.005;
-
-    uint stack[64]; int sp = 0; stack[sp++] = 0u;
-
-    while (sp > 0)
+    ro += rd * ta;
+    float eps = kEps / sc;
+    tr.steps += 1u;
+    if ((lo & kProxyBit) != 0u)
     {
-        uint ni = stack[--sp];
-        tests += 1.0;
-
-        Node nd = node(ni);
-        float dn = sdAABB(p, nd.mn, nd.mx);
-        if (dn > d) continue;
-
-        if (nd.leaf)
-        {
-            for (uint i = 0u; i < nd.hi; ++i)
-            {
-                tests += 1.0;
-                Branch b = branch(leafIdx[nd.lo + i]);
-                float dc = sdCyl(p, b.s, b.e, b.r);
-                d = smin(d, dc, kBlend);
-                if (d == dc) bfs = b.bfs;
-            }
-        }
-        else { stack[sp++] = nd.lo; stack[sp++] = nd.hi; }
+        uint ai = lo & ~kProxyBit;
+        vec4 a = nodeAux[2u * ai], b = nodeAux[2u * ai + 1u];
+        hitCapsule(ro, rd, ta, a.xyz, b.xyz, a.w, eps, lo, k, tr);
+        return;
+    }
+    for (uint j = 0u; j < n; ++j)
+    {
+        Branch b = branch(lo + j);
+        if (!grow(b)) { tr.cnt += 1.0; continue; }
+        hitCapsule(ro, rd, ta, b.s, b.e, b.r, eps, lo + j, k, tr);
     }
-    return d;
 }
 
-/*────────────────────────  ray‑march  ────────────────────────*/
-struct Trace { float t, cnt; };
-Trace raymarch(vec3 ro, vec3 rd)
+/* sphere-trace [ta, tb] against branches lo .. lo + n - 1, or the
+   proxy capsule for lo = kProxyBit | node-aux index; only a hit
+   nearer than tr.t can land                                        */
+void marchSpan(vec3 ro, vec3 rd, float sc, float ta, float tb,
+               uint lo, uint n, uint k, inout Trace tr)
 {
-    const int STEPS = 64; const float FAR = 50.0; const float EPS = 0.001;
-    float t = 0.0, tot = 0.0;
-    for (int i = 0; i < STEPS; ++i)
+    if (kMarchMode == 2u) { hitSpan(ro, rd, sc, ta, lo, n, k, tr); return; }
+    tb = min(tb, tr.t);
+    float t = ta;
+    for (int i = 0; i < kSteps && t <= tb; ++i)
     {
-        float bfs, tests; float d = sceneSDF(ro + rd * t, bfs, tests);
-        tot += tests;
-        if (d < EPS) return Trace(t, tot);
-        t += d; if (t > FAR) break;
+        vec3 p = ro + rd * t;
+        Sdf s = Sdf(1e9, 0u, k, 0.0);
+        if ((lo & kProxyBit) != 0u) proxySDF(p, lo & ~kProxyBit, s);
+        else for (uint j = 0u; j < n; ++j)
+        {
+            s.tests += 1.0;
+            Branch b = branch(lo + j);
+            if (!grow(b)) continue;
+            blend(s, sdCyl(p, b.s, b.e, b.r), lo + j);
+        }
+        tr.cnt += s.tests; tr.steps += 1u;
+        if (s.d * sc < kEps) { tr.t = t; tr.hit = s; return; }
+        t += s.d * sc;
     }
-    return Trace(FAR, tot);
 }
 
-/*──────────────────  surface normal (central diff)  ──────────*/
-vec3 normalAt(vec3 p)
+/* a box worth entering: hit, not behind t0, not behind the best hit */
+bool span(vec3 ro, vec3 inv, vec3 mn, vec3 mx, float t0, float tBest,
+          out float ta, out float tb)
 {
-    vec2 e = vec2(0.001, 0.0); float b, t;
-    float d0 = sceneSDF(p, b, t);
-    float dx = sceneSDF(p + vec3(e.x, e.y, e.y), b, t)
-             - sceneSDF(p - vec3(e.x, e.y, e.y), b, t);
-    float dy = sceneSDF(p + vec3(e.y, e.x, e.y), b, t)
-             - sceneSDF(p - vec3(e.y, e.x, e.y), b, t);
-    float dz = sceneSDF(p + vec3(e.y, e.y, e.x), b, t) - d0;
-    return normalize(vec3(dx, dy, dz));
+    if (!slab(ro, inv, mn, mx, ta, tb) || tb < t0 || ta > tBest) return false;
+    ta = max(ta, t0);
+    return true;
 }
 
-/*────────────────────────  shading  ──────────────────────────*/
-vec3 shade(vec3 p, vec3 n)
+/* binary skip-link tree: fixed (left-first) order, spans pruned */
+void spansStackless(vec3 ro, vec3 rd, float sc, uint base, uint brBase, uint auxBase,
+                    uint k, float t0, inout Trace tr)
 {
-    vec3 base = vec3(0.4, 0.3, 0.2);
-    vec3 L = normalize(vec3(1, 1, -0.5));
-    vec3 V = normalize(pc.camPos.xyz - p);
-    vec3 H = normalize(L + V);
-
-    vec3 amb = 0.15 * base;
-    vec3 dif = 0.75 * base * max(dot(n, L), 0.0);
-    float sp = pow(max(dot(n, H), 0.0), 16.0) * 0.2;
-    return amb + dif + vec3(sp);
+    vec3 inv = 1.0 / rd;
+    Node root = node(base, 0u);
+    uint end = root.leaf ? 1u : root.lo;
+
+    uint ni = 0u;
+    while (ni < end)
+    {
+        tr.cnt += 1.0;
+        Node nd = node(base, ni);
+        float ta, tb;
+        bool cull = !span(ro, inv, nd.mn, nd.mx, t0, tr.t, ta, tb) || unborn(auxBase + ni);
+        if (nd.leaf)
+        {
+            if (!cull) marchSpan(ro, rd, sc, ta, tb, brBase + nd.lo, nd.hi, k, tr);
+            ni += 1u + nd.skip;
+        }
+        else if (!cull && lodNode(length(nd.mx - nd.mn), pc.camPos.w * ta / sc))
+        {
+            marchSpan(ro, rd, sc, ta, tb, kProxyBit | (auxBase + ni), 0u, k, tr);
+            ni = nd.lo;
+        }
+        else ni = cull ? nd.lo : ni + 1u;
+    }
 }
 
-/*──────── distance between a ray and a segment (for skeleton) ─────────*/
-float raySegDist(vec3 ro, vec3 rd, vec3 a, vec3 b)
+/* binary tree with a stack: both children tested at the parent, the
+   nearer one walked first                                           */
+void spansStack(vec3 ro, vec3 rd, float sc, uint base, uint brBase, uint auxBase,
+                uint k, float t0, inout Trace tr)
 {
-    vec3 ab = b - a;
-    float ab2 = dot(ab, ab);
-    float rd_ab = dot(rd, ab);
+    vec3 inv = 1.0 / rd;
+    uint stack[64]; vec2 stackT[64]; int sp = 0;
 
-    float denom = ab2 - rd_ab * rd_ab;
-    float s = 0.0, t = 0.0;
-    vec3 ao = ro - a;
+    float ta, tb;
+    tr.cnt += 1.0;
+    uint e = rootRef(base);
+    Node root = node(base, e);
+    if (!span(ro, inv, root.mn, root.mx, t0, tr.t, ta, tb) || unborn(auxBase)) return;
+    stack[sp] = e; stackT[sp++] = vec2(ta, tb);
 
-    if (denom > 1e-6)
+    while (sp > 0)
     {
-        float ao_ab = dot(ao, ab);
-        float ao_rd = dot(ao, rd);
-        s = clamp((ao_ab * rd_ab - ao_rd * ab2) / denom, 0.0, 1.0);
-        t = clamp((ao_ab + s * rd_ab) / ab2, 0.0, 1.0);
-    }
+        --sp;
+        if (stackT[sp].x > tr.t) continue;
+        e = stack[sp];
+        uint ni = nodeIndex(e);
+        Node nd = node(base, e);
+        if (nd.leaf)
+        {
+            marchSpan(ro, rd, sc, stackT[sp].x, stackT[sp].y, brBase + nd.lo, nd.hi, k, tr);
+            continue;
+        }
+        if (lodNode(length(nd.mx - nd.mn), pc.camPos.w * stackT[sp].x / sc))
+        {
+            marchSpan(ro, rd, sc, stackT[sp].x, stackT[sp].y, kProxyBit | (auxBase + ni), 0u, k, tr);
+            continue;
+        }
 
-    vec3 pRay = ro + rd * s;
-    vec3 pSeg = a + ab * t;
-    return length(pRay - pSeg);
+        uint c[2]; vec2 ct[2]; bool hit[2];
+        c[0] = ni + 1u; c[1] = nd.hi;
+        for (int j = 0; j < 2; ++j)
+        {
+            tr.cnt += 1.0;
+            uint ce = childRef(e, uint(j), c[j]);
+            Node cn = node(base, ce);
+            hit[j] = span(ro, inv, cn.mn, cn.mx, t0, tr.t, ta, tb) && !unborn(auxBase + c[j]);
+            c[j] = ce;
+            ct[j] = vec2(ta, tb);
+        }
+        int nearC = (hit[0] && hit[1] && ct[1].x < ct[0].x) ? 1 : 0;
+        for (int j = 0; j < 2; ++j)            // far child first: popped last
+        {
+            int cj = j == 0 ? 1 - nearC : nearC;
+            if (hit[cj] && sp < 64) { stack[sp] = c[cj]; stackT[sp++] = ct[cj]; }
+        }
+    }
 }
 
-/*────────────────────────  main()  ───────────────────────────*/
-void main()
+/* wide tree: a node's child boxes are slab-tested and sorted; leaf
+   and proxy children are marched there, nearest first, internal
+   children pushed far to near                                      */
+void spansWide(vec3 ro, vec3 rd, float sc, uint base, uint brBase, uint auxBase,
+               uint k, float t0, inout Trace tr)
 {
-    ivec2 gid = ivec2(gl_GlobalInvocationID.xy);
-    float W = pc.scr.x, H = pc.scr.y;
-    if (gid.x >= int(W) || gid.y >= int(H)) return;
+    vec3 inv = 1.0 / rd;
+    uint stack[64]; float stackT[64]; int sp = 0;
+    stack[sp] = rootRef(base); stackT[sp++] = t0;
+
+    while (sp > 0)
+    {
+        --sp;
+        if (stackT[sp] > tr.t) continue;
+        uint ni = stack[sp];
+        tr.cnt += 1.0;
 
-    vec2 uv = (vec2(gid) + 0.5) / vec2(W, H);
-    uv.y = 1.0 - uv.y;
-    vec2 ndc = uv * 2.0 - 1.0; ndc.x *= W / H;
+        uint hdr = wideWord(base, ni, 3u);
+        uint cnt = hdr >> 24;
+        vec3 org = uintBitsToFloat(uvec3(wideWord(base, ni, 0u), wideWord(base, ni, 1u), wideWord(base, ni, 2u)));
+        vec3 scl = exp2(vec3(bitfieldExtract(int(hdr), 0, 8),
+                             bitfieldExtract(int(hdr), 8, 8),
+                             bitfieldExtract(int(hdr), 16, 8)));
 
-    vec3 ro = pc.camPos.xyz;
-    vec3 rd = normalize(pc.camF.xyz + ndc.x * pc.camR.xyz + ndc.y * pc.camU.xyz);
+        /* hit children, insertion-sorted by entry */
+        vec2 ct[8]; float sz[8]; uint order[8]; uint m = 0u;
+        for (uint c = 0u; c < cnt; ++c)
+        {
+            vec3 lo = vec3(planeByte(base, ni, 0u, c), planeByte(base, ni, 2u, c), planeByte(base, ni, 4u, c));
+            vec3 hi = vec3(planeByte(base, ni, 1u, c), planeByte(base, ni, 3u, c), planeByte(base, ni, 5u, c));
+            float ta, tb;
+            if (!span(ro, inv, org + lo * scl, org + hi * scl, t0, tr.t, ta, tb)) continue;
+            ct[c] = vec2(ta, tb);
+            sz[c] = length((hi - lo) * scl);
+            uint j = m++;
+            for (; j > 0u && ct[order[j - 1u]].x > ta; --j) order[j] = order[j - 1u];
+            order[j] = c;
+        }
 
-    /*──── optional wire‑frame overlay – before heavy marching ────*/
-    if (pc.flags.y > 0.5)
-    {
-        float dMin = 1e9;
-        uint brCnt = uint(pc.scr.z);
-        for (uint i = 0u; i < brCnt; ++i)
+        for (uint j = 0u; j < m; ++j)
         {
-            Branch b = branch(i);
-            dMin = min(dMin, raySegDist(ro, rd, b.s, b.e) - b.r);
+            uint c = order[j];
+            uint ref = wideWord(base, ni, 4u + c);
+            if ((ref & 0x80000000u) != 0u)
+                marchSpan(ro, rd, sc, ct[c].x, ct[c].y,
+                          brBase + (ref & 0x00ffffffu), (ref >> 24) & 0x7fu, k, tr);
+            else if (lodNode(sz[c], pc.camPos.w * ct[c].x / sc))
+                marchSpan(ro, rd, sc, ct[c].x, ct[c].y, kProxyBit | (auxBase + ref), 0u, k, tr);
         }
-        if (dMin < 0.003) {            // 3 mm screen‑space width
-            imageStore(outImg, gid, vec4(1.0));  // white line
-            return;
+        for (uint j = m; j-- > 0u;)
+        {
+            uint c = order[j];
+            uint ref = wideWord(base, ni, 4u + c);
+            if ((ref & 0x80000000u) != 0u || lodNode(sz[c], pc.camPos.w * ct[c].x / sc)) continue;
+            if (sp < 64 && !unborn(auxBase + ref)) { stack[sp] = childRef(ni, c, ref); stackT[sp++] = ct[c].x; }
         }
     }
+}
 
-    Trace tr = raymarch(ro, rd);
+void plantSpans(vec3 ro, vec3 rd, float sc, uint base, uint brBase, uint auxBase,
+                uint k, float t0, inout Trace tr)
+{
+    if (kBvhWidth > 2u) spansWide(ro, rd, sc, base, brBase, auxBase, k, t0, tr);
+    else if (kStackless) spansStackless(ro, rd, sc, base, brBase, auxBase, k, t0, tr);
+    else spansStack(ro, rd, sc, base, brBase, auxBase, k, t0, tr);
+}
 
-    /* background */
-    if (tr.t > 49.9) {
-        imageStore(outImg, gid, vec4(0.0, 0.15, 0.2, 1.0));
-        return;
-    }
+Trace intervalMarch(vec3 ro, vec3 rd, float t0)
+{
+    Trace tr = Trace(kFar, 0.0, 0u, Sdf(kFar, 0u, 0u, 0.0), kFar);
 
-    vec3 pos = ro + rd * tr.t;
-    float bfs, tmp; sceneSDF(pos, bfs, tmp);
-    vec3 n = normalAt(pos);
+    uint nInst = uint(pc.flags.z);
+    if (nInst == 0u) { plantSpans(ro, rd, 1.0, 0u, 0u, 0u, 0u, t0, tr); return tr; }
 
-    float mode = pc.flags.x;
-    if (mode >= 2.5)               /* test‑count heat‑map          */
+    /* TLAS boxes are world space; each instance gets the ray in its
+       plant space (rows r0..r2 = R^T / scale, as instanceSDF)      */
+    vec3 inv = 1.0 / rd;
+    Node root = node(0u, 0u);
+    uint end = root.leaf ? 1u : root.lo;
+    uint ni = 0u;
+    while (ni < end)
     {
-        float m = clamp(tr.cnt / pc.scr.z, 0.0, 1.0);
-        imageStore(outImg, gid, vec4(m, 0.0, 1.0 - m, 1.0));
+        tr.cnt += 1.0;
+        Node nd = node(0u, ni);
+        float ta, tb;
+        bool cull = !span(ro, inv, nd.mn, nd.mx, t0, tr.t, ta, tb);
+        if (nd.leaf)
+        {
+            if (!cull)
+                for (uint j = 0u; j < nd.hi; ++j)
+                {
+                    uint k = nd.lo + j;
+                    vec4 r0 = inst[k * 4u], r1 = inst[k * 4u + 1u], r2 = inst[k * 4u + 2u], r3 = inst[k * 4u + 3u];
+                    vec3 q = ro - vec3(r0.w, r1.w, r2.w);
+                    plantSpans(vec3(dot(r0.xyz, q), dot(r1.xyz, q), dot(r2.xyz, q)),
+                               vec3(dot(r0.xyz, rd), dot(r1.xyz, rd), dot(r2.xyz, rd)), r3.x,
+                               floatBitsToUint(r3.y), floatBitsToUint(r3.z), floatBitsToUint(r3.w),
+                               k, t0, tr);
+                }
+            ni += 1u + nd.skip;
+        }
+        else ni = cull ? nd.lo : ni + 1u;
     }
-    else if (mode >= 1.5)          /* BFS depth visualisation      */
+    return tr;
+}
+
+/* An analytic hit is exact for the capsule alone.  If another
+   primitive is within kBlend there, the smin bulge lies in front of
+   it; a graze in front of the hit may be web.  Either way a few
+   sceneSDF steps find the blended surface, otherwise the analytic
+   hit (or miss) stands.                                             */
+void refineJoint(vec3 ro, vec3 rd, float t0, inout Trace tr)
+{
+    const int JOINT_STEPS = 8;
+    float t;
+    if (tr.graze < tr.t) t = max(t0, tr.graze);
+    else
     {
-        float c = clamp(bfs / pc.scr.w, 0.0, 1.0);
-        imageStore(outImg, gid, vec4(c, 1.0 - c, 0.0, 1.0));
+        Sdf s = sceneSDF(ro + rd * tr.t);
+        tr.cnt += s.tests; tr.steps += 1u;
+        if (s.d >= 0.0) return;            // at most kEps of blend
+        t = max(t0, tr.t - kBlend);
     }
-    else                           /* regular shading              */
+
+    for (int i = 0; i < JOINT_STEPS && t < tr.t; ++i)
     {
-        vec3 col = shade(pos, n);
-        imageStore(outImg, gid, vec4(col, 1.0));
+        Sdf s = sceneSDF(ro + rd * t);
+        tr.cnt += s.tests; tr.steps += 1u;
+        if (s.d < kEps) { tr.t = t; tr.hit = s; return; }
+        t += s.d;
     }
 }
+
+Trace raymarch(vec3 ro, vec3 rd, float t0)
+{
+    if (kMarchMode == 0u) return sphereMarch(ro, rd, t0);
+    Trace tr = intervalMarch(ro, rd, t0);
+    if (kMarchMode == 2u && min(tr.t, tr.graze) < kFar) refineJoint(ro, rd, t0, tr);
+    return tr;
+}
+
+/*────────────────────────  main()  ───────────────────────────*/
+void main()
+{
+    loadNodeCache();
+
+    uint tile = tileList.tiles[gl_WorkGroupID.x];
+    ivec2 tid = ivec2(tile & 0xffffu, tile >> 16);
+    ivec2 gid = tid * int(kConeTile) + ivec2(gl_LocalInvocationID.xy);
+    if (gid.x >= int(pc.scr.x) || gid.y >= int(pc.scr.y)) return;
+
+    float t0 = imageLoad(coneImg, tid).x;
+
+    vec3 ro, rd;
+    cameraRay(gid, ro, rd);
+    Trace tr = raymarch(ro, rd, t0);
+
+    imageStore(visImg, gid, uvec4(floatBitsToUint(tr.t), tr.hit.id,
+                                  (tr.hit.inst & 0xffffu) | (min(tr.steps, 0xffffu) << 16),
+                                  uint(tr.cnt)));
+}
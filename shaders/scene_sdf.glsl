@@ -0,0 +1,374 @@
+/*──────────────────────────────────────────────────────────────
+   scene_sdf.glsl  -  the distance field: BVH walks, instances, LOD
+
+   #included after raymarch_common.glsl by every pass that marches
+   (cone prepass, march pass) and by the shade pass for its skeleton
+   query.  Declares binding 2, the BVH specialisation constants and
+   the shared-memory node cache.
+  ──────────────────────────────────────────────────────────────*/
+
+layout(std430, binding = 2) readonly buffer BvhNodeBuf { float nodeData[]; };
+
+/*────────────────────────  specialisation  ───────────────────*/
+layout(constant_id = 0) const uint kBvhWidth = 2u;  // 2 = BvhNode, 4/8 = WideBVH
+layout(constant_id = 1) const bool kStackless = true; // binary tree: skip links
+layout(constant_id = 4) const uint kNodeCacheDepth = 0u; // levels in shared memory
+
+/* words per node: 8 (BvhNode) at width 2, WideBVH::NodeWords above */
+const uint kNodeWords = 4u + kBvhWidth + kBvhWidth * 3u / 2u - (kBvhWidth & 2u) / 2u;
+const uint kLog2Width = (kBvhWidth & 2u) / 2u + (kBvhWidth & 4u) / 2u + (kBvhWidth & 8u) * 3u / 8u;
+
+/* node aux ai = (proxy a, r), (proxy b, earliest birth below) */
+bool unborn(uint ai)
+{
+    return pc.flags.w < 1.0 && nodeAux[2u * ai + 1u].w >= pc.flags.w;
+}
+
+/*──────────  node cache  ─────────────────────────────────────*/
+/* Every ray of a workgroup starts at the same few nodes, so the top
+   kNodeCacheDepth levels of the plant's tree are copied into shared
+   memory once per dispatch and read from there.  Heap order: the
+   root is slot 0, child c of slot s is slot s * W + 1 + c.  The stack
+   walks carry kCachedBit | slot for a cached node and the node index
+   below the cache; the host sizes the depth to its shared-memory
+   budget and leaves it at 0 for the skip-link walk, which moves by
+   index arithmetic.  A forest's BLASes are not cached.              */
+const uint kCacheSlots = ((1u << (kLog2Width * kNodeCacheDepth)) - 1u) / (kBvhWidth - 1u);
+const uint kCachedBit = 0x80000000u;
+
+shared uint nodeCache[kCacheSlots * kNodeWords + 1u];   // + 1: no empty arrays
+shared uint nodeCacheRef[kCacheSlots + 1u];             // slot -> node index
+
+/* tree at base is the cached one: its root as a walk starts it */
+uint rootRef(uint base)
+{
+    return kCacheSlots > 0u && base == 0u && pc.flags.z < 0.5 ? kCachedBit : 0u;
+}
+
+/* child c (node index ref) of the walk's node e, as the walk pushes it */
+uint childRef(uint e, uint c, uint ref)
+{
+    if ((e & kCachedBit) == 0u) return ref;
+    uint s = (e & ~kCachedBit) * kBvhWidth + 1u + c;
+    return s < kCacheSlots ? kCachedBit | s : ref;
+}
+
+uint nodeIndex(uint e)
+{
+    return (e & kCachedBit) != 0u ? nodeCacheRef[e & ~kCachedBit] : e;
+}
+
+/* word k of node e, kNodeWords (cached) or stride words a node */
+uint nodeWord(uint base, uint e, uint stride, uint k)
+{
+    if ((e & kCachedBit) != 0u) return nodeCache[(e & ~kCachedBit) * kNodeWords + k];
+    return floatBitsToUint(nodeData[base + e * stride + k]);
+}
+
+/* node index of slot s from its parent's cached copy, kNoParent if
+   that child is a leaf or missing                                  */
+uint cacheSlotNode(uint s)
+{
+    if (s == 0u) return 0u;
+    uint ps = (s - 1u) / kBvhWidth, c = (s - 1u) % kBvhWidth;
+    if (nodeCacheRef[ps] == kNoParent) return kNoParent;
+    uint o = ps * kNodeWords;
+    if (kBvhWidth == 2u)
+    {
+        uint hi = nodeCache[o + 7u];
+        if ((hi & 0x80000000u) != 0u) return kNoParent;
+        return c == 0u ? nodeCacheRef[ps] + 1u : hi;
+    }
+    if (c >= nodeCache[o + 3u] >> 24) return kNoParent;
+    uint ref = nodeCache[o + 4u + c];
+    return (ref & 0x80000000u) != 0u ? kNoParent : ref;
+}
+
+/* cooperative fill, one level per round; call from uniform control
+   flow at the top of main()                                        */
+void loadNodeCache()
+{
+    if (kCacheSlots == 0u || pc.flags.z >= 0.5) return;
+    uint lanes = gl_WorkGroupSize.x * gl_WorkGroupSize.y * gl_WorkGroupSize.z;
+    uint lo = 0u, hi = 1u;
+    for (uint l = 0u; l < kNodeCacheDepth; ++l)
+    {
+        for (uint i = gl_LocalInvocationIndex; i < (hi - lo) * kNodeWords; i += lanes)
+        {
+            uint s = lo + i / kNodeWords, k = i % kNodeWords;
+            uint ni = cacheSlotNode(s);
+            if (k == 0u) nodeCacheRef[s] = ni;
+            if (ni != kNoParent) nodeCache[s * kNodeWords + k] = floatBitsToUint(nodeData[ni * kNodeWords + k]);
+        }
+        memoryBarrierShared();
+        barrier();
+        lo = hi; hi = hi * kBvhWidth + 1u;
+    }
+}
+
+struct Node { vec3 mn; vec3 mx; uint lo; uint hi; bool leaf; uint skip; };
+/* base = word offset of the tree in nodeData (TLAS / BLAS); i may be
+   a cached slot (binary plant tree only)                            */
+Node node(uint base, uint i)
+{
+    vec3 mn = uintBitsToFloat(uvec3(nodeWord(base, i, 8u, 0u), nodeWord(base, i, 8u, 1u), nodeWord(base, i, 8u, 2u)));
+    vec3 mx = uintBitsToFloat(uvec3(nodeWord(base, i, 8u, 3u), nodeWord(base, i, 8u, 4u), nodeWord(base, i, 8u, 5u)));
+    uint lo = nodeWord(base, i, 8u, 6u);
+    uint hi = nodeWord(base, i, 8u, 7u);
+    bool lf = (hi & 0x80000000u) != 0u;
+    uint skip = lf ? (hi >> 8) & 0x7fffffu : 0u;    // unused slots after a leaf
+    if (lf) hi &= 0xffu;
+    return Node(mn, mx, lo, hi, lf, skip);
+}
+
+float sdAABB(vec3 p, vec3 mn, vec3 mx)
+{
+    vec3 q = max(mn - p, p - mx);
+    return length(max(q, 0.0)) + min(max(q.x, max(q.y, q.z)), 0.0);
+}
+
+/* one field sample: distance, the dominant branch (or proxy) and the
+   instance it belongs to - no gradient, the shade pass rebuilds it   */
+struct Sdf { float d; uint id; uint inst; float tests; };
+
+/* IQ smooth‑min of s.d and d; h < 0.5 = d dominates */
+void blend(inout Sdf s, float d, uint id)
+{
+    if (d >= s.d + kBlend) return;               // h = 1: nothing changes
+    float h = smoothWeight(d, s.d);
+    if (h < 0.5) s.id = id;
+    s.d = mix(d, s.d, h) - kBlend * h * (1.0 - h);
+}
+
+/* blend()'s support is finite: a box kBlend or more beyond s.d holds
+   nothing that can change s - the traversals' cull test            */
+bool beyond(float dn, Sdf s)
+{
+    return dn >= s.d + kBlend;
+}
+
+/*──────────  wide node access (layout: WideBVH.hpp)  ─────────*/
+uint wideWord(uint base, uint ni, uint k)
+{
+    return nodeWord(base, ni, kNodeWords, k);
+}
+
+/* row: 0/1 = lo/hi x, 2/3 = y, 4/5 = z ; 4 children per word */
+uint planeByte(uint base, uint ni, uint row, uint c)
+{
+    uint w = wideWord(base, ni, 4u + kBvhWidth + row * (kBvhWidth / 4u) + (c >> 2));
+    return (w >> ((c & 3u) * 8u)) & 0xffu;
+}
+
+/*────────────────────────  scene SDF  ────────────────────────*/
+/* LOD: once a subtree is smaller than the pixel footprint (lod, in the
+   current space) its proxy capsule stands in for it - grown plants only */
+bool lodNode(float size, float lod)
+{
+    return size < lod && pc.flags.w >= 1.0;
+}
+
+/* a dominant proxy is the hit itself: shading reads its capsule */
+void proxySDF(vec3 p, uint ai, inout Sdf s)
+{
+    vec4 a = nodeAux[2u * ai], b = nodeAux[2u * ai + 1u];
+    s.tests += 1.0;
+    blend(s, sdCyl(p, a.xyz, b.xyz, a.w), kProxyBit | ai);
+}
+
+void sceneSDFWide(vec3 p, uint base, uint brBase, uint auxBase, float lod, inout Sdf s)
+{
+    /* push distance rides along: d keeps shrinking after the push */
+    uint stack[64]; float stackD[64]; int sp = 0;
+    stack[sp] = rootRef(base); stackD[sp++] = 0.0;
+
+    while (sp > 0)
+    {
+        --sp;
+        if (beyond(stackD[sp], s)) continue;
+        uint ni = stack[sp];
+        s.tests += 1.0;
+
+        uint hdr = wideWord(base, ni, 3u);
+        uint cnt = hdr >> 24;
+        vec3 org = uintBitsToFloat(uvec3(wideWord(base, ni, 0u), wideWord(base, ni, 1u), wideWord(base, ni, 2u)));
+        vec3 scl = exp2(vec3(bitfieldExtract(int(hdr), 0, 8),
+                             bitfieldExtract(int(hdr), 8, 8),
+                             bitfieldExtract(int(hdr), 16, 8)));
+
+        /* all child boxes first, insertion-sorted nearest first */
+        float dc[8], sz[8]; uint order[8];
+        for (uint c = 0u; c < cnt; ++c)
+        {
+            vec3 lo = vec3(planeByte(base, ni, 0u, c), planeByte(base, ni, 2u, c), planeByte(base, ni, 4u, c));
+            vec3 hi = vec3(planeByte(base, ni, 1u, c), planeByte(base, ni, 3u, c), planeByte(base, ni, 5u, c));
+            dc[c] = sdAABB(p, org + lo * scl, org + hi * scl);
+            sz[c] = length((hi - lo) * scl);
+            uint j = c;
+            for (; j > 0u && dc[order[j - 1u]] > dc[c]; --j) order[j] = order[j - 1u];
+            order[j] = c;
+        }
+
+        /* leaves and proxies nearest first: once one box is beyond the
+           tightened s.d, every box after it is too                    */
+        for (uint j = 0u; j < cnt; ++j)
+        {
+            uint c = order[j];
+            if (beyond(dc[c], s)) break;
+            uint ref = wideWord(base, ni, 4u + c);
+            if ((ref & 0x80000000u) != 0u)
+            {
+                uint start = ref & 0x00ffffffu;
+                uint n = (ref >> 24) & 0x7fu;
+                for (uint i = 0u; i < n; ++i)
+                {
+                    s.tests += 1.0;
+                    Branch b = branch(brBase + start + i);
+                    if (!grow(b)) continue;
+                    blend(s, sdCyl(p, b.s, b.e, b.r), brBase + start + i);
+                }
+            }
+            else if (lodNode(sz[c], lod)) proxySDF(p, auxBase + ref, s);
+        }
+
+        /* then the inner children, pushed far first: popped near first */
+        for (uint j = cnt; j-- > 0u;)
+        {
+            uint c = order[j];
+            if (beyond(dc[c], s)) continue;
+            uint ref = wideWord(base, ni, 4u + c);
+            if ((ref & 0x80000000u) != 0u || lodNode(sz[c], lod)) continue;
+            if (sp < 64 && !unborn(auxBase + ref)) { stack[sp] = childRef(ni, c, ref); stackD[sp++] = dc[c]; }
+        }
+    }
+}
+
+void leafSDF(vec3 p, Node nd, uint brBase, inout Sdf s)
+{
+    for (uint i = 0u; i < nd.hi; ++i)
+    {
+        s.tests += 1.0;
+        Branch b = branch(brBase + nd.lo + i);   // leaf-ordered buffer
+        if (!grow(b)) continue;
+        /* SBVH pieces of one capsule overlap only at their cut, so
+           smin adds at most a joint-sized bulge there, never a
+           uniform k/4 inflation like exact duplicates would   */
+        blend(s, sdCyl(p, b.s, b.e, b.r), brBase + nd.lo + i);
+    }
+}
+
+/* DFS preorder: left child = ni + 1, nd.lo on internals = skip link
+   (first node after the subtree), leaves step over nd.skip unused
+   slots (DynamicBVH slack).  No stack, no 64-entry cap - and no say
+   in the order either, left first.                                  */
+void sceneSDFStackless(vec3 p, uint base, uint brBase, uint auxBase, float lod, inout Sdf s)
+{
+    Node root = node(base, 0u);
+    uint end = root.leaf ? 1u : root.lo;
+
+    uint ni = 0u;
+    while (ni < end)
+    {
+        s.tests += 1.0;
+        Node nd = node(base, ni);
+        bool cull = beyond(sdAABB(p, nd.mn, nd.mx), s) || unborn(auxBase + ni);
+        if (nd.leaf)
+        {
+            if (!cull) leafSDF(p, nd, brBase, s);
+            ni += 1u + nd.skip;
+        }
+        else if (!cull && lodNode(length(nd.mx - nd.mn), lod))
+        {
+            proxySDF(p, auxBase + ni, s);
+            ni = nd.lo;
+        }
+        else ni = cull ? nd.lo : ni + 1u;
+    }
+}
+
+/* both children are measured at the parent and the farther one is
+   pushed first, so the nearer subtree tightens s.d before the other
+   is looked at; a popped entry rides on its push distance          */
+void sceneSDFStack(vec3 p, uint base, uint brBase, uint auxBase, float lod, inout Sdf s)
+{
+    uint stack[64]; float stackD[64]; int sp = 0;
+    stack[sp] = rootRef(base); stackD[sp++] = 0.0;
+    s.tests += 1.0;                        // root box, as ever
+
+    while (sp > 0)
+    {
+        --sp;
+        if (beyond(stackD[sp], s)) continue;
+        uint e = stack[sp], ni = nodeIndex(e);
+
+        Node nd = node(base, e);
+        if (unborn(auxBase + ni)) continue;
+
+        if (nd.leaf) leafSDF(p, nd, brBase, s);
+        else if (lodNode(length(nd.mx - nd.mn), lod)) proxySDF(p, auxBase + ni, s);
+        else if (sp + 2 <= 64)
+        {
+            uint a = childRef(e, 0u, ni + 1u), b = childRef(e, 1u, nd.hi);
+            Node na = node(base, a), nb = node(base, b);
+            s.tests += 2.0;
+            float da = sdAABB(p, na.mn, na.mx), db = sdAABB(p, nb.mn, nb.mx);
+            if (da > db) { uint t = a; a = b; b = t; float td = da; da = db; db = td; }
+            stack[sp] = b; stackD[sp++] = db;
+            stack[sp] = a; stackD[sp++] = da;
+        }
+    }
+}
+
+/* one plant's BVH at word offset base; s is tightened in place */
+void plantSDF(vec3 p, uint base, uint brBase, uint auxBase, float lod, inout Sdf s)
+{
+    if (kBvhWidth > 2u) sceneSDFWide(p, base, brBase, auxBase, lod, s);
+    else if (kStackless) sceneSDFStackless(p, base, brBase, auxBase, lod, s);
+    else sceneSDFStack(p, base, brBase, auxBase, lod, s);
+}
+
+/* rigid + uniform scale: march in plant space, scale distances back.
+   rows r0..r2 = R^T / scale                                          */
+void instanceSDF(vec3 p, uint k, float lod, inout Sdf s)
+{
+    vec4 r0 = inst[k * 4u], r1 = inst[k * 4u + 1u], r2 = inst[k * 4u + 2u], r3 = inst[k * 4u + 3u];
+    vec3 q = p - vec3(r0.w, r1.w, r2.w);
+    vec3 pl = vec3(dot(r0.xyz, q), dot(r1.xyz, q), dot(r2.xyz, q));
+
+    /* kNoParent marks "not taken over": k owns the hit if the id changes */
+    uint id = s.id; s.id = kNoParent;
+    s.d /= r3.x;
+    plantSDF(pl, floatBitsToUint(r3.y), floatBitsToUint(r3.z), floatBitsToUint(r3.w),
+             lod / r3.x, s);
+    s.d *= r3.x;
+    if (s.id == kNoParent) s.id = id; else s.inst = k;
+}
+
+Sdf sceneSDF(vec3 p)
+{
+    Sdf s = Sdf(1e9, 0u, 0u, 0.0);
+
+    float lod = pc.camPos.w * length(p - pc.camPos.xyz);   // pixel size at p
+
+    uint nInst = uint(pc.flags.z);
+    if (nInst == 0u) { plantSDF(p, 0u, 0u, 0u, lod, s); return s; }
+
+    /* TLAS: binary nodes at word 0, leaves = instance records */
+    Node root = node(0u, 0u);
+    uint end = root.leaf ? 1u : root.lo;
+    uint ni = 0u;
+    while (ni < end)
+    {
+        s.tests += 1.0;
+        Node nd = node(0u, ni);
+        bool cull = beyond(sdAABB(p, nd.mn, nd.mx), s);
+        if (nd.leaf)
+        {
+            if (!cull)
+                for (uint k = 0u; k < nd.hi; ++k) instanceSDF(p, nd.lo + k, lod, s);
+            ni += 1u + nd.skip;
+        }
+        else ni = cull ? nd.lo : ni + 1u;
+    }
+    return s;
+}
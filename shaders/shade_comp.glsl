@@ -0,0 +1,227 @@
+#version 460
+#pragma shader_stage(compute)
+#extension GL_GOOGLE_include_directive : require
+
+/*──────────────────────────────────────────────────────────────
+   Shade pass: reads the visibility buffer raymarch_comp.glsl wrote
+   and turns it into colour.  No BVH walk for shading - the normal
+   comes straight from the hit capsule (plus its parent near the
+   joint), so every pixel does the same handful of loads and the
+   warps stay coherent.  Only the skeleton overlay queries the BVH.
+  ──────────────────────────────────────────────────────────────*/
+
+/*────────────────────────  CS layout  ────────────────────────*/
+/* the shape tuneWorkgroups() picked, 16 x 16 unless told otherwise */
+layout(local_size_x = 16, local_size_y = 16, local_size_z = 1,
+       local_size_x_id = 10, local_size_y_id = 11) in;
+
+layout(binding = 0, rgba8) uniform writeonly image2D outImg;
+layout(binding = 5, rgba32ui) uniform readonly uimage2D visImg;
+layout(binding = 6, r32f) uniform readonly image2D coneImg;
+
+#include "raymarch_common.glsl"
+#include "scene_sdf.glsl"
+
+/*────────────────────────  specialisation  ───────────────────*/
+/* per-frame variants: 0 = shading, 1 = BFS depth, 2 = test heat map;
+   the skeleton overlay (single plant only)                          */
+layout(constant_id = 8) const uint kVisMode = 0u;
+layout(constant_id = 9) const bool kSkeleton = false;
+
+/*──────────  surface gradient from the hit id  ───────────────*/
+/* p in the plant's space.  A branch is smin‑blended with its parent
+   like sceneSDF does; away from the joint the parent is kBlend or more
+   farther and drops out, so the blend only ever touches joints.  A
+   proxy (LOD) hit uses the proxy capsule as it is.                   */
+vec3 hitGrad(vec3 p, uint id)
+{
+    vec3 g;
+    if ((id & kProxyBit) != 0u)
+    {
+        uint ai = id & ~kProxyBit;
+        vec4 a = nodeAux[2u * ai], b = nodeAux[2u * ai + 1u];
+        sdCyl(p, a.xyz, b.xyz, a.w, g);
+        return g;
+    }
+
+    Branch b = branch(id);
+    grow(b);
+    float d = sdCyl(p, b.s, b.e, b.r, g);
+
+    uint pi = parentOf(id);
+    if (pi == kNoParent) return g;
+    Branch q = branch(pi);
+    if (!grow(q)) return g;
+    vec3 gq; float dq = sdCyl(p, q.s, q.e, q.r, gq);
+    if (dq >= d + kBlend) return g;
+    return mix(gq, g, smoothWeight(dq, d));
+}
+
+/* world‑space unit normal at the hit; k = instance (forest only) */
+vec3 hitNormal(vec3 p, uint id, uint k)
+{
+    if (pc.flags.z < 0.5)
+        return normalize(hitGrad(p, id));
+
+    /* rows r0..r2 = R^T / scale: into plant space and back out */
+    vec4 r0 = inst[k * 4u], r1 = inst[k * 4u + 1u], r2 = inst[k * 4u + 2u];
+    vec3 q = p - vec3(r0.w, r1.w, r2.w);
+    vec3 g = hitGrad(vec3(dot(r0.xyz, q), dot(r1.xyz, q), dot(r2.xyz, q)), id);
+    return normalize(r0.xyz * g.x + r1.xyz * g.y + r2.xyz * g.z);
+}
+
+/*────────────────────────  shading  ──────────────────────────*/
+vec3 shade(vec3 p, vec3 n)
+{
+    vec3 base = vec3(0.4, 0.3, 0.2);
+    vec3 L = normalize(vec3(1, 1, -0.5));
+    vec3 V = normalize(pc.camPos.xyz - p);
+    vec3 H = normalize(L + V);
+
+    vec3 amb = 0.15 * base;
+    vec3 dif = 0.75 * base * max(dot(n, L), 0.0);
+    float sp = pow(max(dot(n, H), 0.0), 16.0) * 0.2;
+    return amb + dif + vec3(sp);
+}
+
+/*────────────────────────  skeleton overlay  ─────────────────*/
+/* Branch axes drawn kLinePixels wide on top of everything.  A ray
+   query through the plant's BVH: a box is entered if the ray passes
+   within a line width of it, measured at its far corner, so a pixel
+   pays for the boxes along its ray - not for every branch.          */
+const float kLinePixels = 0.75;        // half-width
+
+/* the axis a-b within ang * t of the ray at its closest point */
+bool nearAxis(vec3 ro, vec3 rd, vec3 a, vec3 b, float ang)
+{
+    vec3 ab = b - a, ao = ro - a;
+    float ab2 = dot(ab, ab), d = dot(rd, ab), e = dot(ao, ab), f = dot(rd, ao);
+    float den = ab2 - d * d;
+    float u = den > 1e-9 ? clamp((e - d * f) / den, 0.0, 1.0) : 0.0;
+    float t = max(d * u - f, 0.0);
+    u = clamp((e + d * t) / max(ab2, 1e-12), 0.0, 1.0);
+    return length(ao + rd * t - ab * u) < ang * t;
+}
+
+bool nearBox(vec3 ro, vec3 inv, vec3 mn, vec3 mx, float ang)
+{
+    float w = ang * length(max(abs(mn - ro), abs(mx - ro)));
+    vec3 a = (mn - w - ro) * inv, b = (mx + w - ro) * inv;
+    vec3 lo = min(a, b), hi = max(a, b);
+    float ta = max(max(lo.x, lo.y), lo.z), tb = min(min(hi.x, hi.y), hi.z);
+    return ta <= tb && tb >= 0.0;
+}
+
+bool nearLeaf(vec3 ro, vec3 rd, uint lo, uint n, float ang)
+{
+    for (uint i = 0u; i < n; ++i)
+    {
+        Branch b = branch(lo + i);
+        if (grow(b) && nearAxis(ro, rd, b.s, b.e, ang)) return true;
+    }
+    return false;
+}
+
+/* single plant at word 0; any hit ends the walk */
+bool skeletonHit(vec3 ro, vec3 rd)
+{
+    float ang = kLinePixels * 2.0 / pc.scr.y;      // rays span ndc.y in [-1,1]
+    vec3 inv = 1.0 / rd;
+
+    if (kBvhWidth > 2u)
+    {
+        uint stack[64]; int sp = 0;
+        stack[sp++] = 0u;
+        while (sp > 0)
+        {
+            uint ni = stack[--sp];
+            uint hdr = wideWord(0u, ni, 3u);
+            uint cnt = hdr >> 24;
+            vec3 org = uintBitsToFloat(uvec3(wideWord(0u, ni, 0u), wideWord(0u, ni, 1u), wideWord(0u, ni, 2u)));
+            vec3 scl = exp2(vec3(bitfieldExtract(int(hdr), 0, 8),
+                                 bitfieldExtract(int(hdr), 8, 8),
+                                 bitfieldExtract(int(hdr), 16, 8)));
+            for (uint c = 0u; c < cnt; ++c)
+            {
+                vec3 lo = vec3(planeByte(0u, ni, 0u, c), planeByte(0u, ni, 2u, c), planeByte(0u, ni, 4u, c));
+                vec3 hi = vec3(planeByte(0u, ni, 1u, c), planeByte(0u, ni, 3u, c), planeByte(0u, ni, 5u, c));
+                if (!nearBox(ro, inv, org + lo * scl, org + hi * scl, ang)) continue;
+                uint ref = wideWord(0u, ni, 4u + c);
+                if ((ref & 0x80000000u) != 0u)
+                {
+                    if (nearLeaf(ro, rd, ref & 0x00ffffffu, (ref >> 24) & 0x7fu, ang)) return true;
+                }
+                else if (sp < 64 && !unborn(ref)) stack[sp++] = ref;
+            }
+        }
+        return false;
+    }
+
+    /* binary: the skip links are there whether or not kStackless */
+    Node root = node(0u, 0u);
+    uint end = root.leaf ? 1u : root.lo;
+    uint ni = 0u;
+    while (ni < end)
+    {
+        Node nd = node(0u, ni);
+        bool cull = !nearBox(ro, inv, nd.mn, nd.mx, ang) || unborn(ni);
+        if (nd.leaf)
+        {
+            if (!cull && nearLeaf(ro, rd, nd.lo, nd.hi, ang)) return true;
+            ni += 1u + nd.skip;
+        }
+        else ni = cull ? nd.lo : ni + 1u;
+    }
+    return false;
+}
+
+/*────────────────────────  main()  ───────────────────────────*/
+void main()
+{
+    ivec2 gid = ivec2(gl_GlobalInvocationID.xy);
+    if (gid.x >= int(pc.scr.x) || gid.y >= int(pc.scr.y)) return;
+
+    vec3 ro, rd;
+    cameraRay(gid, ro, rd);
+
+    /*──── optional wire‑frame overlay ────*/
+    if (kSkeleton && pc.flags.z < 0.5 && skeletonHit(ro, rd))   // single plant only
+    {
+        imageStore(outImg, gid, vec4(1.0));      // white line
+        return;
+    }
+
+    /* background: tiles the prepass found empty were never marched,
+       their visibility texels are stale                              */
+    if (imageLoad(coneImg, gid / int(kConeTile)).x >= kFar) {
+        imageStore(outImg, gid, vec4(0.0, 0.15, 0.2, 1.0));
+        return;
+    }
+
+    uvec4 vis = imageLoad(visImg, gid);
+    float t = uintBitsToFloat(vis.x);
+
+    if (t > kFar - 0.1) {
+        imageStore(outImg, gid, vec4(0.0, 0.15, 0.2, 1.0));
+        return;
+    }
+
+    if (kVisMode == 2u)            /* test‑count heat‑map          */
+    {
+        float m = clamp(float(vis.w) / pc.scr.z, 0.0, 1.0);
+        imageStore(outImg, gid, vec4(m, 0.0, 1.0 - m, 1.0));
+    }
+    else if (kVisMode == 1u)       /* BFS depth visualisation      */
+    {
+        /* a proxy stands in for twigs below pixel size: deepest level */
+        float bfs = (vis.y & kProxyBit) != 0u ? pc.scr.w : branch(vis.y).bfs;
+        float c = clamp(bfs / pc.scr.w, 0.0, 1.0);
+        imageStore(outImg, gid, vec4(c, 1.0 - c, 0.0, 1.0));
+    }
+    else                           /* regular shading              */
+    {
+        vec3 pos = ro + rd * t;
+        vec3 n = hitNormal(pos, vis.y, vis.z & 0xffffu);
+        imageStore(outImg, gid, vec4(shade(pos, n), 1.0));
+    }
+}
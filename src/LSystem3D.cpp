@@ -136,7 +136,7 @@ static std::vector<Symbol> tokenize(const std::string& str)
 /*  Single expansion pass  (feature 4 : probabilistic pruning)             */
 /*=========================================================================*/
 static std::vector<Symbol> expandOnce(const std::vector<Symbol>& cur,
-    const std::vector<ParametricRule>& rules)
+    const std::vector<ParametricRule>& rules, int pass)
 {
     std::vector<Symbol> next;
     int depth = 0;                 // bracket?depth for pruning
@@ -167,7 +167,7 @@ static std::vector<Symbol> expandOnce(const std::vector<Symbol>& cur,
             if (!ok) continue;
 
             for (const auto& os : R.successor) {
-                Symbol o{ os.name,{} };
+                Symbol o{ os.name,{}, pass + 1 };
                 for (const auto& ex : os.paramExprs) {
                     std::unique_ptr<Expr> e(compileExpr(ex));
                     o.params.push_back(e->eval(env));
@@ -181,6 +181,26 @@ static std::vector<Symbol> expandOnce(const std::vector<Symbol>& cur,
     return next;
 }
 
+/*=========================================================================*/
+/*  Growth clock (temporal BVH)                                            */
+/*=========================================================================*/
+/* A segment starts when its parent is fully grown, but never before the
+   derivation pass that wrote it; thick low-depth segments take longer.
+   Times are normalised so the whole plant is grown at 1.                */
+static void assignGrowthTimes(std::vector<CPUBranch>& out, const std::vector<int>& gen)
+{
+    float end = 0.f;
+    for (size_t i = 0; i < out.size(); ++i) {
+        CPUBranch& b = out[i];
+        float start = b.parentIndex < 0 ? 0.f : out[b.parentIndex].grown;
+        b.birth = std::max(start, float(gen[i]));
+        b.grown = b.birth + 2.f / (2.f + b.bfsDepth);
+        end = std::max(end, b.grown);
+    }
+    if (end <= 0.f) return;
+    for (auto& b : out) { b.birth /= end; b.grown /= end; }
+}
+
 /*=========================================================================*/
 /*  generateLSystem    turtle + variation 1?3,5?7                         */
 /*=========================================================================*/
@@ -199,13 +219,14 @@ std::vector<CPUBranch> generateLSystem(const LSystemPreset& P)
 
     /* 1) expand ------------------------------------------------------- */
     std::vector<Symbol> cur = P.axiom;
-    for (int i = 0; i < P.iterations; ++i) cur = expandOnce(cur, P.rules);
+    for (int i = 0; i < P.iterations; ++i) cur = expandOnce(cur, P.rules, i);
 
     /* 2) turtle pass -------------------------------------------------- */
     struct Turtle { glm::vec3 p, d, u; int parent; };
     std::stack<Turtle> st;
     st.push({ {0,-1,0},{0,1,0},{0,0,1},-1 });
     std::vector<CPUBranch> out;
+    std::vector<int> gen;              /* derivation pass per segment */
 
     auto rot = [&](glm::vec3 v, float a, const glm::vec3& ax) {
         return glm::vec3(glm::rotate(glm::mat4(1), a, ax) * glm::vec4(v, 0)); };
@@ -245,6 +266,7 @@ std::vector<CPUBranch> generateLSystem(const LSystemPreset& P)
                 std::pow(taperFactor, depth); /* features 5 & 6 */
 
             out.push_back(br);
+            gen.push_back(S.gen);
             st.top().parent = int(out.size()) - 1;
             st.top().p = b;
 
@@ -283,6 +305,7 @@ std::vector<CPUBranch> generateLSystem(const LSystemPreset& P)
         computeMedialAxisRadii(out);
         for (auto& b : out) b.radius *= thickScale;   // keep noise
     }
+    assignGrowthTimes(out, gen);
     return out;
 }
 
@@ -8,6 +8,8 @@
 #include "FileUtils.hpp"
 #include "vulkanbackend.hpp"      // low?level functions (unchanged)
 #include "LSystem3D.hpp" 
+#include "WideBVH.hpp"
+#include "TwoLevelBVH.hpp"
 
  /* ---------- std / utility ---------- */
 #include <iostream>
@@ -40,6 +42,7 @@
 #include <stdexcept>
 #include <iomanip>
 #include <array>
+#include <cstring>
 
 /* ---------- tiny helpers that fix glm::min/max overload trouble ---------- */
 static inline glm::vec3 vmin(glm::vec3 a, glm::vec3 b)
@@ -70,6 +73,7 @@ VulkanRaymarchApp::VulkanRaymarchApp(uint32_t w, uint32_t h,
     initWindow();
     initVulkan();
     maybeRegeneratePlant(true);
+    tuneWorkgroups(false);
     m_startTime = std::chrono::steady_clock::now();
 }
 VulkanRaymarchApp::VulkanRaymarchApp(uint32_t w, uint32_t h,
@@ -86,6 +90,7 @@ VulkanRaymarchApp::VulkanRaymarchApp(uint32_t w, uint32_t h,
     initWindow();      /* invisible window is fine  off?screen rendering */
     initVulkan();
     maybeRegeneratePlant(true);        /* first sample */
+    tuneWorkgroups(false);
 }
 VulkanRaymarchApp::~VulkanRaymarchApp()
 {
@@ -93,13 +98,30 @@ VulkanRaymarchApp::~VulkanRaymarchApp()
     cleanupSwapChain();
     if (m_branchBuffer) vkDestroyBuffer(m_device, m_branchBuffer, nullptr);
     if (m_branchMem)    vkFreeMemory(m_device, m_branchMem, nullptr);
+    if (m_bvhNodeBuf)   vkDestroyBuffer(m_device, m_bvhNodeBuf, nullptr);
+    if (m_bvhNodeMem)   vkFreeMemory(m_device, m_bvhNodeMem, nullptr);
+    if (m_instanceBuf)  vkDestroyBuffer(m_device, m_instanceBuf, nullptr);
+    if (m_instanceMem)  vkFreeMemory(m_device, m_instanceMem, nullptr);
+    if (m_nodeAuxBuf)   vkDestroyBuffer(m_device, m_nodeAuxBuf, nullptr);
+    if (m_nodeAuxMem)   vkFreeMemory(m_device, m_nodeAuxMem, nullptr);
     vkDestroyDescriptorSetLayout(m_device, m_setLayout, nullptr);
     vkDestroyPipelineLayout(m_device, m_pipeLayout, nullptr);
-    vkDestroyPipeline(m_device, m_pipeline, nullptr);
+    for (auto& [key, pipe] : m_pipelines) vkDestroyPipeline(m_device, pipe, nullptr);
     vkDestroyDescriptorPool(m_device, m_descPool, nullptr);
     vkDestroyImage(m_device, m_storageImage, nullptr);
     vkDestroyImageView(m_device, m_storageView, nullptr);
     vkFreeMemory(m_device, m_storageMem, nullptr);
+    vkDestroyImage(m_device, m_visImage, nullptr);
+    vkDestroyImageView(m_device, m_visView, nullptr);
+    vkFreeMemory(m_device, m_visMem, nullptr);
+    vkDestroyImage(m_device, m_coneImage, nullptr);
+    vkDestroyImageView(m_device, m_coneView, nullptr);
+    vkFreeMemory(m_device, m_coneMem, nullptr);
+    vkDestroyBuffer(m_device, m_tileBuf, nullptr);
+    vkFreeMemory(m_device, m_tileMem, nullptr);
+    vkDestroyBuffer(m_device, m_stagingBuf, nullptr);
+    vkFreeMemory(m_device, m_stagingMem, nullptr);
+    vkDestroyFence(m_device, m_uploadFence, nullptr);
     vkDestroyCommandPool(m_device, m_cmdPool, nullptr);
     for (size_t i = 0; i < m_imgAvailSems.size(); ++i) {
         vkDestroySemaphore(m_device, m_imgAvailSems[i], nullptr);
@@ -155,8 +177,16 @@ void VulkanRaymarchApp::initWindow()
         glfwSetKeyCallback(m_window, [](GLFWwindow* w, int key, int, int act, int) {
             if (act != GLFW_PRESS) return;
             auto* a = static_cast<VulkanRaymarchApp*>(glfwGetWindowUserPointer(w));
-            if (key == GLFW_KEY_D) a->m_debugColoring = !a->m_debugColoring;
+            if (key == GLFW_KEY_D) a->m_visMode = (a->m_visMode + 1) % 3;
+            if (key == GLFW_KEY_K) a->m_skeleton = !a->m_skeleton;
+            if (key == GLFW_KEY_Q) a->m_quality = (a->m_quality + 1) % 3;
+            if (key == GLFW_KEY_B) a->m_blend = !a->m_blend;
+            if (key == GLFW_KEY_W) a->tuneWorkgroups(true);
             if (key == GLFW_KEY_C) a->maybeRegeneratePlant(true);
+            if (key == GLFW_KEY_G) a->startGrowth();
+            if (key == GLFW_KEY_F) a->buildForest();
+            if (key == GLFW_KEY_T) a->m_timedGrowth = !a->m_timedGrowth;
+            if (key == GLFW_KEY_L) a->m_lodPixels = a->m_lodPixels > 0.f ? 0.f : 1.f;
             if (key == GLFW_KEY_H) {   /* random hybrid on H */
                 LSystemPreset h = randomHybrid(
                     [&] { std::vector<LSystemPreset> vec;
@@ -404,23 +434,160 @@ void VulkanRaymarchApp::maybeRegeneratePlant(bool force)
     if (m_branchBuffer) { vkDestroyBuffer(m_device, m_branchBuffer, nullptr); m_branchBuffer = VK_NULL_HANDLE; }
     if (m_branchMem) { vkFreeMemory(m_device, m_branchMem, nullptr);   m_branchMem = VK_NULL_HANDLE; }
 
-    createBranchBuffer(m_cpuBranches, m_branchBuffer, m_branchMem, m_numBranches);
+    /* leaf order: each BVH leaf owns a contiguous run of the branch SSBO */
+    BvhBuildOptions opt;
+    opt.builder = BvhBuilder::Topology;
+    opt.leafOrder = true;
+    m_cachedBVH = buildBVH(m_cpuBranches, opt);
 
-    m_cachedBVH = buildBVH(m_cpuBranches);
-    uploadBVH(m_cachedBVH);
+    const std::vector<CPUBranch> slots =
+        reorderBranches(m_cpuBranches, m_cachedBVH.order, m_cachedBVH.clip);
+    createBranchBuffer(slots, m_branchBuffer, m_branchMem, m_numBranches);
+    uploadBVH(m_cachedBVH, slots);
     updateDescriptorSetsWithBranchBuffer();
 
+    m_forest = false;                      /* back to one plant */
+    m_numInstances = 0;
+    if (!m_instanceBuf) uploadInstances({});   /* binding 3 must be valid */
+
     m_maxBFS = 0.f;
     for (const auto& br : m_cpuBranches) m_maxBFS = std::max(m_maxBFS, br.bfsDepth);
 }
 
+/* ---------------- growth replay --------------------------------------
+   The branch SSBO goes up once in generation order (DynamicBVH leaves
+   address it directly); each frame adds a few branches to the tree and
+   uploads only the node ranges that changed.                           */
+void VulkanRaymarchApp::startGrowth()
+{
+    if (m_cpuBranches.empty()) return;
+    vkDeviceWaitIdle(m_device);
+
+    if (m_branchBuffer) { vkDestroyBuffer(m_device, m_branchBuffer, nullptr); m_branchBuffer = VK_NULL_HANDLE; }
+    if (m_branchMem) { vkFreeMemory(m_device, m_branchMem, nullptr);   m_branchMem = VK_NULL_HANDLE; }
+    createBranchBuffer(m_cpuBranches, m_branchBuffer, m_branchMem, m_numBranches);
+    updateDescriptorSetsWithBranchBuffer();
+
+    m_dynBVH.clear();
+    m_bvhNodeBytes = 0;                  /* first step uploads in full */
+    m_hasBirths = m_hasNodeAux = false;
+    m_forest = false;
+    m_numInstances = 0;
+    m_grown = 0;
+    m_growing = true;
+}
+
+void VulkanRaymarchApp::stepGrowth()
+{
+    const uint32_t kBranchesPerFrame = 4;
+    const uint32_t n = uint32_t(m_cpuBranches.size());
+    for (uint32_t k = 0; k < kBranchesPerFrame && m_grown < n; ++k, ++m_grown)
+        m_dynBVH.insert(m_grown, m_cpuBranches[m_grown]);
+
+    if (m_grown < n) {
+        std::vector<BvhDirtyRange> dirty;
+        const BuiltBVH& b = m_dynBVH.serialize(dirty);
+        updateBVH(b, dirty);
+        return;
+    }
+
+    /* grown: hold the full plant 2 s in the configured width, with its
+       LOD proxies.  flatten() drops the slack slots bvhNodeAux() cannot
+       read; its leaves index m_cpuBranches (generation order) like the
+       branch SSBO does.  No births: the clock would grow it in again.  */
+    m_growing = false;
+    vkDeviceWaitIdle(m_device);
+    uploadBVH(m_dynBVH.flatten(), m_cpuBranches);
+    m_hasBirths = false;
+    m_cycleStart = std::chrono::duration<float>(
+        std::chrono::steady_clock::now() - m_startTime).count();
+}
+
+/* ---------------- forest ---------------------------------------------
+   A few presets become species; every species is built and uploaded
+   once, the grid only adds 16-float instance records and TLAS nodes.
+   The forest stays up (no auto-cycling) until C or G.                 */
+void VulkanRaymarchApp::buildForest()
+{
+    if (m_presets.empty()) return;
+    const size_t kSpecies = std::min<size_t>(4, m_presets.size());
+    const int    kGrid = 12;
+
+    std::vector<std::vector<CPUBranch>> species;
+    float spacing = 0.f, height = 0.f;
+    m_maxBFS = 0.f;
+    for (size_t s = 0; s < kSpecies; ++s) {
+        std::vector<CPUBranch> br =
+            generateLSystem(m_presets[(m_speciesIndex + s) % m_presets.size()].second);
+        glm::vec3 mn(1e9f), mx(-1e9f);
+        for (auto& b : br) {                         /* same shrink as one plant */
+            b.startX *= .40f; b.endX *= .40f;
+            b.startY *= .40f; b.endY *= .40f;
+            b.startZ *= .40f; b.endZ *= .40f;
+            mn = vmin(vmin(mn, { b.startX, b.startY, b.startZ }), { b.endX, b.endY, b.endZ });
+            mx = vmax(vmax(mx, { b.startX, b.startY, b.startZ }), { b.endX, b.endY, b.endZ });
+            m_maxBFS = std::max(m_maxBFS, b.bfsDepth);
+        }
+        if (br.empty()) continue;
+        spacing = std::max(spacing, std::max(mx.x - mn.x, mx.z - mn.z));
+        height = std::max(height, mx.y);
+        species.push_back(std::move(br));
+    }
+    if (species.empty()) return;
+
+    std::mt19937& gen = rng();
+    std::uniform_real_distribution<float> uf(0.f, 1.f);
+    std::vector<PlantInstance> inst;
+    for (int z = 0; z < kGrid; ++z)
+        for (int x = 0; x < kGrid; ++x) {
+            PlantInstance pi;
+            pi.position = glm::vec3((x - 0.5f * (kGrid - 1) + 0.6f * (uf(gen) - 0.5f)) * spacing, 0.f,
+                (z - 0.5f * (kGrid - 1) + 0.6f * (uf(gen) - 0.5f)) * spacing);
+            pi.yaw = uf(gen) * 6.2831853f;
+            pi.scale = 0.8f + 0.4f * uf(gen);
+            pi.species = uint32_t(gen() % species.size());
+            inst.push_back(pi);
+        }
+
+    BvhBuildOptions opt;
+    opt.builder = BvhBuilder::Topology;
+    TwoLevelBVH f = buildTwoLevel(species, inst, m_bvhWidth, opt);
+
+    /* ---------------- GPU upload ------------------- */
+    vkDeviceWaitIdle(m_device);
+    m_growing = false;
+
+    if (m_branchBuffer) { vkDestroyBuffer(m_device, m_branchBuffer, nullptr); m_branchBuffer = VK_NULL_HANDLE; }
+    if (m_branchMem) { vkFreeMemory(m_device, m_branchMem, nullptr);   m_branchMem = VK_NULL_HANDLE; }
+    createBranchBuffer(f.branches, m_branchBuffer, m_branchMem, m_numBranches);
+    updateDescriptorSetsWithBranchBuffer();
+
+    createStorageBuffer(m_bvhNodeBuf, m_bvhNodeMem,
+        f.nodeWords.data(), f.nodeWords.size() * sizeof(uint32_t));
+    m_bvhNodeBytes = 0;
+    bindStorageBuffer(2, m_bvhNodeBuf);
+    createStorageBuffer(m_nodeAuxBuf, m_nodeAuxMem,
+        f.nodeAux.data(), f.nodeAux.size() * sizeof(BvhNodeAux));
+    bindStorageBuffer(4, m_nodeAuxBuf);
+    m_hasBirths = false;                 /* forest is shown fully grown */
+    m_hasNodeAux = true;
+    uploadInstances(f.instanceData);
+
+    m_numInstances = f.instanceCount();
+    m_forest = true;
+
+    m_camCenterY = 0.5f * height;
+    m_camDist = std::min(100.f, 0.9f * spacing * kGrid);
+}
+
 
 /* =======================================================================
    SECTION 7 :  drawFrame
    =======================================================================*/
 void VulkanRaymarchApp::drawFrame()
 {
-    maybeRegeneratePlant();
+    if (m_growing) stepGrowth();
+    else if (!m_forest) maybeRegeneratePlant();
 
     vkWaitForFences(m_device, 1, &m_inFlight[m_frameIndex], VK_TRUE, UINT64_MAX);
     vkResetFences(m_device, 1, &m_inFlight[m_frameIndex]);
@@ -472,32 +639,63 @@ void VulkanRaymarchApp::drawFrame()
 /* =======================================================================
    SECTION 8 :  recordCommandBuffer
    =======================================================================*/
-void VulkanRaymarchApp::recordCommandBuffer(VkCommandBuffer cmd,
-    uint32_t imgIndex)
+static void barrier(VkCommandBuffer cmd, VkImage img, VkImageLayout oldL, VkImageLayout newL,
+    VkAccessFlags srcA, VkAccessFlags dstA,
+    VkPipelineStageFlags srcS, VkPipelineStageFlags dstS)
 {
-    VkCommandBufferBeginInfo bi{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
-    vkBeginCommandBuffer(cmd, &bi);
+    VkImageMemoryBarrier b{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+    b.oldLayout = oldL; b.newLayout = newL;
+    b.srcAccessMask = srcA; b.dstAccessMask = dstA;
+    b.srcQueueFamilyIndex = b.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    b.image = img;
+    b.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    b.subresourceRange.levelCount = b.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(cmd, srcS, dstS, 0,
+        0, nullptr, 0, nullptr, 1, &b);
+}
+
+static void bufBarrier(VkCommandBuffer cmd, VkBuffer buf, VkAccessFlags srcA, VkAccessFlags dstA,
+    VkPipelineStageFlags srcS, VkPipelineStageFlags dstS)
+{
+    VkBufferMemoryBarrier b{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+    b.srcAccessMask = srcA; b.dstAccessMask = dstA;
+    b.srcQueueFamilyIndex = b.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    b.buffer = buf; b.offset = 0; b.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(cmd, srcS, dstS, 0,
+        0, nullptr, 1, &b, 0, nullptr);
+}
 
-    auto barrier = [&](VkImage img, VkImageLayout oldL, VkImageLayout newL,
-        VkAccessFlags srcA, VkAccessFlags dstA,
-        VkPipelineStageFlags srcS, VkPipelineStageFlags dstS)
-        {
-            VkImageMemoryBarrier b{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
-            b.oldLayout = oldL; b.newLayout = newL;
-            b.srcAccessMask = srcA; b.dstAccessMask = dstA;
-            b.srcQueueFamilyIndex = b.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            b.image = img;
-            b.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            b.subresourceRange.levelCount = b.subresourceRange.layerCount = 1;
-            vkCmdPipelineBarrier(cmd, srcS, dstS, 0,
-                0, nullptr, 0, nullptr, 1, &b);
-        };
-
-    barrier(m_storageImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+/* cone, march and shade pass into the storage image (left in GENERAL).
+   With a timing pool: timestamps 0..3 before the cone pass, after it,
+   before the shade pass and after it (tuneWorkgroups)                 */
+void VulkanRaymarchApp::recordPasses(VkCommandBuffer cmd, uint32_t imgIndex, VkQueryPool timing)
+{
+    /* the tile list and the cone / vis / storage images are shared by the
+       frames in flight: nothing is rewritten until the previous frame's
+       indirect dispatch, shaders and swapchain copy are done with it     */
+    bufBarrier(cmd, m_tileBuf, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+    /* empty tile list: 0 x 1 x 1 march workgroups until the prepass appends */
+    const uint32_t listHeader[4] = { 0, 1, 1, 0 };
+    vkCmdUpdateBuffer(cmd, m_tileBuf, 0, sizeof(listHeader), listHeader);
+    bufBarrier(cmd, m_tileBuf, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    barrier(cmd, m_storageImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+        0, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    barrier(cmd, m_visImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
         0, VK_ACCESS_SHADER_WRITE_BIT,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    barrier(cmd, m_coneImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+        0, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
 
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineVariant(kConePass));
     vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
         m_pipeLayout, 0, 1, &m_descSets[imgIndex],
         0, nullptr);
@@ -521,7 +719,9 @@ void VulkanRaymarchApp::recordCommandBuffer(VkCommandBuffer cmd,
         glm::vec4 camPos, camR, camU, camF;
         glm::vec4 screen, flags;
     } pc;
-    pc.camPos = glm::vec4(pos, 0);
+    /* LOD: pixel footprint per unit distance (rays span ndc.y in [-1,1]) */
+    const float lod = m_hasNodeAux ? m_lodPixels * 2.f / float(m_swapChainExtent.height) : 0.f;
+    pc.camPos = glm::vec4(pos, lod);
     pc.camR = glm::vec4(right, 0);
     pc.camU = glm::vec4(up, 0);
     pc.camF = glm::vec4(glm::normalize(fwd), 0);
@@ -529,22 +729,71 @@ void VulkanRaymarchApp::recordCommandBuffer(VkCommandBuffer cmd,
         float(m_swapChainExtent.height),
         float(m_numBranches),
         m_maxBFS);
-//    pc.flags = glm::vec4(m_debugColoring ? 1.f : 0.f, 0, 0, 0);
-    pc.flags = glm::vec4(1.0f, 1.0f, 0, 0);
+    /* growth clock: each new plant grows in from the node/branch birth
+       times already on the GPU - no rebuild or upload per frame       */
+    float clock = 1.f;
+    if (m_timedGrowth && m_hasBirths && m_mode == Mode::Interactive) {
+        const float now = std::chrono::duration<float>(
+            std::chrono::steady_clock::now() - m_startTime).count();
+        clock = std::clamp((now - m_cycleStart) / kGrowSeconds, 0.f, 1.f);
+    }
+    /* vis mode and skeleton are baked into the shade variant */
+    pc.flags = glm::vec4(0.0f, 0.0f, float(m_numInstances), clock);
 
     vkCmdPushConstants(cmd, m_pipeLayout, VK_SHADER_STAGE_COMPUTE_BIT,
         0, sizeof(PC), &pc);
 
-    uint32_t gx = (m_swapChainExtent.width + 7) / 8;
-    uint32_t gy = (m_swapChainExtent.height + 7) / 8;
+    /* cone prepass (tuned tiles per workgroup) -> start depths + the
+       list of occupied tiles; march pass, indirect, one workgroup per
+       listed tile -> visibility buffer; shade pass over the full screen
+       (tuned workgroups) fills in the background for the rest.  All
+       three share the push block / set.                               */
+    const WorkgroupShape& cs = kWorkgroupShapes[m_coneShape];
+    const WorkgroupShape& ss = kWorkgroupShapes[m_shadeShape];
+    uint32_t cx = (m_swapChainExtent.width + kConeTile - 1) / kConeTile;
+    uint32_t cy = (m_swapChainExtent.height + kConeTile - 1) / kConeTile;
+    if (timing) vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timing, 0);
+    vkCmdDispatch(cmd, (cx + cs.x - 1) / cs.x, (cy + cs.y - 1) / cs.y, 1);
+    if (timing) vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timing, 1);
+
+    barrier(cmd, m_coneImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+        VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    bufBarrier(cmd, m_tileBuf, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineVariant(kMarchPass));
+    vkCmdDispatchIndirect(cmd, m_tileBuf, 0);
+
+    uint32_t gx = (m_swapChainExtent.width + ss.x - 1) / ss.x;
+    uint32_t gy = (m_swapChainExtent.height + ss.y - 1) / ss.y;
+
+    barrier(cmd, m_visImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+        VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineVariant(kShadePass));
+    if (timing) vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timing, 2);
     vkCmdDispatch(cmd, gx, gy, 1);
+    if (timing) vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timing, 3);
+}
 
-    barrier(m_storageImage, VK_IMAGE_LAYOUT_GENERAL,
+void VulkanRaymarchApp::recordCommandBuffer(VkCommandBuffer cmd,
+    uint32_t imgIndex)
+{
+    VkCommandBufferBeginInfo bi{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    vkBeginCommandBuffer(cmd, &bi);
+
+    recordPasses(cmd, imgIndex);
+
+    barrier(cmd, m_storageImage, VK_IMAGE_LAYOUT_GENERAL,
         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
         VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
 
-    barrier(m_swapChainImages[imgIndex], VK_IMAGE_LAYOUT_UNDEFINED,
+    barrier(cmd, m_swapChainImages[imgIndex], VK_IMAGE_LAYOUT_UNDEFINED,
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
         0, VK_ACCESS_TRANSFER_WRITE_BIT,
         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
@@ -560,7 +809,7 @@ void VulkanRaymarchApp::recordCommandBuffer(VkCommandBuffer cmd,
         m_swapChainImages[imgIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
         1, &copy);
 
-    barrier(m_swapChainImages[imgIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+    barrier(cmd, m_swapChainImages[imgIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
         VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
         VK_ACCESS_TRANSFER_WRITE_BIT, 0,
         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
@@ -576,15 +825,56 @@ void VulkanRaymarchApp::createBranchBuffer(const std::vector<CPUBranch>& src,
 {
     std::vector<CPUBranch> data = src.empty() ? std::vector<CPUBranch>(1) : src;
     count = static_cast<uint32_t>(data.size());
-    VkDeviceSize size = count * 9 * sizeof(float);
+    std::vector<uint32_t> words = packBranches(data, m_branchFormat);
+    createStorageBuffer(buf, mem, words.data(), words.size() * sizeof(uint32_t));
+}
+
+void VulkanRaymarchApp::updateDescriptorSetsWithBranchBuffer()
+{
+    if (m_branchBuffer == VK_NULL_HANDLE)          // nothing to bind
+        return;
+
+    VkDescriptorBufferInfo bi{};
+    bi.buffer = m_branchBuffer;
+    bi.offset = 0;
+    bi.range = VK_WHOLE_SIZE;
+
+    for (VkDescriptorSet ds : m_descSets)
+    {
+        VkWriteDescriptorSet wr{};
+        wr.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        wr.dstSet = ds;
+        wr.dstBinding = 1;                       // **binding1 ? BranchBuf**
+        wr.dstArrayElement = 0;
+        wr.descriptorCount = 1;
+        wr.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        wr.pBufferInfo = &bi;
+
+        vkUpdateDescriptorSets(m_device, 1, &wr, 0, nullptr);
+    }
+}
+
+/* SSBO holding a copy of src (one dummy word when empty): device-local
+   and filled through the staging ring, or host-visible and written in
+   place on a UMA device (createStagingRing decides)                     */
+void VulkanRaymarchApp::createStorageBuffer(VkBuffer& buf, VkDeviceMemory& mem,
+    const void* src, size_t sz)
+{
+    if (sz == 0) {
+        static const uint32_t dummy = 0;
+        src = &dummy;  sz = sizeof(dummy);
+    }
+    vkWaitForFences(m_device, 1, &m_uploadFence, VK_TRUE, UINT64_MAX);
+    if (buf) { vkDestroyBuffer(m_device, buf, nullptr); buf = VK_NULL_HANDLE; }
+    if (mem) { vkFreeMemory(m_device, mem, nullptr);    mem = VK_NULL_HANDLE; }
 
     VkBufferCreateInfo bc{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
-    bc.size = size;
-    bc.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    bc.size = sz;
+    bc.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
     bc.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
     if (vkCreateBuffer(m_device, &bc, nullptr, &buf) != VK_SUCCESS)
-        throw std::runtime_error("vkCreateBuffer (branch SSBO)");
+        throw std::runtime_error("vkCreateBuffer (SSBO)");
 
     VkMemoryRequirements req;
     vkGetBufferMemoryRequirements(m_device, buf, &req);
@@ -592,139 +882,281 @@ void VulkanRaymarchApp::createBranchBuffer(const std::vector<CPUBranch>& src,
     VkPhysicalDeviceMemoryProperties mp;
     vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &mp);
 
-    uint32_t idx = UINT32_MAX;
-    for (uint32_t i = 0; i < mp.memoryTypeCount; ++i) {
-        if ((req.memoryTypeBits & (1u << i)) &&
-            (mp.memoryTypes[i].propertyFlags &
-                (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)))
-        {
-            idx = i; break;
-        }
-    }
-    if (idx == UINT32_MAX)
-        throw std::runtime_error("No host-visible memory type for branch SSBO");
+    /* the same shared mask createStagingRing() found m_uma by */
+    const VkMemoryPropertyFlags want = m_uma
+        ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+        : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    uint32_t idx = 0;
+    for (; idx < mp.memoryTypeCount; ++idx)
+        if ((req.memoryTypeBits & (1u << idx)) &&
+            (mp.memoryTypes[idx].propertyFlags & want) == want)
+            break;
+    if (idx == mp.memoryTypeCount)
+        throw std::runtime_error("No memory type for SSBO");
 
     VkMemoryAllocateInfo ai{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
     ai.allocationSize = req.size;
     ai.memoryTypeIndex = idx;
 
     if (vkAllocateMemory(m_device, &ai, nullptr, &mem) != VK_SUCCESS)
-        throw std::runtime_error("vkAllocateMemory (branch SSBO)");
-
+        throw std::runtime_error("vkAllocateMemory (SSBO)");
     vkBindBufferMemory(m_device, buf, mem, 0);
 
-    /* upload ------------------------------------------------------------ */
-    void* ptr = nullptr;
-    vkMapMemory(m_device, mem, 0, size, 0, &ptr);
-    float* fp = static_cast<float*>(ptr);
+    if (m_uma) {
+        void* ptr = nullptr;
+        vkMapMemory(m_device, mem, 0, sz, 0, &ptr);
+        std::memcpy(ptr, src, sz);
+        vkUnmapMemory(m_device, mem);
+        return;
+    }
+    stageUpload(buf, 0, src, sz);
+    flushUploads();
+}
 
-    for (auto& b : data) {
-        *fp++ = b.startX; *fp++ = b.startY; *fp++ = b.startZ;
-        *fp++ = b.radius;
-        *fp++ = b.endX;   *fp++ = b.endY;   *fp++ = b.endZ;
-        *fp++ = b.bfsDepth;
+/* queue a copy of src into dst at off through the staging ring.  The
+   ring fills front to back; a full one is flushed, and waited on
+   before it is written again                                         */
+void VulkanRaymarchApp::stageUpload(VkBuffer dst, VkDeviceSize off, const void* src, size_t bytes)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(src);
+    while (bytes > 0) {
+        if (m_stagingHead == m_stagingBytes) flushUploads();
+        if (!m_uploadOpen) {
+            vkWaitForFences(m_device, 1, &m_uploadFence, VK_TRUE, UINT64_MAX);
+            vkResetFences(m_device, 1, &m_uploadFence);
+            vkResetCommandBuffer(m_uploadCmd, 0);
+            VkCommandBufferBeginInfo bi{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+            bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            vkBeginCommandBuffer(m_uploadCmd, &bi);
+            /* write-after-read: earlier frames on the queue may still
+               read a buffer this batch patches (updateBVH)           */
+            VkMemoryBarrier mb{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+            mb.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            vkCmdPipelineBarrier(m_uploadCmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &mb, 0, nullptr, 0, nullptr);
+            m_uploadOpen = true;
+            m_stagingHead = 0;
+        }
+        const VkDeviceSize n = std::min<VkDeviceSize>(bytes, m_stagingBytes - m_stagingHead);
+        std::memcpy(m_stagingPtr + m_stagingHead, p, size_t(n));
+        VkBufferCopy copy{ m_stagingHead, off, n };
+        vkCmdCopyBuffer(m_uploadCmd, m_stagingBuf, dst, 1, &copy);
 
-        union { float f; uint32_t u; } conv;
-        conv.u = (b.parentIndex < 0) ? 0xffffffffu : uint32_t(b.parentIndex);
-        *fp++ = conv.f;
+        m_stagingHead = std::min(m_stagingBytes, (m_stagingHead + n + 15) & ~VkDeviceSize(15));
+        p += n; off += n; bytes -= size_t(n);
     }
-    vkUnmapMemory(m_device, mem);
 }
 
-void VulkanRaymarchApp::updateDescriptorSetsWithBranchBuffer()
+/* submit the queued copies; the barrier makes them visible to every
+   compute pass submitted after them on the same queue              */
+void VulkanRaymarchApp::flushUploads()
 {
-    if (m_branchBuffer == VK_NULL_HANDLE)          // nothing to bind
-        return;
+    if (!m_uploadOpen) return;
 
-    VkDescriptorBufferInfo bi{};
-    bi.buffer = m_branchBuffer;
-    bi.offset = 0;
-    bi.range = VK_WHOLE_SIZE;
+    VkMemoryBarrier mb{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+    mb.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    mb.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(m_uploadCmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &mb, 0, nullptr, 0, nullptr);
+    vkEndCommandBuffer(m_uploadCmd);
 
-    for (VkDescriptorSet ds : m_descSets)
-    {
-        VkWriteDescriptorSet wr{};
-        wr.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        wr.dstSet = ds;
-        wr.dstBinding = 1;                       // **binding1 ? BranchBuf**
-        wr.dstArrayElement = 0;
-        wr.descriptorCount = 1;
-        wr.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        wr.pBufferInfo = &bi;
+    VkSubmitInfo si{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+    si.commandBufferCount = 1; si.pCommandBuffers = &m_uploadCmd;
+    if (vkQueueSubmit(m_computeQueue, 1, &si, m_uploadFence) != VK_SUCCESS)
+        throw std::runtime_error("vkQueueSubmit (uploads)");
+    m_uploadOpen = false;
+}
 
-        vkUpdateDescriptorSets(m_device, 1, &wr, 0, nullptr);
+void VulkanRaymarchApp::bindStorageBuffer(uint32_t binding, VkBuffer buf)
+{
+    if (buf == VK_NULL_HANDLE) return;
+
+    for (auto ds : m_descSets) {
+        VkDescriptorBufferInfo bi{ buf, 0, VK_WHOLE_SIZE };
+
+        VkWriteDescriptorSet w{};
+        w.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        w.dstSet = ds;
+        w.dstBinding = binding;
+        w.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        w.descriptorCount = 1;
+        w.pBufferInfo = &bi;
+
+        vkUpdateDescriptorSets(m_device, 1, &w, 0, nullptr);
     }
 }
 
-void VulkanRaymarchApp::uploadBVH(const BuiltBVH& b)
+void VulkanRaymarchApp::uploadBVH(const BuiltBVH& b, const std::vector<CPUBranch>& slots)
 {
-    auto makeBuf = [&](VkBuffer& buf, VkDeviceMemory& mem,
-        const void* src, size_t sz)
-        {
-            if (sz == 0) {                             
-                static const uint32_t dummy = 0;       
-                src = &dummy;  sz = sizeof(dummy);
-            }
-            if (buf) { vkDestroyBuffer(m_device, buf, nullptr); buf = VK_NULL_HANDLE; }
-            if (mem) { vkFreeMemory(m_device, mem, nullptr);    mem = VK_NULL_HANDLE; }
-
-            VkBufferCreateInfo bc{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
-            bc.size = sz;
-            bc.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
-            bc.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    /* empty: no LOD proxies, no growth clock (DynamicBVH replay) */
+    std::vector<BvhNodeAux> aux;
+    if (!slots.empty()) aux = bvhNodeAux(b, slots);
+
+    if (m_bvhWidth > 2 && !m_growing) {
+        /* same bindings, collapsed layout - shader picks it via spec id 0 */
+        WideBVH w = collapseBVH(b, m_bvhWidth);
+        createStorageBuffer(m_bvhNodeBuf, m_bvhNodeMem, w.words.data(), w.words.size() * sizeof(uint32_t));
+        m_bvhNodeBytes = 0;
+        if (!aux.empty()) {                      /* wide node -> its binary node */
+            std::vector<BvhNodeAux> wa;
+            for (uint32_t n : w.binNode) wa.push_back(aux[n]);
+            aux.swap(wa);
+        }
+    }
+    else {
+        createStorageBuffer(m_bvhNodeBuf, m_bvhNodeMem, b.nodes.data(), b.nodes.size() * sizeof(BvhNode));
+        m_bvhNodeBytes = b.nodes.size() * sizeof(BvhNode);
+    }
+    createStorageBuffer(m_nodeAuxBuf, m_nodeAuxMem, aux.data(), aux.size() * sizeof(BvhNodeAux));
+    m_hasBirths = m_hasNodeAux = !aux.empty();
 
-            if (vkCreateBuffer(m_device, &bc, nullptr, &buf) != VK_SUCCESS)
-                throw std::runtime_error("vkCreateBuffer (BVH)");
+    bindStorageBuffer(2, m_bvhNodeBuf);          /* BVH nodes */
+    bindStorageBuffer(4, m_nodeAuxBuf);          /* LOD proxy + birth per node */
+}
 
-            VkMemoryRequirements req;
-            vkGetBufferMemoryRequirements(m_device, buf, &req);
+/* binding 3: 4 x vec4 per instance (TwoLevelBVH::instanceData) */
+void VulkanRaymarchApp::uploadInstances(const std::vector<glm::vec4>& records)
+{
+    createStorageBuffer(m_instanceBuf, m_instanceMem,
+        records.data(), records.size() * sizeof(glm::vec4));
+    bindStorageBuffer(3, m_instanceBuf);
+}
 
-            VkPhysicalDeviceMemoryProperties mp;
-            vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &mp);
+/* patch the live (binary - growth replay runs on DynamicBVH's layout
+   whatever m_bvhWidth says) node buffer in place; only a grown array
+   is re-created.  No device idle per step: the patch is a staged copy
+   on the compute queue, and the ring's leading barrier holds it back
+   until the frames in flight are done reading the buffer            */
+void VulkanRaymarchApp::updateBVH(const BuiltBVH& b, const std::vector<BvhDirtyRange>& dirty)
+{
+    const VkDeviceSize bytes = b.nodes.size() * sizeof(BvhNode);
+    if (m_bvhNodeBytes == 0 || bytes != m_bvhNodeBytes) {
+        vkDeviceWaitIdle(m_device);
+        uploadBVH(b);
+        return;
+    }
+    for (const BvhDirtyRange& r : dirty)
+        stageUpload(m_bvhNodeBuf, r.first * sizeof(BvhNode), &b.nodes[r.first],
+            r.count * sizeof(BvhNode));
+    flushUploads();
+}
 
-            uint32_t idx = 0;
-            for (; idx < mp.memoryTypeCount; ++idx)
-                if ((req.memoryTypeBits & (1u << idx)) &&
-                    (mp.memoryTypes[idx].propertyFlags &
-                        (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)))
-                    break;
+/* =======================================================================
+   SECTION 10 :  workgroup autotuner
+   =======================================================================*/
+void VulkanRaymarchApp::tuneWorkgroups(bool force)
+{
+    constexpr uint32_t kShapes = uint32_t(std::size(kWorkgroupShapes));
+
+    VkPhysicalDeviceIDProperties ids{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES };
+    VkPhysicalDeviceProperties2 props{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+    props.pNext = &ids;
+    vkGetPhysicalDeviceProperties2(m_physicalDevice, &props);
+    const VkPhysicalDeviceLimits& lim = props.properties.limits;
+
+    std::ostringstream uuid;
+    for (uint8_t b : ids.deviceUUID)
+        uuid << std::hex << std::setw(2) << std::setfill('0') << int(b);
+
+    auto fits = [&](uint32_t s) {
+        const WorkgroupShape& w = kWorkgroupShapes[s];
+        return w.x <= lim.maxComputeWorkGroupSize[0] && w.y <= lim.maxComputeWorkGroupSize[1]
+            && w.x * w.y <= lim.maxComputeWorkGroupInvocations; };
+    auto shapeOf = [&](uint32_t x, uint32_t y) {
+        uint32_t s = 0;
+        while (s < kShapes && (kWorkgroupShapes[s].x != x || kWorkgroupShapes[s].y != y)) ++s;
+        return s; };
+
+    /* one line per device: uuid coneX coneY shadeX shadeY */
+    std::vector<std::string> others;
+    {
+        std::ifstream in(kWorkgroupCache);
+        for (std::string line; std::getline(in, line); ) {
+            std::istringstream ls(line);
+            std::string id; uint32_t cx, cy, sx, sy;
+            if (!(ls >> id >> cx >> cy >> sx >> sy)) continue;
+            if (id != uuid.str()) { others.push_back(line); continue; }
+            uint32_t c = shapeOf(cx, cy), s = shapeOf(sx, sy);
+            if (!force && c < kShapes && s < kShapes && fits(c) && fits(s)) {
+                m_coneShape = c; m_shadeShape = s;
+                return;
+            }
+        }
+    }
 
-            VkMemoryAllocateInfo ai{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
-            ai.allocationSize = req.size;
-            ai.memoryTypeIndex = idx;
+    uint32_t qCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &qCount, nullptr);
+    std::vector<VkQueueFamilyProperties> qProps(qCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &qCount, qProps.data());
+    const uint32_t validBits = qProps[m_computeQFamily].timestampValidBits;
+    if (validBits == 0) {
+        std::cout << "No timestamps on the compute queue, keeping the default workgroups\n";
+        return;
+    }
+    const uint64_t mask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
 
-            vkAllocateMemory(m_device, &ai, nullptr, &mem);
-            vkBindBufferMemory(m_device, buf, mem, 0);
+    VkQueryPoolCreateInfo qi{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+    qi.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    qi.queryCount = 4;
+    VkQueryPool pool;
+    if (vkCreateQueryPool(m_device, &qi, nullptr, &pool) != VK_SUCCESS)
+        throw std::runtime_error("vkCreateQueryPool failed");
 
-            void* ptr = nullptr;
-            vkMapMemory(m_device, mem, 0, sz, 0, &ptr);
-            std::memcpy(ptr, src, sz);
-            vkUnmapMemory(m_device, mem);
-        };
+    VkCommandBuffer cmd;
+    VkCommandBufferAllocateInfo cai{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+    cai.commandPool = m_cmdPool; cai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY; cai.commandBufferCount = 1;
+    vkAllocateCommandBuffers(m_device, &cai, &cmd);
 
-    makeBuf(m_bvhNodeBuf, m_bvhNodeMem, b.nodes.data(), b.nodes.size() * sizeof(BvhNode));
-    makeBuf(m_bvhLeafBuf, m_bvhLeafMem, b.leafIdx.data(), b.leafIdx.size() * sizeof(uint32_t));
+    vkDeviceWaitIdle(m_device);
 
-    for (auto ds : m_descSets) {
-        VkDescriptorBufferInfo ni{ m_bvhNodeBuf, 0, VK_WHOLE_SIZE };
-        VkDescriptorBufferInfo li{ m_bvhLeafBuf, 0, VK_WHOLE_SIZE };
-
-        VkWriteDescriptorSet w[2]{};
-        w[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        w[0].dstSet = ds;
-        w[0].dstBinding = 2;                         /* BVH nodes */
-        w[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        w[0].descriptorCount = 1;
-        w[0].pBufferInfo = &ni;
-
-        w[1] = w[0];
-        w[1].dstBinding = 3;                       /* BVH leaves */
-        w[1].pBufferInfo = &li;
-
-        vkUpdateDescriptorSets(m_device, 2, w, 0, nullptr);
+    /* every shape drives both passes at once; the best of a few frames
+       (the first one, cold, is dropped) decides each pass on its own    */
+    const int kFrames = 6;
+    double bestCone = 1e30, bestShade = 1e30;
+    uint32_t cone = m_coneShape, shade = m_shadeShape;
+    for (uint32_t s = 0; s < kShapes; ++s) {
+        if (!fits(s)) continue;
+        m_coneShape = m_shadeShape = s;
+        double coneMs = 1e30, shadeMs = 1e30;
+        for (int f = 0; f < kFrames; ++f) {
+            vkResetCommandBuffer(cmd, 0);
+            VkCommandBufferBeginInfo bi{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+            bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            vkBeginCommandBuffer(cmd, &bi);
+            vkCmdResetQueryPool(cmd, pool, 0, 4);
+            recordPasses(cmd, 0, pool);
+            vkEndCommandBuffer(cmd);
+
+            VkSubmitInfo si{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+            si.commandBufferCount = 1; si.pCommandBuffers = &cmd;
+            vkQueueSubmit(m_computeQueue, 1, &si, VK_NULL_HANDLE);
+            vkQueueWaitIdle(m_computeQueue);
+
+            uint64_t ts[4];
+            vkGetQueryPoolResults(m_device, pool, 0, 4, sizeof(ts), ts, sizeof(uint64_t),
+                VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+            if (f == 0) continue;
+            const double ms = double(lim.timestampPeriod) * 1e-6;
+            coneMs = std::min(coneMs, double((ts[1] - ts[0]) & mask) * ms);
+            shadeMs = std::min(shadeMs, double((ts[3] - ts[2]) & mask) * ms);
+        }
+        if (coneMs < bestCone)   { bestCone = coneMs; cone = s; }
+        if (shadeMs < bestShade) { bestShade = shadeMs; shade = s; }
     }
+    m_coneShape = cone; m_shadeShape = shade;
+
+    vkFreeCommandBuffers(m_device, m_cmdPool, 1, &cmd);
+    vkDestroyQueryPool(m_device, pool, nullptr);
+
+    const WorkgroupShape& c = kWorkgroupShapes[cone];
+    const WorkgroupShape& s = kWorkgroupShapes[shade];
+    std::cout << "Workgroups: cone " << c.x << "x" << c.y << " (" << bestCone << " ms), shade "
+        << s.x << "x" << s.y << " (" << bestShade << " ms)\n";
+
+    std::ofstream out(kWorkgroupCache, std::ios::trunc);
+    for (const std::string& line : others) out << line << "\n";
+    out << uuid.str() << " " << c.x << " " << c.y << " " << s.x << " " << s.y << "\n";
 }
 
 /* -----------------------------------------------------------------------
@@ -3,12 +3,15 @@
 #include <GLFW/glfw3.h>
 
 #include "BFSSystem.hpp"
+#include "BranchLayout.hpp"
 #include "BVH.hpp"
+#include "DynamicBVH.hpp"
 #include "LSystem3D.hpp"
 
 #include <vector>
 #include <string>
 #include <chrono>
+#include <unordered_map>
 
 /*------------------------------------------------------------------------------
    VulkanRaymarchApp – front‑end (window, camera, UI, dataset writer)
@@ -48,13 +51,78 @@ private:
 
     /* ---------- plant generation ---------- */
     void maybeRegeneratePlant(bool force = false);
-    void uploadBVH(const BuiltBVH&);
+    void uploadBVH(const BuiltBVH&, const std::vector<CPUBranch>& slots = {});
+    void updateBVH(const BuiltBVH&, const std::vector<BvhDirtyRange>& dirty);
+    void startGrowth();             /* G: replay the plant's growth */
+    void stepGrowth();
+    void buildForest();             /* F: instanced forest (TwoLevelBVH) */
+    void uploadInstances(const std::vector<glm::vec4>& records);
+    void createStorageBuffer(VkBuffer& buf, VkDeviceMemory& mem,
+        const void* src, size_t bytes);
+    void stageUpload(VkBuffer dst, VkDeviceSize offset, const void* src, size_t bytes);
+    void flushUploads();
+    void bindStorageBuffer(uint32_t binding, VkBuffer buf);
     void createBranchBuffer(const std::vector<CPUBranch>& src,
         VkBuffer& buf, VkDeviceMemory& mem,
         uint32_t& count);
     void updateDescriptorSetsWithBranchBuffer();
 
     BuiltBVH m_cachedBVH;
+    uint32_t m_bvhWidth = 4;        /* 2 = binary nodes, 4/8 = WideBVH;
+                                       baked into the pipeline (spec id 0) */
+    bool     m_stackless = true;    /* width 2 only: skip-link walk (id 1) */
+    uint32_t m_marchMode = 0;       /* march pass (id 2): 0 sphere-trace,
+                                       1 BVH leaf spans, 2 analytic hits */
+    uint32_t m_branchFormat = BRANCH_FORMAT_F32;   /* binding 1 records (id 3):
+                                       F32 32 B, Q16 16 B per branch */
+    uint32_t m_nodeCacheBytes = 8192;   /* shared memory for the top BVH
+                                       levels, 0 = no node cache */
+    uint32_t m_nodeCacheDepth = 0;  /* levels that fit (id 4), set by
+                                       createComputePipeline */
+
+    /* per-frame shader variants (ids 5..9): recordCommandBuffer binds the
+       one matching these, pipelineVariant() builds it on first use      */
+    struct QualityTier { uint32_t steps; float eps; };
+    static constexpr QualityTier kQualityTiers[3] = {
+        { 32, 0.004f }, { 64, 0.001f }, { 128, 0.0005f } };
+    uint32_t m_quality = 1;         /* Q cycles the tiers (ids 6, 7) */
+    bool     m_blend = true;        /* B: smooth-min joints or plain min (id 5) */
+    uint32_t m_visMode = 0;         /* D cycles: shade, BFS depth, tests (id 8) */
+    bool     m_skeleton = false;    /* K: branch-axis overlay (id 9) */
+    enum Pass : uint32_t { kConePass, kMarchPass, kShadePass };
+    VkPipeline pipelineVariant(Pass pass);
+
+    /* workgroup shapes of the cone and shade passes (ids 10, 11); the
+       march pass is one 8 x 8 workgroup per tile and stays as it is.
+       tuneWorkgroups() times each shape on the current plant and keeps
+       the fastest, remembered per device UUID in kWorkgroupCache      */
+    struct WorkgroupShape { uint32_t x, y; };
+    static constexpr WorkgroupShape kWorkgroupShapes[6] = {
+        { 8, 8 }, { 16, 8 }, { 8, 16 }, { 16, 16 }, { 32, 4 }, { 32, 8 } };
+    static constexpr const char* kWorkgroupCache = "workgroups.txt";
+    uint32_t m_coneShape = 0;       /* kWorkgroupShapes index, 8 x 8 */
+    uint32_t m_shadeShape = 3;      /* 16 x 16 */
+    void tuneWorkgroups(bool force);    /* W forces a fresh benchmark */
+    VkDeviceSize m_bvhNodeBytes = 0;    /* binary node buffer size, 0 = wide */
+
+    /* growth replay (G): branches enter a DynamicBVH a few per frame and
+       its binary nodes are patched in place, whatever m_bvhWidth is   */
+    DynamicBVH m_dynBVH;
+    bool       m_growing = false;
+    uint32_t   m_grown = 0;
+
+    /* growth clock (T toggles): push flags.w runs 0..1 per new plant */
+    static constexpr float kGrowSeconds = 1.25f;
+    bool       m_timedGrowth = true;
+    bool       m_hasBirths = false;     /* binding 4 matches binding 2 */
+
+    /* LOD (L toggles): subtrees under this many pixels draw their proxy */
+    float      m_lodPixels = 1.f;
+    bool       m_hasNodeAux = false;
+
+    /* forest (F): shared per-species BLAS + instance TLAS */
+    bool       m_forest = false;
+    uint32_t   m_numInstances = 0;      /* push flags.z, 0 = single plant */
     std::vector<CPUBranch>   m_cpuBranches;
     uint32_t                 m_numBranches = 0;
     float                    m_maxBFS = 0.f;
@@ -67,6 +135,7 @@ private:
     void createSurface();           void createSwapChain();
     void createSwapChainImageViews();
     void createCommandPool();       void createComputeResources();
+    void createStagingRing();
     void createStorageImage();      void createDescriptorSetLayout();
     void createComputePipeline();   void createDescriptorPoolAndSets();
     void createCommandBuffers();    void createSyncObjects();
@@ -75,6 +144,8 @@ private:
     /* ---------- per‑frame ---------- */
     void drawFrame();                      /* interactive */
     void recordCommandBuffer(VkCommandBuffer cmd, uint32_t imageIndex);
+    void recordPasses(VkCommandBuffer cmd, uint32_t imageIndex,
+        VkQueryPool timing = VK_NULL_HANDLE);
 
     /* ---------- helpers ---------- */
     bool  checkValidationLayerSupport();
@@ -121,19 +192,47 @@ private:
     VkDeviceMemory m_storageMem = VK_NULL_HANDLE;
     VkImageView    m_storageView = VK_NULL_HANDLE;
 
+    /* visibility buffer, march pass -> shade pass (rgba32ui) */
+    VkImage        m_visImage = VK_NULL_HANDLE;
+    VkDeviceMemory m_visMem = VK_NULL_HANDLE;
+    VkImageView    m_visView = VK_NULL_HANDLE;
+
+    /* cone prepass depths, one texel per kConeTile^2 pixels (r32f) */
+    static constexpr uint32_t kConeTile = 8;     /* = kConeTile in the shaders */
+    VkImage        m_coneImage = VK_NULL_HANDLE;
+    VkDeviceMemory m_coneMem = VK_NULL_HANDLE;
+    VkImageView    m_coneView = VK_NULL_HANDLE;
+
+    /* occupied cone tiles + VkDispatchIndirectCommand for the march pass */
+    VkBuffer       m_tileBuf = VK_NULL_HANDLE;
+    VkDeviceMemory m_tileMem = VK_NULL_HANDLE;
+
     /* branch + BVH SSBOs */
     VkBuffer       m_branchBuffer = VK_NULL_HANDLE;
     VkDeviceMemory m_branchMem = VK_NULL_HANDLE;
     VkBuffer       m_bvhNodeBuf = VK_NULL_HANDLE;
     VkDeviceMemory m_bvhNodeMem = VK_NULL_HANDLE;
-    VkBuffer       m_bvhLeafBuf = VK_NULL_HANDLE;
-    VkDeviceMemory m_bvhLeafMem = VK_NULL_HANDLE;
-    VkBuffer       m_leafIdxBuf = VK_NULL_HANDLE;
-    VkDeviceMemory m_leafIdxMem = VK_NULL_HANDLE;
+    VkBuffer       m_instanceBuf = VK_NULL_HANDLE;
+    VkDeviceMemory m_instanceMem = VK_NULL_HANDLE;
+    VkBuffer       m_nodeAuxBuf = VK_NULL_HANDLE;     /* BvhNodeAux */
+    VkDeviceMemory m_nodeAuxMem = VK_NULL_HANDLE;
+
+    /* the SSBOs above live in device-local memory and are filled through
+       this host-visible ring; on a UMA device they are host-visible and
+       written directly when created (m_uma), patched through the ring */
+    bool           m_uma = false;
+    VkDeviceSize   m_stagingBytes = 4 << 20;
+    VkBuffer       m_stagingBuf = VK_NULL_HANDLE;
+    VkDeviceMemory m_stagingMem = VK_NULL_HANDLE;
+    uint8_t*       m_stagingPtr = nullptr;           /* persistently mapped */
+    VkDeviceSize   m_stagingHead = 0;
+    VkCommandBuffer m_uploadCmd = VK_NULL_HANDLE;
+    VkFence        m_uploadFence = VK_NULL_HANDLE;  /* last flushUploads() */
+    bool           m_uploadOpen = false;             /* m_uploadCmd recording */
 
     VkDescriptorSetLayout        m_setLayout = VK_NULL_HANDLE;
     VkPipelineLayout             m_pipeLayout = VK_NULL_HANDLE;
-    VkPipeline                   m_pipeline = VK_NULL_HANDLE;
+    std::unordered_map<uint32_t, VkPipeline> m_pipelines;   /* variant key -> pipeline */
     VkDescriptorPool             m_descPool = VK_NULL_HANDLE;
     std::vector<VkDescriptorSet> m_descSets;
 
@@ -162,7 +261,6 @@ private:
     std::chrono::steady_clock::time_point m_startTime;
     float    m_cycleStart = 0.f;       /* preset auto‑cycle timer */
     size_t   m_speciesIndex = 0;
-    bool     m_debugColoring = false;
 
     /* presets pool (loaded once from presets.json) */
     std::vector<std::pair<std::string, LSystemPreset>> m_presets;
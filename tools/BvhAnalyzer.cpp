@@ -0,0 +1,242 @@
+/* --------------------------------------------------------------------------
+   BvhAnalyzer.cpp  -  headless BVH quality report (no Vulkan, no window)
+
+   Loads presets.json, grows every species, builds BuiltBVH exactly like
+   VulkanRaymarchApp::maybeRegeneratePlant() (topology builder, leaf order,
+   branches reordered to match) and prints one JSON record per plant (SAH,
+   area, overlap, depth, leaf histogram, visits per query).  --builder
+   picks another builder; median keeps the old leafIdx layout.
+   With --width 4|8 the tree is also collapsed to a wide BVH and the same
+   queries are replayed against it ("wide" record).  With --grow K the
+   plant is also grown into a DynamicBVH K branches at a time, reporting
+   the nodes each step re-serializes ("growth" record).  With --sdf the
+   query points are also run through the 8-wide packet evaluator
+   (SdfBatch) and timed against the scalar walk ("sdfBatch" record).
+
+   usage:  BvhAnalyzer [--queries N] [--seed S] [--width W] [--grow K] [--sdf]
+                       [--builder topology|median|sbvh|dynamic] [--out file.json]
+           (run from the repo root so presets.json is found)
+   --------------------------------------------------------------------------*/
+#include "BVH.hpp"
+#include "BVHStats.hpp"
+#include "DynamicBVH.hpp"
+#include "SdfBatch.hpp"
+#include "WideBVH.hpp"
+#include "LSystem3D.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+using json = nlohmann::ordered_json;   /* keep field order stable for diffs */
+
+/* same global shrink maybeRegeneratePlant() applies before upload */
+static constexpr float kPlantScale = 0.40f;
+
+static json toJson(const std::string& name, const BvhStats& s,
+    size_t branches, double buildMs)
+{
+    json j;
+    j["name"] = name;
+    j["branches"] = branches;
+    j["nodes"] = s.nodeCount;
+    j["leaves"] = s.leafCount;
+    j["primRefs"] = s.primRefs;
+    j["buildMs"] = buildMs;
+    j["sahCost"] = s.sahCost;
+    j["totalNodeArea"] = s.totalNodeArea;
+    j["siblingOverlap"] = s.siblingOverlap;
+    j["maxDepth"] = s.maxDepth;
+    j["avgLeafDepth"] = s.avgLeafDepth;
+    j["maxStackUse"] = s.maxStackUse;
+    j["stackOverflow"] = s.maxStackUse > kShaderStackSize;
+    j["leafSizeHistogram"] = s.leafSizeHistogram;
+    j["avgNodeVisits"] = s.avgNodeVisits;
+    j["avgLeafTests"] = s.avgLeafTests;
+    j["avgNodeVisitsStackless"] = s.avgNodeVisitsStackless;
+    return j;
+}
+
+/* replay growth in array order, K branches per step (one "frame") */
+static json growthJson(const std::vector<CPUBranch>& br, uint32_t step)
+{
+    DynamicBVH dyn;
+    std::vector<BvhDirtyRange> dirty;
+    uint64_t dirtySum = 0, rangeSum = 0;
+    uint32_t dirtyMax = 0, steps = 0;
+    double us = 0.0;
+
+    for (uint32_t first = 0; first < br.size(); first += step, ++steps) {
+        auto t0 = std::chrono::steady_clock::now();
+        uint32_t last = std::min<uint32_t>(first + step, uint32_t(br.size()));
+        for (uint32_t i = first; i < last; ++i) dyn.insert(i, br[i]);
+        dyn.serialize(dirty);
+        us += std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - t0).count();
+        uint32_t n = 0;
+        for (const BvhDirtyRange& r : dirty) n += r.count;
+        dirtySum += n;
+        rangeSum += dirty.size();
+        dirtyMax = std::max(dirtyMax, n);
+    }
+
+    json j;
+    j["step"] = step;
+    j["steps"] = steps;
+    j["finalNodes"] = dyn.built().nodes.size();
+    j["avgDirtyNodes"] = steps ? double(dirtySum) / steps : 0.0;
+    j["maxDirtyNodes"] = dirtyMax;
+    j["avgDirtyRanges"] = steps ? double(rangeSum) / steps : 0.0;
+    j["avgStepUs"] = steps ? us / steps : 0.0;
+    return j;
+}
+
+/* packet vs scalar SDF over random points in the root box */
+static json sdfBatchJson(const BuiltBVH& bvh, const std::vector<CPUBranch>& br,
+    uint32_t queries, uint32_t seed)
+{
+    SdfScene sc = makeSdfScene(bvh, br);
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> u01(0.f, 1.f);
+    std::vector<glm::vec3> pts(queries);
+    for (auto& p : pts)
+        p = bvh.nodes[0].mn + (bvh.nodes[0].mx - bvh.nodes[0].mn) * glm::vec3(u01(gen), u01(gen), u01(gen));
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<float> ref(pts.size());
+    for (size_t i = 0; i < pts.size(); ++i) ref[i] = sdfEval(sc, pts[i]);
+    auto t1 = std::chrono::steady_clock::now();
+    SdfBatchStats st;
+    std::vector<float> d = sdfEvalBatch(sc, pts, &st);
+    auto t2 = std::chrono::steady_clock::now();
+
+    float maxDiff = 0.f;
+    for (size_t i = 0; i < d.size(); ++i) maxDiff = std::max(maxDiff, std::fabs(d[i] - ref[i]));
+
+    json j;
+    j["scalarMs"] = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    j["batchMs"] = std::chrono::duration<double, std::milli>(t2 - t1).count();
+    j["laneUtilisation"] = st.laneUtilisation();
+    j["packets"] = st.packets;
+    j["splits"] = st.splits;
+    j["merges"] = st.merges;
+    j["maxAbsDiff"] = maxDiff;
+    return j;
+}
+
+static json toJson(const WideBvhStats& s)
+{
+    json j;
+    j["width"] = s.width;
+    j["nodes"] = s.nodeCount;
+    j["bytes"] = s.bytes;
+    j["maxStackUse"] = s.maxStackUse;
+    j["avgNodeVisits"] = s.avgNodeVisits;
+    j["avgLeafTests"] = s.avgLeafTests;
+    return j;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t queries = 4096, seed = 1, width = 2, grow = 0;
+    bool sdf = false;
+    BvhBuildOptions opt;                 /* as maybeRegeneratePlant() builds */
+    opt.builder = BvhBuilder::Topology;
+    opt.leafOrder = true;
+    std::string outPath;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) { std::cerr << "missing value for " << a << "\n"; std::exit(EXIT_FAILURE); }
+            return argv[++i];
+            };
+        if (a == "--queries") queries = (uint32_t)std::stoul(next());
+        else if (a == "--seed")    seed = (uint32_t)std::stoul(next());
+        else if (a == "--width")   width = (uint32_t)std::stoul(next());
+        else if (a == "--grow")    grow = (uint32_t)std::stoul(next());
+        else if (a == "--sdf")     sdf = true;
+        else if (a == "--builder") {
+            std::string b = next();
+            if (b == "median")      { opt.builder = BvhBuilder::Median; opt.leafOrder = false; }
+            else if (b == "topology") opt.builder = BvhBuilder::Topology;
+            else if (b == "sbvh")     opt.builder = BvhBuilder::SBVH;
+            else if (b == "dynamic")  opt.builder = BvhBuilder::Dynamic;
+            else { std::cerr << "unknown builder " << b << "\n"; return EXIT_FAILURE; }
+        }
+        else if (a == "--out")     outPath = next();
+        else {
+            std::cerr << "usage: BvhAnalyzer [--queries N] [--seed S] [--width W] [--grow K] [--sdf] "
+                "[--builder topology|median|sbvh|dynamic] [--out file.json]\n";
+            return EXIT_FAILURE;
+        }
+    }
+    if (width != 2 && width != 4 && width != 8) {
+        std::cerr << "--width must be 2, 4 or 8\n";
+        return EXIT_FAILURE;
+    }
+
+    /* the loader dumps every preset to stdout - keep stdout pure JSON */
+    std::vector<std::pair<std::string, LSystemPreset>> presets;
+    {
+        std::ostringstream sink;
+        std::streambuf* old = std::cout.rdbuf(sink.rdbuf());
+        try { presets = loadParametricPresets(false); }
+        catch (...) { std::cout.rdbuf(old); throw; }
+        std::cout.rdbuf(old);
+    }
+
+    json report;
+    report["queries"] = queries;
+    report["seed"] = seed;
+    report["builder"] = opt.builder == BvhBuilder::Topology ? "topology"
+        : opt.builder == BvhBuilder::SBVH ? "sbvh"
+        : opt.builder == BvhBuilder::Dynamic ? "dynamic" : "median";
+    report["leafOrder"] = opt.leafOrder;
+    report["plants"] = json::array();
+
+    for (const auto& [name, preset] : presets)
+    {
+        std::vector<CPUBranch> br = generateLSystem(preset);
+        for (auto& b : br) {
+            b.startX *= kPlantScale; b.startY *= kPlantScale; b.startZ *= kPlantScale;
+            b.endX *= kPlantScale;   b.endY *= kPlantScale;   b.endZ *= kPlantScale;
+        }
+
+        auto t0 = std::chrono::steady_clock::now();
+        BuiltBVH bvh = buildBVH(br, opt);
+        double ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - t0).count();
+
+        /* leaf order: leaves address the permuted array, as the SSBO does */
+        const std::vector<CPUBranch> slots =
+            opt.leafOrder ? reorderBranches(br, bvh.order, bvh.clip) : br;
+
+        json rec = toJson(name, analyzeBVH(bvh, slots, queries, seed), br.size(), ms);
+        if (width > 2)
+            rec["wide"] = toJson(analyzeWideBVH(collapseBVH(bvh, width), slots, queries, seed));
+        if (grow > 0)
+            rec["growth"] = growthJson(br, grow);
+        if (sdf)
+            rec["sdfBatch"] = sdfBatchJson(bvh, slots, queries, seed);
+        report["plants"].push_back(rec);
+    }
+
+    if (outPath.empty()) {
+        std::cout << report.dump(2) << "\n";
+    }
+    else {
+        std::ofstream f(outPath);
+        if (!f) { std::cerr << "cannot write " << outPath << "\n"; return EXIT_FAILURE; }
+        f << report.dump(2) << "\n";
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,215 @@
+/* --------------------------------------------------------------------------
+   CpuRender.cpp  -  headless render with the CPU reference raymarcher
+
+   Grows one preset (or the F-key forest), uploads it into a CpuScene the
+   way VulkanRaymarchApp does, and writes the same PNG captureFrameToPNG
+   would - without Vulkan.  Handy as a GPU-free dataset fallback and for
+   diffing shader changes against a known-good image.
+
+   usage:  CpuRender [--preset NAME] [--size W H] [--bvh 2|4|8] [--stack]
+                     [--march sphere|interval|analytic] [--branches f32|q16]
+                     [--cache BYTES] [--quality 0|1|2] [--no-blend]
+                     [--mode shade|bfs|tests] [--skeleton] [--forest]
+                     [--yaw DEG] [--pitch DEG] [--lod PX] [--clock T]
+                     [--threads N] [--seed S] [--out file.png]
+           (run from the repo root so presets.json is found)
+   --------------------------------------------------------------------------*/
+#include "CpuRaymarcher.hpp"
+#include "LSystem3D.hpp"
+#include "WideBVH.hpp"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+/* same global shrink maybeRegeneratePlant() applies before upload */
+static constexpr float kPlantScale = 0.40f;
+
+static void shrink(std::vector<CPUBranch>& br, glm::vec3& mn, glm::vec3& mx, float& maxBFS)
+{
+    mn = glm::vec3(1e9f); mx = glm::vec3(-1e9f);
+    for (auto& b : br) {
+        b.startX *= kPlantScale; b.startY *= kPlantScale; b.startZ *= kPlantScale;
+        b.endX *= kPlantScale;   b.endY *= kPlantScale;   b.endZ *= kPlantScale;
+        mn = glm::min(glm::min(mn, { b.startX, b.startY, b.startZ }), { b.endX, b.endY, b.endZ });
+        mx = glm::max(glm::max(mx, { b.startX, b.startY, b.startZ }), { b.endX, b.endY, b.endZ });
+        maxBFS = std::max(maxBFS, b.bfsDepth);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string presetName, outPath = "cpu_render.png";
+    uint32_t W = 512, H = 512, bvhWidth = 4, threads = 0, seed = 1;
+    uint32_t march = 0, branchFormat = BRANCH_FORMAT_F32, cacheBytes = 8192;
+    uint32_t mode = 0, quality = 1;
+    bool stackless = true, skeleton = false, forest = false, blend = true;
+    float yaw = 0.f, pitch = 15.f, lodPixels = 1.f, clock = 1.f;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) { std::cerr << "missing value for " << a << "\n"; std::exit(EXIT_FAILURE); }
+            return argv[++i];
+            };
+        if (a == "--preset")        presetName = next();
+        else if (a == "--size")     { W = (uint32_t)std::stoul(next()); H = (uint32_t)std::stoul(next()); }
+        else if (a == "--bvh")      bvhWidth = (uint32_t)std::stoul(next());
+        else if (a == "--stack")    stackless = false;
+        else if (a == "--skeleton") skeleton = true;
+        else if (a == "--no-blend") blend = false;
+        else if (a == "--quality")  quality = (uint32_t)std::stoul(next());
+        else if (a == "--forest")   forest = true;
+        else if (a == "--yaw")      yaw = std::stof(next());
+        else if (a == "--pitch")    pitch = std::stof(next());
+        else if (a == "--lod")      lodPixels = std::stof(next());
+        else if (a == "--clock")    clock = std::stof(next());
+        else if (a == "--threads")  threads = (uint32_t)std::stoul(next());
+        else if (a == "--seed")     seed = (uint32_t)std::stoul(next());
+        else if (a == "--cache")    cacheBytes = (uint32_t)std::stoul(next());
+        else if (a == "--out")      outPath = next();
+        else if (a == "--mode") {
+            std::string m = next();
+            if (m == "shade")      mode = 0;
+            else if (m == "bfs")   mode = 1;
+            else if (m == "tests") mode = 2;
+            else { std::cerr << "unknown mode " << m << "\n"; return EXIT_FAILURE; }
+        }
+        else if (a == "--march") {
+            std::string m = next();
+            if (m == "sphere")        march = 0;
+            else if (m == "interval") march = 1;
+            else if (m == "analytic") march = 2;
+            else { std::cerr << "unknown march " << m << "\n"; return EXIT_FAILURE; }
+        }
+        else if (a == "--branches") {
+            std::string m = next();
+            if (m == "f32")      branchFormat = BRANCH_FORMAT_F32;
+            else if (m == "q16") branchFormat = BRANCH_FORMAT_Q16;
+            else { std::cerr << "unknown branch format " << m << "\n"; return EXIT_FAILURE; }
+        }
+        else {
+            std::cerr << "usage: CpuRender [--preset NAME] [--size W H] [--bvh 2|4|8] [--stack] "
+                "[--march sphere|interval|analytic] [--branches f32|q16] [--cache BYTES] [--quality 0|1|2] [--no-blend] [--mode shade|bfs|tests] [--skeleton] [--forest] "
+                "[--yaw DEG] [--pitch DEG] "
+                "[--lod PX] [--clock T] [--threads N] [--seed S] [--out file.png]\n";
+            return EXIT_FAILURE;
+        }
+    }
+    if (bvhWidth != 2 && bvhWidth != 4 && bvhWidth != 8) {
+        std::cerr << "--bvh must be 2, 4 or 8\n";
+        return EXIT_FAILURE;
+    }
+    if (quality > 2) {
+        std::cerr << "--quality must be 0, 1 or 2\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::pair<std::string, LSystemPreset>> presets;
+    {
+        std::ostringstream sink;                     /* loader is chatty */
+        std::streambuf* old = std::cout.rdbuf(sink.rdbuf());
+        try { presets = loadParametricPresets(false); }
+        catch (...) { std::cout.rdbuf(old); throw; }
+        std::cout.rdbuf(old);
+    }
+    if (presets.empty()) { std::cerr << "no presets\n"; return EXIT_FAILURE; }
+
+    size_t first = 0;
+    if (!presetName.empty()) {
+        while (first < presets.size() && presets[first].first != presetName) ++first;
+        if (first == presets.size()) { std::cerr << "unknown preset " << presetName << "\n"; return EXIT_FAILURE; }
+    }
+
+    /* scene + camera, as maybeRegeneratePlant() / buildForest() -------- */
+    CpuScene scene;
+    float maxBFS = 0.f, centerY = 0.f, dist = 3.f;
+    uint32_t numInstances = 0;
+    bool hasBirths = false;
+
+    if (!forest) {
+        std::vector<CPUBranch> br = generateLSystem(presets[first].second);
+        glm::vec3 mn, mx;
+        shrink(br, mn, mx, maxBFS);
+        scene = cpuScenePlant(br, bvhWidth, branchFormat);
+        centerY = 0.5f * (mn.y + mx.y);
+        dist = 0.75f * glm::length(mx - mn);
+        hasBirths = true;
+    }
+    else {
+        const size_t kSpecies = std::min<size_t>(4, presets.size());
+        const int    kGrid = 12;
+        std::vector<std::vector<CPUBranch>> species;
+        float spacing = 0.f, height = 0.f;
+        for (size_t s = 0; s < kSpecies; ++s) {
+            std::vector<CPUBranch> br = generateLSystem(presets[(first + s) % presets.size()].second);
+            glm::vec3 mn, mx;
+            shrink(br, mn, mx, maxBFS);
+            if (br.empty()) continue;
+            spacing = std::max(spacing, std::max(mx.x - mn.x, mx.z - mn.z));
+            height = std::max(height, mx.y);
+            species.push_back(std::move(br));
+        }
+        if (species.empty()) { std::cerr << "empty species\n"; return EXIT_FAILURE; }
+
+        std::mt19937 gen(seed);
+        std::uniform_real_distribution<float> uf(0.f, 1.f);
+        std::vector<PlantInstance> inst;
+        for (int z = 0; z < kGrid; ++z)
+            for (int x = 0; x < kGrid; ++x) {
+                PlantInstance pi;
+                pi.position = glm::vec3((x - 0.5f * (kGrid - 1) + 0.6f * (uf(gen) - 0.5f)) * spacing, 0.f,
+                    (z - 0.5f * (kGrid - 1) + 0.6f * (uf(gen) - 0.5f)) * spacing);
+                pi.yaw = uf(gen) * 6.2831853f;
+                pi.scale = 0.8f + 0.4f * uf(gen);
+                pi.species = uint32_t(gen() % species.size());
+                inst.push_back(pi);
+            }
+
+        BvhBuildOptions opt;
+        opt.builder = BvhBuilder::Topology;
+        TwoLevelBVH f = buildTwoLevel(species, inst, bvhWidth, opt);
+        scene = cpuSceneForest(f, bvhWidth, branchFormat);
+        numInstances = f.instanceCount();
+        centerY = 0.5f * height;
+        dist = std::min(100.f, 0.9f * spacing * kGrid);
+    }
+    scene.stackless = stackless;
+    scene.marchMode = march;
+    scene.nodeCacheDepth = nodeCacheDepth(bvhWidth, stackless, cacheBytes);
+
+    /* the variant pipelineVariant() would bind (VulkanRaymarchApp::kQualityTiers) */
+    const uint32_t kSteps[3] = { 32, 64, 128 };
+    const float    kEps[3] = { 0.004f, 0.001f, 0.0005f };
+    scene.blend = blend ? 0.005f : 0.f;
+    scene.steps = kSteps[quality];
+    scene.eps = kEps[quality];
+    scene.visMode = mode;
+    scene.skeleton = skeleton;
+
+    CpuPush pc = cpuOrbitCamera(centerY, dist, yaw, pitch, W, H);
+    pc.camPos.w = lodPixels * 2.f / float(H);
+    pc.scr.z = float(std::max<uint32_t>(1, scene.numBranches));
+    pc.scr.w = maxBFS;
+    pc.flags = glm::vec4(0.f, 0.f, float(numInstances),
+        hasBirths ? std::clamp(clock, 0.f, 1.f) : 1.f);
+
+    std::vector<uint8_t> rgba;
+    CpuRenderStats st = cpuRaymarch(scene, pc, rgba, threads);
+
+    if (!stbi_write_png(outPath.c_str(), int(W), int(H), 4, rgba.data(), int(W) * 4)) {
+        std::cerr << "cannot write " << outPath << "\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << outPath << ": " << W << "x" << H << " " << scene.numBranches << " branches, "
+        << st.ms << " ms on " << st.threads << " threads, "
+        << st.avgTests << " tests/px, " << st.avgSteps << " steps/px, "
+        << 100.0 * st.marchedTiles << "% tiles marched\n";
+    return EXIT_SUCCESS;
+}